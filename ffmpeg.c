@@ -45,6 +45,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/avstring.h"
 #include "libavutil/libm.h"
+#include "libavutil/profile.h"
 #include "libavformat/os_support.h"
 
 #if CONFIG_AVFILTER
@@ -201,6 +202,7 @@ static int64_t input_ts_offset = 0;
 static int file_overwrite = 0;
 static AVMetadata *metadata;
 static int do_benchmark = 0;
+static int do_benchmark_stages = 0;
 static int do_hex_dump = 0;
 static int do_pkt_dump = 0;
 static int do_psnr = 0;
@@ -314,6 +316,7 @@ typedef struct AVInputStream {
     AVStream *st;
     int discard;             /* true if stream data should be discarded */
     int decoding_needed;     /* true if the packets must be decoded in 'raw_fifo' */
+    int nb_outputs;          /* number of output streams fed by this stream */
     int64_t sample_index;      /* current sample */
 
     int64_t       start;     /* time when read started */
@@ -736,15 +739,8 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
     int ret;
 
     while(bsfc){
-        AVPacket new_pkt= *pkt;
-        int a= av_bitstream_filter_filter(bsfc, avctx, NULL,
-                                          &new_pkt.data, &new_pkt.size,
-                                          pkt->data, pkt->size,
-                                          pkt->flags & AV_PKT_FLAG_KEY);
-        if(a>0){
-            av_free_packet(pkt);
-            new_pkt.destruct= av_destruct_packet;
-        } else if(a<0){
+        int a= av_bitstream_filter_filter_packet(bsfc, avctx, NULL, pkt);
+        if(a<0){
             fprintf(stderr, "%s failed for stream %d, codec %s",
                     bsfc->filter->name, pkt->stream_index,
                     avctx->codec ? avctx->codec->name : "copy");
@@ -752,7 +748,6 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
             if (exit_on_error)
                 ffmpeg_exit(1);
         }
-        *pkt= new_pkt;
 
         bsfc= bsfc->next;
     }
@@ -1458,7 +1453,7 @@ static void print_report(AVFormatContext **output_files,
 /* pkt = NULL means EOF (needed to flush decoder buffers) */
 static int output_packet(AVInputStream *ist, int ist_index,
                          AVOutputStream **ost_table, int nb_ostreams,
-                         const AVPacket *pkt)
+                         AVPacket *pkt)
 {
     AVFormatContext *os;
     AVOutputStream *ost;
@@ -1733,6 +1728,16 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             opkt.size = data_size;
                         }
 
+                        /* if nothing else uses the input packet, hand its
+                           buffer over, so that the bitstream filters can
+                           rewrite it in place and the muxer need not copy it */
+                        if (!opkt.destruct && ist->nb_outputs == 1 &&
+                            pkt->destruct == av_destruct_packet &&
+                            opkt.data == pkt->data && opkt.size == pkt->size) {
+                            opkt.destruct = pkt->destruct;
+                            pkt->destruct = NULL;
+                        }
+
                         write_frame(os, &opkt, ost->st->codec, ost->bitstream_filters);
                         ost->st->codec->frame_number++;
                         ost->frame_number++;
@@ -2096,6 +2101,7 @@ static int transcode(AVFormatContext **output_files,
             }
             ist = ist_table[ost->source_index];
             ist->discard = 0;
+            ist->nb_outputs++;
             ost->sync_ist = (nb_stream_maps > 0) ?
                 ist_table[file_table[stream_maps[n].sync_file_index].ist_index +
                          stream_maps[n].sync_stream_index] : ist;
@@ -4199,6 +4205,8 @@ static const OptionDef options[] = {
     { "dframes", OPT_INT | HAS_ARG, {(void*)&max_frames[AVMEDIA_TYPE_DATA]}, "set the number of data frames to record", "number" },
     { "benchmark", OPT_BOOL | OPT_EXPERT, {(void*)&do_benchmark},
       "add timings for benchmarking" },
+    { "benchmark_stages", OPT_BOOL | OPT_EXPERT, {(void*)&do_benchmark_stages},
+      "show the time spent in each decoder, filter, demuxer and muxer" },
     { "timelimit", OPT_FUNC2 | HAS_ARG, {(void*)opt_timelimit}, "set max runtime in seconds", "limit" },
     { "dump", OPT_BOOL | OPT_EXPERT, {(void*)&do_pkt_dump},
       "dump each input packet" },
@@ -4357,6 +4365,8 @@ int main(int argc, char **argv)
         ffmpeg_exit(1);
     }
 
+    if (do_benchmark_stages)
+        av_profile_enable(1);
     ti = getutime();
     if (transcode(output_files, nb_output_files, input_files, nb_input_files,
                   stream_maps, nb_stream_maps) < 0)
@@ -4366,6 +4376,8 @@ int main(int argc, char **argv)
         int maxrss = getmaxrss() / 1024;
         printf("bench: utime=%0.3fs maxrss=%ikB\n", ti / 1000000.0, maxrss);
     }
+    if (do_benchmark_stages)
+        av_profile_dump(NULL, AV_LOG_INFO);
 
     return ffmpeg_exit(0);
 }
@@ -36,12 +36,17 @@
 #include "libavutil/avstring.h"
 #include "libavutil/lfg.h"
 #include "libavutil/random_seed.h"
+#include "libavutil/slab.h"
 #include "libavcore/parseutils.h"
 #include "libavcodec/opt.h"
 #include <stdarg.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#if HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 #if HAVE_POLL_H
 #include <poll.h>
 #endif
@@ -70,6 +75,7 @@ enum HTTPState {
     HTTPSTATE_RECEIVE_DATA,
     HTTPSTATE_WAIT_FEED,          /* wait for data from the feed */
     HTTPSTATE_READY,
+    HTTPSTATE_SEND_FILE,          /* sending a file as it is */
 
     RTSPSTATE_WAIT_REQUEST,
     RTSPSTATE_SEND_REPLY,
@@ -86,6 +92,7 @@ static const char *http_state[] = {
     "RECEIVE_DATA",
     "WAIT_FEED",
     "READY",
+    "SEND_FILE",
 
     "RTSP_WAIT_REQUEST",
     "RTSP_SEND_REPLY",
@@ -104,6 +111,10 @@ static const char *http_state[] = {
 
 #define SYNC_TIMEOUT (10 * 1000)
 
+/* maximum amount of file data sent in one go, so that a fast client does
+   not hold up the others */
+#define SEND_FILE_CHUNK (256 * 1024)
+
 typedef struct RTSPActionServerSetup {
     uint32_t ipaddr;
     char transport_option[512];
@@ -114,6 +125,40 @@ typedef struct {
     int64_t time1, time2;
 } DataRateData;
 
+#define FEED_RING_SIZE 1024
+#define FEED_RING_MAX_BYTES (8 * 1024 * 1024)
+
+/* last packets of a feed, read once from the feed file and shared by all
+   the connections sending the feed */
+typedef struct FeedRing {
+    AVFormatContext *in;    /* reader of the feed file */
+    AVPacket pkts[FEED_RING_SIZE];
+    int64_t start, end;     /* number of the oldest packet and of the next one */
+    int bytes;              /* total size of the packets in the ring */
+} FeedRing;
+
+#define SHARED_OUTPUT_SIZE 1024
+
+/* block of muxed data, referenced by the connections sending it */
+typedef struct OutputBuffer {
+    int refcount;
+    int size;
+    int key;                /* true if the data starts with a key frame */
+    uint8_t data[1];
+} OutputBuffer;
+
+/* a stream muxed once for all the HTTP connections sending it */
+typedef struct SharedOutput {
+    AVFormatContext fmt_ctx;
+    OutputBuffer *header;
+    OutputBuffer *bufs[SHARED_OUTPUT_SIZE];
+    int64_t start, end;     /* number of the oldest buffer and of the next one */
+    int64_t key_buf;        /* number of the last buffer with a key frame, -1 if none */
+    int64_t ring_pos;       /* number of the next packet of the feed ring to mux */
+    int got_key_frame;
+    int nb_clients;
+} SharedOutput;
+
 /* context associated with one connection */
 typedef struct HTTPContext {
     enum HTTPState state;
@@ -126,13 +171,25 @@ typedef struct HTTPContext {
     int post;
     int chunked_encoding;
     int chunk_size;               /* 0 if it needs to be read */
+    int chunked_output;           /* true if the data is sent in chunks */
+    int chunk_step;               /* next part of the chunk: 1 data, 2 end, 3 none left */
+    uint8_t *chunk_data, *chunk_data_end;
+    uint8_t chunk_header[16];
     struct HTTPContext *next;
     int got_key_frame; /* stream 0 => 1, stream 1 => 2, stream 2=> 4 */
     int64_t data_count;
     /* feed input */
     int feed_fd;
+    /* file sent as it is */
+    int file_fd;
+    int64_t file_pos, file_end; /* byte range of the file left to send */
     /* input format handling */
     AVFormatContext *fmt_in;
+    FeedRing *ring;              /* if non NULL, the packets are taken from there */
+    int64_t ring_pos;            /* number of the next packet to send from the ring */
+    SharedOutput *output;        /* if non NULL, the muxed data is taken from there */
+    int64_t output_pos;          /* number of the next buffer to send from the output */
+    OutputBuffer *out_buf;       /* buffer of the output being sent */
     int64_t start_time;            /* In milliseconds - this wraps fairly often */
     int64_t first_pts;            /* initial pts value */
     int64_t cur_pts;             /* current pts value from the stream in us */
@@ -183,6 +240,7 @@ typedef struct HTTPContext {
 enum StreamType {
     STREAM_TYPE_LIVE,
     STREAM_TYPE_STATUS,
+    STREAM_TYPE_METRICS,
     STREAM_TYPE_REDIRECT,
 };
 
@@ -235,6 +293,8 @@ typedef struct FFStream {
     int multicast_port; /* first port used for multicast */
     int multicast_ttl;
     int loop; /* if true, send the stream in loops (only meaningful if file) */
+    int passthrough; /* if true, the file is already in the output format
+                        and is sent without remuxing */
 
     /* feed specific */
     int feed_opened;     /* true if someone is writing to the feed */
@@ -242,10 +302,19 @@ typedef struct FFStream {
     int readonly;        /* True if writing is prohibited to the file */
     int truncate;        /* True if feeder connection truncate the feed file */
     int conns_served;
-    int64_t bytes_served;
+    int64_t bytes_served;       /* for a feed, bytes received */
+    int64_t packets_served;     /* for a feed, packets received */
+    int64_t packets_dropped;    /* packets skipped for slow connections */
+    int64_t last_receive_time;  /* feed: last time data was received */
+    /* connection statistics, gathered when the metrics are computed */
+    int64_t nb_clients;
+    int64_t queued_bytes;
+    int64_t queued_packets;
     int64_t feed_max_size;      /* maximum storage size, zero means unlimited */
     int64_t feed_write_index;   /* current write position in feed (it wraps around) */
     int64_t feed_size;          /* current size of feed */
+    FeedRing *ring;             /* last packets of the feed */
+    SharedOutput *output;       /* muxer shared by the connections */
     struct FFStream *next_feed;
 } FFStream;
 
@@ -269,7 +338,14 @@ static void close_connection(HTTPContext *c);
 static int handle_connection(HTTPContext *c);
 static int http_parse_request(HTTPContext *c);
 static int http_send_data(HTTPContext *c);
+static int http_start_send_file(HTTPContext *c);
+static int http_send_file(HTTPContext *c);
+static void output_buffer_unref(OutputBuffer **buf);
+static void shared_output_free(FFStream *stream);
+static int can_share_output(FFStream *stream);
+static int shared_output_join(HTTPContext *c);
 static void compute_status(HTTPContext *c);
+static void compute_metrics(HTTPContext *c);
 static int open_input_stream(HTTPContext *c, const char *info);
 static int http_start_receive_data(HTTPContext *c);
 static int http_receive_data(HTTPContext *c);
@@ -315,6 +391,12 @@ static uint64_t current_bandwidth;
 
 static int64_t cur_time;           // Making this global saves on passing it around everywhere
 
+/* time spent handling the events of one iteration of the main loop,
+   upper bounds of the histogram buckets in us */
+static const int loop_latency_bounds[] = { 1000, 5000, 10000, 50000, 100000, 500000 };
+static int64_t loop_latency_count[FF_ARRAY_ELEMS(loop_latency_bounds) + 1];
+static int64_t loop_latency_sum;
+
 static AVLFG random_state;
 
 static FILE *logfile = NULL;
@@ -587,12 +669,24 @@ static void start_multicast(void)
 }
 
 /* main loop of the http server */
+static void update_loop_latency(int64_t latency)
+{
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(loop_latency_bounds); i++)
+        if (latency <= loop_latency_bounds[i])
+            break;
+    loop_latency_count[i]++;
+    loop_latency_sum += latency;
+}
+
 static int http_server(void)
 {
     int server_fd = 0, rtsp_server_fd = 0;
     int ret, delay, delay1;
     struct pollfd *poll_table, *poll_entry;
     HTTPContext *c, *c_next;
+    int64_t loop_start = 0;
 
     if(!(poll_table = av_mallocz((nb_max_http_connections + 2)*sizeof(*poll_table)))) {
         http_log("Impossible to allocate a poll table handling %d connections.\n", nb_max_http_connections);
@@ -643,6 +737,7 @@ static int http_server(void)
             fd = c->fd;
             switch(c->state) {
             case HTTPSTATE_SEND_HEADER:
+            case HTTPSTATE_SEND_FILE:
             case RTSPSTATE_SEND_REPLY:
             case RTSPSTATE_SEND_PACKET:
                 c->poll_entry = poll_entry;
@@ -685,6 +780,9 @@ static int http_server(void)
             c = c->next;
         }
 
+        if (loop_start)
+            update_loop_latency(av_gettime() - loop_start);
+
         /* wait for an event on one connection. We poll at least every
            second to handle timeouts */
         do {
@@ -694,7 +792,8 @@ static int http_server(void)
                 return -1;
         } while (ret < 0);
 
-        cur_time = av_gettime() / 1000;
+        loop_start = av_gettime();
+        cur_time = loop_start / 1000;
 
         if (need_to_start_children) {
             need_to_start_children = 0;
@@ -783,6 +882,7 @@ static void new_connection(int server_fd, int is_rtsp)
         goto fail;
 
     c->fd = fd;
+    c->file_fd = -1;
     c->poll_entry = NULL;
     c->from_addr = from_addr;
     c->buffer_size = IOBUFFER_INIT_SIZE;
@@ -833,6 +933,8 @@ static void close_connection(HTTPContext *c)
     /* remove connection associated resources */
     if (c->fd >= 0)
         closesocket(c->fd);
+    if (c->file_fd >= 0)
+        close(c->file_fd);
     if (c->fmt_in) {
         /* close each frame parser */
         for(i=0;i<c->fmt_in->nb_streams;i++) {
@@ -880,6 +982,10 @@ static void close_connection(HTTPContext *c)
     if (c->stream && !c->post && c->stream->stream_type == STREAM_TYPE_LIVE)
         current_bandwidth -= c->stream->bandwidth;
 
+    output_buffer_unref(&c->out_buf);
+    if (c->output && !--c->output->nb_clients)
+        shared_output_free(c->stream);
+
     /* signal that there is no feed if we are the feeder socket */
     if (c->state == HTTPSTATE_RECEIVE_DATA && c->stream) {
         c->stream->feed_opened = 0;
@@ -966,7 +1072,10 @@ static int handle_connection(HTTPContext *c)
                 if (c->http_error)
                     return -1;
                 /* all the buffer was sent : synchronize to the incoming stream */
-                c->state = HTTPSTATE_SEND_DATA_HEADER;
+                if (c->file_fd >= 0)
+                    c->state = HTTPSTATE_SEND_FILE;
+                else
+                    c->state = HTTPSTATE_SEND_DATA_HEADER;
                 c->buffer_ptr = c->buffer_end = c->buffer;
             }
         }
@@ -988,8 +1097,20 @@ static int handle_connection(HTTPContext *c)
         }
         if (http_send_data(c) < 0)
             return -1;
-        /* close connection if trailer sent */
-        if (c->state == HTTPSTATE_SEND_DATA_TRAILER)
+        /* close connection if trailer sent, in chunked mode once the
+           last chunk has been sent */
+        if (c->state == HTTPSTATE_SEND_DATA_TRAILER && !c->chunked_output)
+            return -1;
+        break;
+    case HTTPSTATE_SEND_FILE:
+        if (c->poll_entry->revents & (POLLERR | POLLHUP))
+            return -1;
+
+        /* no need to write if no events */
+        if (!(c->poll_entry->revents & POLLOUT))
+            return 0;
+        /* close connection once the whole range has been sent */
+        if (http_send_file(c))
             return -1;
         break;
     case HTTPSTATE_RECEIVE_DATA:
@@ -1462,7 +1583,7 @@ static int http_parse_request(HTTPContext *c)
     char info[1024], filename[1024];
     char url[1024], *q;
     char protocol[32];
-    char msg[1024];
+    char msg[sizeof(url) + 64]; /* room for the url in the error messages */
     const char *mime_type;
     FFStream *stream;
     int i;
@@ -1808,6 +1929,21 @@ static int http_parse_request(HTTPContext *c)
 
     if (c->stream->stream_type == STREAM_TYPE_STATUS)
         goto send_status;
+    if (c->stream->stream_type == STREAM_TYPE_METRICS) {
+        compute_metrics(c);
+        c->http_error = 200;
+        c->state = HTTPSTATE_SEND_HEADER;
+        return 0;
+    }
+
+    /* send the file as it is unless a position was requested */
+    if (c->stream->passthrough && !find_info_tag(msg, sizeof(msg), "date", info)) {
+        if (http_start_send_file(c) < 0) {
+            snprintf(msg, sizeof(msg), "Input stream corresponding to '%s' not found", url);
+            goto send_error;
+        }
+        return 0;
+    }
 
     /* open input stream */
     if (open_input_stream(c, info) < 0) {
@@ -1815,9 +1951,21 @@ static int http_parse_request(HTTPContext *c)
         goto send_error;
     }
 
+    /* live connections to the same stream share a single muxer */
+    if (c->ring && !info[0] && can_share_output(c->stream))
+        shared_output_join(c);
+
     /* prepare http header */
     q = c->buffer;
-    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "HTTP/1.0 200 OK\r\n");
+    if (!strcmp(c->protocol, "HTTP/1.1") && strcmp(c->stream->fmt->name, "asf_stream")) {
+        /* chunks let the client tell the end of the stream from a lost
+           connection */
+        c->chunked_output = 1;
+        q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "HTTP/1.1 200 OK\r\n");
+        q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Transfer-Encoding: chunked\r\n");
+        q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Connection: close\r\n");
+    } else
+        q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "HTTP/1.0 200 OK\r\n");
     mime_type = c->stream->fmt->mime_type;
     if (!mime_type)
         mime_type = "application/x-octet-stream";
@@ -2116,6 +2264,215 @@ static void compute_status(HTTPContext *c)
     c->buffer_end = c->pb_buffer + len;
 }
 
+/* write s as the value of a metrics label */
+static void fmt_label(ByteIOContext *pb, const char *s)
+{
+    for (; *s; s++) {
+        if (*s == '\\' || *s == '"')
+            put_byte(pb, '\\');
+        if (*s == '\n')
+            put_buffer(pb, "\\n", 2);
+        else
+            put_byte(pb, *s);
+    }
+}
+
+static void fmt_metric_header(ByteIOContext *pb, const char *name,
+                              const char *type, const char *help)
+{
+    url_fprintf(pb, "# HELP ffserver_%s %s\n", name, help);
+    url_fprintf(pb, "# TYPE ffserver_%s %s\n", name, type);
+}
+
+#define STREAM_METRIC(field, name, type, help) \
+    { offsetof(FFStream, field), name, type, help }
+
+static const struct {
+    size_t offset;
+    const char *name, *type, *help;
+} stream_metrics[] = {
+    STREAM_METRIC(nb_clients, "stream_clients", "gauge",
+                  "Number of connections receiving the stream."),
+    STREAM_METRIC(bytes_served, "stream_bytes_total", "counter",
+                  "Bytes sent to the connections."),
+    STREAM_METRIC(packets_served, "stream_packets_total", "counter",
+                  "Packets sent to the connections."),
+    STREAM_METRIC(packets_dropped, "stream_dropped_packets_total", "counter",
+                  "Packets skipped because a connection was too slow."),
+    STREAM_METRIC(queued_bytes, "stream_queued_bytes", "gauge",
+                  "Bytes muxed but not yet sent to the connections."),
+    STREAM_METRIC(queued_packets, "stream_queued_packets", "gauge",
+                  "Packets of the feed not yet sent to the connections."),
+}, feed_metrics[] = {
+    STREAM_METRIC(bytes_served, "feed_bytes_total", "counter",
+                  "Bytes received from the feeder."),
+    STREAM_METRIC(packets_served, "feed_packets_total", "counter",
+                  "Packets received from the feeder."),
+    STREAM_METRIC(feed_size, "feed_size_bytes", "gauge",
+                  "Size of the feed file."),
+};
+
+/* write the statistics as plain text, in the Prometheus exposition
+   format, so that they can be collected at a high rate */
+static void compute_metrics(HTTPContext *c)
+{
+    HTTPContext *c1;
+    FFStream *stream;
+    ByteIOContext *pb;
+    FFSlabStats slab_stats[16];
+    int64_t count;
+    int i, len, nb_slab;
+
+    if (url_open_dyn_buf(&pb) < 0) {
+        c->buffer_ptr = c->buffer;
+        c->buffer_end = c->buffer;
+        return;
+    }
+
+    url_fprintf(pb, "HTTP/1.0 200 OK\r\n");
+    url_fprintf(pb, "Content-type: %s\r\n", "text/plain; version=0.0.4");
+    url_fprintf(pb, "Pragma: no-cache\r\n");
+    url_fprintf(pb, "\r\n");
+
+    /* gather what is queued for each stream in a single pass */
+    for (stream = first_stream; stream; stream = stream->next)
+        stream->nb_clients = stream->queued_bytes = stream->queued_packets = 0;
+    for (c1 = first_http_ctx; c1; c1 = c1->next) {
+        if (!c1->stream || c1->post || c1->stream->stream_type != STREAM_TYPE_LIVE)
+            continue;
+        stream = c1->stream;
+        stream->nb_clients++;
+        stream->queued_bytes += c1->buffer_end - c1->buffer_ptr;
+        if (c1->output)
+            stream->queued_packets += c1->output->end - c1->output_pos;
+        else if (c1->ring)
+            stream->queued_packets += c1->ring->end - c1->ring_pos;
+    }
+
+    fmt_metric_header(pb, "connections", "gauge", "Number of open connections.");
+    url_fprintf(pb, "ffserver_connections %u\n", nb_connections);
+    fmt_metric_header(pb, "connections_max", "gauge", "Maximum number of connections.");
+    url_fprintf(pb, "ffserver_connections_max %u\n", nb_max_connections);
+    fmt_metric_header(pb, "bandwidth_kbits", "gauge", "Bandwidth reserved by the live connections, in kbit/s.");
+    url_fprintf(pb, "ffserver_bandwidth_kbits %"PRIu64"\n", current_bandwidth);
+    fmt_metric_header(pb, "bandwidth_max_kbits", "gauge", "Maximum bandwidth, in kbit/s.");
+    url_fprintf(pb, "ffserver_bandwidth_max_kbits %"PRIu64"\n", max_bandwidth);
+
+    fmt_metric_header(pb, "loop_latency_seconds", "histogram",
+                      "Time spent handling the events of one iteration of the main loop.");
+    count = 0;
+    for (i = 0; i < FF_ARRAY_ELEMS(loop_latency_bounds); i++) {
+        count += loop_latency_count[i];
+        url_fprintf(pb, "ffserver_loop_latency_seconds_bucket{le=\"%g\"} %"PRId64"\n",
+                    loop_latency_bounds[i] / 1000000.0, count);
+    }
+    count += loop_latency_count[i];
+    url_fprintf(pb, "ffserver_loop_latency_seconds_bucket{le=\"+Inf\"} %"PRId64"\n", count);
+    url_fprintf(pb, "ffserver_loop_latency_seconds_sum %f\n", loop_latency_sum / 1000000.0);
+    url_fprintf(pb, "ffserver_loop_latency_seconds_count %"PRId64"\n", count);
+
+    nb_slab = ff_slab_get_stats(slab_stats, FF_ARRAY_ELEMS(slab_stats));
+    if (nb_slab) {
+        fmt_metric_header(pb, "slab_allocs_total", "counter",
+                          "Objects allocated from the slab allocator.");
+        for (i = 0; i < nb_slab; i++)
+            url_fprintf(pb, "ffserver_slab_allocs_total{size=\"%d\"} %"PRIu64"\n",
+                        slab_stats[i].size, slab_stats[i].allocs);
+        fmt_metric_header(pb, "slab_refills_total", "counter",
+                          "Batches of objects moved into a thread cache.");
+        for (i = 0; i < nb_slab; i++)
+            url_fprintf(pb, "ffserver_slab_refills_total{size=\"%d\"} %"PRIu64"\n",
+                        slab_stats[i].size, slab_stats[i].refills);
+        fmt_metric_header(pb, "slab_objects", "gauge",
+                          "Objects the slabs of the size class can hold.");
+        for (i = 0; i < nb_slab; i++)
+            url_fprintf(pb, "ffserver_slab_objects{size=\"%d\"} %d\n",
+                        slab_stats[i].size, slab_stats[i].objects);
+        fmt_metric_header(pb, "slab_objects_in_use", "gauge",
+                          "Objects allocated or held in a thread cache.");
+        for (i = 0; i < nb_slab; i++)
+            url_fprintf(pb, "ffserver_slab_objects_in_use{size=\"%d\"} %d\n",
+                        slab_stats[i].size,
+                        slab_stats[i].objects - slab_stats[i].objects_free);
+    }
+
+    fmt_metric_header(pb, "stream_connections_total", "counter",
+                      "Connections served since the server started.");
+    for (stream = first_stream; stream; stream = stream->next) {
+        if (stream->stream_type != STREAM_TYPE_LIVE || stream->feed == stream)
+            continue;
+        url_fprintf(pb, "ffserver_stream_connections_total{stream=\"");
+        fmt_label(pb, stream->filename);
+        url_fprintf(pb, "\"} %d\n", stream->conns_served);
+    }
+    for (i = 0; i < FF_ARRAY_ELEMS(stream_metrics); i++) {
+        fmt_metric_header(pb, stream_metrics[i].name, stream_metrics[i].type,
+                          stream_metrics[i].help);
+        for (stream = first_stream; stream; stream = stream->next) {
+            if (stream->stream_type != STREAM_TYPE_LIVE || stream->feed == stream)
+                continue;
+            url_fprintf(pb, "ffserver_%s{stream=\"", stream_metrics[i].name);
+            fmt_label(pb, stream->filename);
+            url_fprintf(pb, "\"} %"PRId64"\n",
+                        *(int64_t *)((uint8_t *)stream + stream_metrics[i].offset));
+        }
+    }
+
+    for (i = 0; i < FF_ARRAY_ELEMS(feed_metrics); i++) {
+        fmt_metric_header(pb, feed_metrics[i].name, feed_metrics[i].type,
+                          feed_metrics[i].help);
+        for (stream = first_feed; stream; stream = stream->next_feed) {
+            url_fprintf(pb, "ffserver_%s{feed=\"", feed_metrics[i].name);
+            fmt_label(pb, stream->filename);
+            url_fprintf(pb, "\"} %"PRId64"\n",
+                        *(int64_t *)((uint8_t *)stream + feed_metrics[i].offset));
+        }
+    }
+    fmt_metric_header(pb, "feed_connected", "gauge", "1 if a feeder is connected.");
+    for (stream = first_feed; stream; stream = stream->next_feed) {
+        url_fprintf(pb, "ffserver_feed_connected{feed=\"");
+        fmt_label(pb, stream->filename);
+        url_fprintf(pb, "\"} %d\n", stream->feed_opened);
+    }
+    fmt_metric_header(pb, "feed_lag_seconds", "gauge",
+                      "Time since data was last received from the feeder.");
+    for (stream = first_feed; stream; stream = stream->next_feed) {
+        if (!stream->last_receive_time)
+            continue;
+        url_fprintf(pb, "ffserver_feed_lag_seconds{feed=\"");
+        fmt_label(pb, stream->filename);
+        url_fprintf(pb, "\"} %.3f\n", (cur_time - stream->last_receive_time) / 1000.0);
+    }
+
+    /* per connection throughput, to find the clients using the most bandwidth */
+    fmt_metric_header(pb, "connection_bytes_total", "counter",
+                      "Bytes transferred on the connection.");
+    for (c1 = first_http_ctx; c1; c1 = c1->next) {
+        if (!c1->stream || c1 == c)
+            continue;
+        url_fprintf(pb, "ffserver_connection_bytes_total{stream=\"");
+        fmt_label(pb, c1->stream->filename);
+        url_fprintf(pb, "\",client=\"%s:%d\"} %"PRId64"\n",
+                    inet_ntoa(c1->from_addr.sin_addr), ntohs(c1->from_addr.sin_port),
+                    c1->data_count);
+    }
+    fmt_metric_header(pb, "connection_bytes_per_second", "gauge",
+                      "Recent throughput of the connection.");
+    for (c1 = first_http_ctx; c1; c1 = c1->next) {
+        if (!c1->stream || c1 == c)
+            continue;
+        url_fprintf(pb, "ffserver_connection_bytes_per_second{stream=\"");
+        fmt_label(pb, c1->stream->filename);
+        url_fprintf(pb, "\",client=\"%s:%d\"} %d\n",
+                    inet_ntoa(c1->from_addr.sin_addr), ntohs(c1->from_addr.sin_port),
+                    compute_datarate(&c1->datarate, c1->data_count));
+    }
+
+    len = url_close_dyn_buf(pb, &c->pb_buffer);
+    c->buffer_ptr = c->pb_buffer;
+    c->buffer_end = c->pb_buffer + len;
+}
+
 /* check if the parser needs to be opened for stream i */
 static void open_parser(AVFormatContext *s, int i)
 {
@@ -2132,6 +2489,125 @@ static void open_parser(AVFormatContext *s, int i)
     }
 }
 
+/* free the oldest packet of the ring */
+static void feed_ring_pop(FeedRing *ring)
+{
+    AVPacket *pkt = &ring->pkts[ring->start++ % FEED_RING_SIZE];
+
+    ring->bytes -= pkt->size;
+    av_free_packet(pkt);
+}
+
+static void feed_ring_reset(FeedRing *ring)
+{
+    while (ring->start < ring->end)
+        feed_ring_pop(ring);
+    if (ring->in) {
+        av_close_input_file(ring->in);
+        ring->in = NULL;
+    }
+}
+
+/* add the packets written to the feed file since the last call to the
+   ring of the feed */
+static void feed_ring_update(FFStream *feed)
+{
+    FeedRing *ring = feed->ring;
+    AVPacket pkt;
+
+    if (!ring) {
+        ring = feed->ring = av_mallocz(sizeof(FeedRing));
+        if (!ring)
+            return;
+    }
+    if (!ring->in) {
+        FFStream *stream;
+        int prebuffer = 0;
+
+        if (av_open_input_file(&ring->in, feed->feed_filename,
+                               av_find_input_format("ffm"), FFM_PACKET_SIZE, NULL) < 0) {
+            ring->in = NULL;
+            return;
+        }
+        ring->in->flags |= AVFMT_FLAG_GENPTS;
+
+        /* start early enough for the streams which use this feed */
+        for (stream = first_stream; stream; stream = stream->next)
+            if (stream->feed == feed)
+                prebuffer = FFMAX(prebuffer, stream->prebuffer);
+        ffm_set_write_index(ring->in, feed->feed_write_index, feed->feed_size);
+        av_seek_frame(ring->in, -1, av_gettime() - prebuffer * (int64_t)1000, 0);
+    }
+
+    ffm_set_write_index(ring->in, feed->feed_write_index, feed->feed_size);
+    while (av_read_frame(ring->in, &pkt) >= 0) {
+        if (av_dup_packet(&pkt) < 0) {
+            av_free_packet(&pkt);
+            break;
+        }
+        /* a few large packets must not keep the whole ring in memory */
+        while (ring->end - ring->start == FEED_RING_SIZE ||
+               (ring->end > ring->start &&
+                ring->bytes + pkt.size > FEED_RING_MAX_BYTES))
+            feed_ring_pop(ring);
+        ring->pkts[ring->end++ % FEED_RING_SIZE] = pkt;
+        ring->bytes += pkt.size;
+        feed->packets_served++;
+    }
+}
+
+/* send the packets of the feed from stream_pos (absolute time in us) on
+   from the ring of the feed, if it goes back that far */
+static int feed_ring_seek(HTTPContext *c, int64_t stream_pos)
+{
+    FeedRing *ring = c->stream->feed->ring;
+    int64_t i;
+    int oldest = 1;
+
+    if (!ring || !ring->in)
+        return -1;
+    for (i = ring->start; i < ring->end; i++) {
+        AVPacket *pkt = &ring->pkts[i % FEED_RING_SIZE];
+        int64_t dts;
+
+        if (pkt->dts == AV_NOPTS_VALUE)
+            continue;
+        dts = av_rescale_q(pkt->dts, ring->in->streams[pkt->stream_index]->time_base,
+                           AV_TIME_BASE_Q);
+        if (dts >= stream_pos) {
+            /* older packets may still be in the feed file */
+            if (oldest)
+                return -1;
+            break;
+        }
+        oldest = 0;
+    }
+    if (oldest)
+        return -1;
+    c->ring = ring;
+    c->ring_pos = i;
+    return 0;
+}
+
+/* get the next packet of the ring, its data stays owned by the ring */
+static int feed_ring_read(HTTPContext *c, AVPacket *pkt)
+{
+    FeedRing *ring = c->ring;
+
+    if (c->ring_pos < ring->start) {
+        http_log("%s: %"PRId64" packets of feed '%s' dropped, the connection is too slow\n",
+                 inet_ntoa(c->from_addr.sin_addr), ring->start - c->ring_pos,
+                 c->stream->feed->filename);
+        c->stream->packets_dropped += ring->start - c->ring_pos;
+        c->ring_pos = ring->start;
+    }
+    if (c->ring_pos >= ring->end)
+        return AVERROR(EAGAIN);
+    *pkt = ring->pkts[c->ring_pos++ % FEED_RING_SIZE];
+    pkt->destruct = NULL;
+    return 0;
+}
+
 static int open_input_stream(HTTPContext *c, const char *info)
 {
     char buf[128];
@@ -2154,6 +2630,8 @@ static int open_input_stream(HTTPContext *c, const char *info)
             stream_pos = av_gettime() - prebuffer * (int64_t)1000000;
         } else
             stream_pos = av_gettime() - c->stream->prebuffer * (int64_t)1000;
+        if (!feed_ring_seek(c, stream_pos))
+            goto found;
     } else {
         strcpy(input_filename, c->stream->feed_filename);
         buf_size = 0;
@@ -2186,6 +2664,11 @@ static int open_input_stream(HTTPContext *c, const char *info)
     for(i=0;i<s->nb_streams;i++)
         open_parser(s, i);
 
+    /* files are already at their start unless a date was given */
+    if (c->stream->feed || stream_pos)
+        av_seek_frame(c->fmt_in, -1, stream_pos, 0);
+
+ found:
     /* choose stream as clock source (we favorize video stream if
        present) for packet sending */
     c->pts_stream_index = 0;
@@ -2196,10 +2679,6 @@ static int open_input_stream(HTTPContext *c, const char *info)
         }
     }
 
-#if 1
-    if (c->fmt_in->iformat->read_seek)
-        av_seek_frame(c->fmt_in, -1, stream_pos, 0);
-#endif
     /* set the start time (needed for maxtime and RTP packet timing) */
     c->start_time = cur_time;
     c->first_pts = AV_NOPTS_VALUE;
@@ -2230,76 +2709,281 @@ static int64_t get_packet_send_clock(HTTPContext *c)
 }
 
 
-static int http_prepare_data(HTTPContext *c)
+/* set up ctx to mux stream, and write the header in *header */
+static int write_output_header(FFStream *stream, AVFormatContext *ctx,
+                               uint8_t **header)
 {
-    int i, len, ret;
-    AVFormatContext *ctx;
+    int i;
 
-    av_freep(&c->pb_buffer);
-    switch(c->state) {
-    case HTTPSTATE_SEND_DATA_HEADER:
-        memset(&c->fmt_ctx, 0, sizeof(c->fmt_ctx));
-        av_metadata_set2(&c->fmt_ctx.metadata, "author"   , c->stream->author   , 0);
-        av_metadata_set2(&c->fmt_ctx.metadata, "comment"  , c->stream->comment  , 0);
-        av_metadata_set2(&c->fmt_ctx.metadata, "copyright", c->stream->copyright, 0);
-        av_metadata_set2(&c->fmt_ctx.metadata, "title"    , c->stream->title    , 0);
-
-        for(i=0;i<c->stream->nb_streams;i++) {
-            AVStream *st;
-            AVStream *src;
-            st = av_mallocz(sizeof(AVStream));
-            c->fmt_ctx.streams[i] = st;
-            /* if file or feed, then just take streams from FFStream struct */
-            if (!c->stream->feed ||
-                c->stream->feed == c->stream)
-                src = c->stream->streams[i];
-            else
-                src = c->stream->feed->streams[c->stream->feed_streams[i]];
+    memset(ctx, 0, sizeof(*ctx));
+    av_metadata_set2(&ctx->metadata, "author"   , stream->author   , 0);
+    av_metadata_set2(&ctx->metadata, "comment"  , stream->comment  , 0);
+    av_metadata_set2(&ctx->metadata, "copyright", stream->copyright, 0);
+    av_metadata_set2(&ctx->metadata, "title"    , stream->title    , 0);
+
+    for(i=0;i<stream->nb_streams;i++) {
+        AVStream *st;
+        AVStream *src;
+        st = av_mallocz(sizeof(AVStream));
+        ctx->streams[i] = st;
+        /* if file or feed, then just take streams from FFStream struct */
+        if (!stream->feed ||
+            stream->feed == stream)
+            src = stream->streams[i];
+        else
+            src = stream->feed->streams[stream->feed_streams[i]];
 
-            *st = *src;
-            st->priv_data = 0;
-            st->codec->frame_number = 0; /* XXX: should be done in
-                                           AVStream, not in codec */
-        }
-        /* set output format parameters */
-        c->fmt_ctx.oformat = c->stream->fmt;
-        c->fmt_ctx.nb_streams = c->stream->nb_streams;
+        *st = *src;
+        st->priv_data = 0;
+        st->codec->frame_number = 0; /* XXX: should be done in
+                                       AVStream, not in codec */
+    }
+    /* set output format parameters */
+    ctx->oformat = stream->fmt;
+    ctx->nb_streams = stream->nb_streams;
+
+    /* prepare header and save header data in a stream */
+    if (url_open_dyn_buf(&ctx->pb) < 0) {
+        /* XXX: potential leak */
+        return -1;
+    }
+    ctx->pb->is_streamed = 1;
 
-        c->got_key_frame = 0;
+    /*
+     * HACK to avoid mpeg ps muxer to spit many underflow errors
+     * Default value from FFmpeg
+     * Try to set it use configuration option
+     */
+    ctx->preload   = (int)(0.5*AV_TIME_BASE);
+    ctx->max_delay = (int)(0.7*AV_TIME_BASE);
 
-        /* prepare header and save header data in a stream */
-        if (url_open_dyn_buf(&c->fmt_ctx.pb) < 0) {
-            /* XXX: potential leak */
-            return -1;
+    av_set_parameters(ctx, NULL);
+    if (av_write_header(ctx) < 0) {
+        http_log("Error writing output header\n");
+        return -1;
+    }
+    av_metadata_free(&ctx->metadata);
+
+    return url_close_dyn_buf(ctx->pb, header);
+}
+
+static OutputBuffer *output_buffer_new(const uint8_t *data, int size, int key)
+{
+    OutputBuffer *buf = av_malloc(sizeof(OutputBuffer) + size);
+
+    if (!buf)
+        return NULL;
+    buf->refcount = 1;
+    buf->size     = size;
+    buf->key      = key;
+    memcpy(buf->data, data, size);
+    return buf;
+}
+
+static void output_buffer_unref(OutputBuffer **buf)
+{
+    if (*buf && !--(*buf)->refcount)
+        av_free(*buf);
+    *buf = NULL;
+}
+
+/* return 1 if the output of stream can be shared: it must come live from
+   a feed, and be in a format which can be decoded from any point. The
+   muxer must also write each packet as soon as it gets it, so that a key
+   frame starts a new block: "mpeg" and "mpegts" buffer packets and are
+   not shared. */
+static int can_share_output(FFStream *stream)
+{
+    static const char * const formats[] = {
+        "mpjpeg", "mp2", "mp3", "adts", NULL
+    };
+    int i;
+
+    if (!stream->feed || stream->feed == stream || !stream->fmt)
+        return 0;
+    for (i = 0; formats[i]; i++)
+        if (!strcmp(stream->fmt->name, formats[i]))
+            return 1;
+    return 0;
+}
+
+static void shared_output_free(FFStream *stream)
+{
+    SharedOutput *out = stream->output;
+    uint8_t *data;
+    int i;
+
+    for (; out->start < out->end; out->start++)
+        output_buffer_unref(&out->bufs[out->start % SHARED_OUTPUT_SIZE]);
+    /* the trailer is not sent, but it frees the muxer */
+    if (out->header && url_open_dyn_buf(&out->fmt_ctx.pb) >= 0) {
+        av_write_trailer(&out->fmt_ctx);
+        url_close_dyn_buf(out->fmt_ctx.pb, &data);
+        av_free(data);
+    }
+    output_buffer_unref(&out->header);
+    for (i = 0; i < out->fmt_ctx.nb_streams; i++)
+        av_free(out->fmt_ctx.streams[i]);
+    av_freep(&stream->output);
+}
+
+/* mux the packets added to the feed ring since the last call */
+static void shared_output_update(FFStream *stream)
+{
+    SharedOutput *out = stream->output;
+    FeedRing *ring = stream->feed->ring;
+    AVFormatContext *ctx = &out->fmt_ctx;
+
+    if (out->ring_pos < ring->start)
+        out->ring_pos = ring->start;
+    while (out->ring_pos < ring->end) {
+        AVPacket pkt = ring->pkts[out->ring_pos++ % FEED_RING_SIZE];
+        AVStream *ist = ring->in->streams[pkt.stream_index], *ost;
+        OutputBuffer *buf;
+        uint8_t *data;
+        int i, len, key;
+
+        for (i = 0; i < stream->nb_streams; i++)
+            if (stream->feed_streams[i] == pkt.stream_index)
+                break;
+        if (i == stream->nb_streams)
+            continue;
+        key = pkt.flags & AV_PKT_FLAG_KEY &&
+              (ist->codec->codec_type == AVMEDIA_TYPE_VIDEO ||
+               stream->nb_streams == 1);
+        if (key)
+            out->got_key_frame = 1;
+        if (stream->send_on_key && !out->got_key_frame)
+            continue;
+
+        ost = ctx->streams[i];
+        pkt.destruct = NULL;
+        pkt.stream_index = i;
+        if (pkt.dts != AV_NOPTS_VALUE)
+            pkt.dts = av_rescale_q(pkt.dts, ist->time_base, ost->time_base);
+        if (pkt.pts != AV_NOPTS_VALUE)
+            pkt.pts = av_rescale_q(pkt.pts, ist->time_base, ost->time_base);
+        pkt.duration = av_rescale_q(pkt.duration, ist->time_base, ost->time_base);
+
+        if (url_open_dyn_buf(&ctx->pb) < 0)
+            return;
+        ctx->pb->is_streamed = 1;
+        if (av_write_frame(ctx, &pkt) < 0)
+            http_log("Error writing frame to output\n");
+        len = url_close_dyn_buf(ctx->pb, &data);
+        ost->codec->frame_number++;
+
+        if (len > 0 && (buf = output_buffer_new(data, len, key))) {
+            if (out->end - out->start == SHARED_OUTPUT_SIZE)
+                output_buffer_unref(&out->bufs[out->start++ % SHARED_OUTPUT_SIZE]);
+            if (key)
+                out->key_buf = out->end;
+            out->bufs[out->end++ % SHARED_OUTPUT_SIZE] = buf;
         }
-        c->fmt_ctx.pb->is_streamed = 1;
+        av_free(data);
+    }
+}
 
-        /*
-         * HACK to avoid mpeg ps muxer to spit many underflow errors
-         * Default value from FFmpeg
-         * Try to set it use configuration option
-         */
-        c->fmt_ctx.preload   = (int)(0.5*AV_TIME_BASE);
-        c->fmt_ctx.max_delay = (int)(0.7*AV_TIME_BASE);
+/* make c send the output of its stream muxed once for all connections.
+   The first connection starts where it would have on its own, the next
+   ones at the last key frame */
+static int shared_output_join(HTTPContext *c)
+{
+    FFStream *stream = c->stream;
+    SharedOutput *out = stream->output;
+
+    if (out) {
+        c->output_pos = out->key_buf >= out->start ? out->key_buf : out->start;
+    } else {
+        uint8_t *header;
+        int len;
 
-        av_set_parameters(&c->fmt_ctx, NULL);
-        if (av_write_header(&c->fmt_ctx) < 0) {
-            http_log("Error writing output header\n");
+        out = stream->output = av_mallocz(sizeof(SharedOutput));
+        if (!out)
+            return -1;
+        len = write_output_header(stream, &out->fmt_ctx, &header);
+        if (len < 0) {
+            shared_output_free(stream);
             return -1;
         }
-        av_metadata_free(&c->fmt_ctx.metadata);
+        out->header = output_buffer_new(header, len, 0);
+        av_free(header);
+        if (!out->header) {
+            shared_output_free(stream);
+            return -1;
+        }
+        out->key_buf  = -1;
+        out->ring_pos = c->ring_pos;
+        shared_output_update(stream);
+        c->output_pos = out->start;
+    }
+    c->output = out;
+    out->nb_clients++;
+    return 0;
+}
 
-        len = url_close_dyn_buf(c->fmt_ctx.pb, &c->pb_buffer);
-        c->buffer_ptr = c->pb_buffer;
-        c->buffer_end = c->pb_buffer + len;
+static int shared_output_read(HTTPContext *c)
+{
+    SharedOutput *out = c->output;
+
+    if (c->output_pos < out->start) {
+        http_log("%s: %"PRId64" blocks of '%s' dropped, the connection is too slow\n",
+                 inet_ntoa(c->from_addr.sin_addr), out->start - c->output_pos,
+                 c->stream->filename);
+        c->stream->packets_dropped += out->start - c->output_pos;
+        c->output_pos = out->key_buf >= out->start ? out->key_buf : out->start;
+    }
+    if (c->output_pos >= out->end) {
+        c->state = HTTPSTATE_WAIT_FEED;
+        return 1; /* state changed */
+    }
+    c->out_buf = out->bufs[c->output_pos++ % SHARED_OUTPUT_SIZE];
+    c->out_buf->refcount++;
+    c->stream->packets_served++;
+    c->buffer_ptr = c->out_buf->data;
+    c->buffer_end = c->out_buf->data + c->out_buf->size;
+    return 0;
+}
+
+static int http_prepare_data(HTTPContext *c)
+{
+    int i, len, ret;
+    AVFormatContext *ctx;
+
+    av_freep(&c->pb_buffer);
+    output_buffer_unref(&c->out_buf);
+    switch(c->state) {
+    case HTTPSTATE_SEND_DATA_HEADER:
+        if (c->output) {
+            c->out_buf = c->output->header;
+            c->out_buf->refcount++;
+            c->buffer_ptr = c->out_buf->data;
+            c->buffer_end = c->out_buf->data + c->out_buf->size;
+        } else {
+            c->got_key_frame = 0;
+
+            len = write_output_header(c->stream, &c->fmt_ctx, &c->pb_buffer);
+            if (len < 0)
+                return -1;
+            c->buffer_ptr = c->pb_buffer;
+            c->buffer_end = c->pb_buffer + len;
+        }
 
         c->state = HTTPSTATE_SEND_DATA;
         c->last_packet_sent = 0;
         break;
     case HTTPSTATE_SEND_DATA:
+        if (c->output) {
+            if (c->stream->max_time &&
+                c->stream->max_time + c->start_time - cur_time < 0)
+                c->state = HTTPSTATE_SEND_DATA_TRAILER;
+            else
+                return shared_output_read(c);
+            break;
+        }
         /* find a new packet */
         /* read a packet from the input stream */
-        if (c->stream->feed)
+        if (c->stream->feed && !c->ring)
             ffm_set_write_index(c->fmt_in,
                                 c->stream->feed->feed_write_index,
                                 c->stream->feed->feed_size);
@@ -2311,7 +2995,10 @@ static int http_prepare_data(HTTPContext *c)
         else {
             AVPacket pkt;
         redo:
-            ret = av_read_frame(c->fmt_in, &pkt);
+            if (c->ring)
+                ret = feed_ring_read(c, &pkt);
+            else
+                ret = av_read_frame(c->fmt_in, &pkt);
             if (ret < 0) {
                 if (c->stream->feed) {
                     /* if coming from feed, it means we reached the end of the
@@ -2335,10 +3022,11 @@ static int http_prepare_data(HTTPContext *c)
                     }
                 }
             } else {
+                AVFormatContext *in = c->ring ? c->ring->in : c->fmt_in;
                 int source_index = pkt.stream_index;
                 /* update first pts if needed */
                 if (c->first_pts == AV_NOPTS_VALUE) {
-                    c->first_pts = av_rescale_q(pkt.dts, c->fmt_in->streams[pkt.stream_index]->time_base, AV_TIME_BASE_Q);
+                    c->first_pts = av_rescale_q(pkt.dts, in->streams[pkt.stream_index]->time_base, AV_TIME_BASE_Q);
                     c->start_time = cur_time;
                 }
                 /* send it to the appropriate stream */
@@ -2356,7 +3044,7 @@ static int http_prepare_data(HTTPContext *c)
                     }
                     for(i=0;i<c->stream->nb_streams;i++) {
                         if (c->stream->feed_streams[i] == pkt.stream_index) {
-                            AVStream *st = c->fmt_in->streams[source_index];
+                            AVStream *st = in->streams[source_index];
                             pkt.stream_index = i;
                             if (pkt.flags & AV_PKT_FLAG_KEY &&
                                 (st->codec->codec_type == AVMEDIA_TYPE_VIDEO ||
@@ -2370,7 +3058,7 @@ static int http_prepare_data(HTTPContext *c)
                     AVCodecContext *codec;
                     AVStream *ist, *ost;
                 send_it:
-                    ist = c->fmt_in->streams[source_index];
+                    ist = in->streams[source_index];
                     /* specific handling for RTP: we use several
                        output stream (one for each RTP
                        connection). XXX: need more abstract handling */
@@ -2428,6 +3116,7 @@ static int http_prepare_data(HTTPContext *c)
                     c->buffer_end = c->pb_buffer + len;
 
                     codec->frame_number++;
+                    c->stream->packets_served++;
                     if (len == 0) {
                         av_free_packet(&pkt);
                         goto redo;
@@ -2442,6 +3131,11 @@ static int http_prepare_data(HTTPContext *c)
         /* last packet test ? */
         if (c->last_packet_sent || c->is_packetized)
             return -1;
+        if (c->output) {
+            /* the shared muxer goes on for the other connections */
+            c->last_packet_sent = 1;
+            return -1;
+        }
         ctx = &c->fmt_ctx;
         /* prepare header */
         if (url_open_dyn_buf(&ctx->pb) < 0) {
@@ -2460,6 +3154,50 @@ static int http_prepare_data(HTTPContext *c)
     return 0;
 }
 
+/* with chunked transfer encoding, send each block of data prepared by
+   http_prepare_data() as a chunk: its size, the data, then CRLF. A last
+   empty chunk ends the stream. */
+static int http_prepare_chunk(HTTPContext *c)
+{
+    int ret;
+
+    switch (c->chunk_step) {
+    case 1:
+        c->buffer_ptr = c->chunk_data;
+        c->buffer_end = c->chunk_data_end;
+        c->chunk_step = 2;
+        return 0;
+    case 2:
+        memcpy(c->chunk_header, "\r\n", 2);
+        c->buffer_ptr = c->chunk_header;
+        c->buffer_end = c->chunk_header + 2;
+        c->chunk_step = 0;
+        return 0;
+    case 3:
+        return -1;
+    }
+
+    ret = http_prepare_data(c);
+    if (ret < 0 && c->last_packet_sent) {
+        memcpy(c->chunk_header, "0\r\n\r\n", 5);
+        c->buffer_ptr = c->chunk_header;
+        c->buffer_end = c->chunk_header + 5;
+        c->chunk_step = 3;
+        return 0;
+    }
+    /* an empty chunk would end the stream */
+    if (ret || c->buffer_ptr >= c->buffer_end)
+        return ret;
+    c->chunk_data     = c->buffer_ptr;
+    c->chunk_data_end = c->buffer_end;
+    c->buffer_ptr = c->chunk_header;
+    c->buffer_end = c->chunk_header +
+                    snprintf(c->chunk_header, sizeof(c->chunk_header), "%x\r\n",
+                             (int)(c->chunk_data_end - c->chunk_data));
+    c->chunk_step = 1;
+    return 0;
+}
+
 /* should convert the format at the same time */
 /* send data starting at c->buffer_ptr to the output connection
    (either UDP or TCP connection) */
@@ -2469,7 +3207,10 @@ static int http_send_data(HTTPContext *c)
 
     for(;;) {
         if (c->buffer_ptr >= c->buffer_end) {
-            ret = http_prepare_data(c);
+            if (c->chunked_output)
+                ret = http_prepare_chunk(c);
+            else
+                ret = http_prepare_data(c);
             if (ret < 0)
                 return -1;
             else if (ret != 0)
@@ -2582,6 +3323,178 @@ static int http_send_data(HTTPContext *c)
     return 0;
 }
 
+/* parse the value of a Range header. Return 1 and set [*start, *end[ if it
+   is a single satisfiable byte range, -1 if it cannot be satisfied and 0
+   if it must be ignored (malformed or several ranges) */
+static int parse_byte_range(const char *p, int64_t size,
+                            int64_t *start, int64_t *end)
+{
+    int64_t first, last;
+    char *q;
+
+    skip_spaces(&p);
+    if (strncasecmp(p, "bytes=", 6))
+        return 0;
+    p += 6;
+    if (*p == '-') {
+        /* last bytes of the file */
+        if (!isdigit(p[1]))
+            return 0;
+        last = strtoll(p + 1, &q, 10);
+        p = q;
+        if (!last || !size)
+            return -1;
+        first = FFMAX(size - last, 0);
+        last  = size - 1;
+    } else {
+        if (!isdigit(*p))
+            return 0;
+        first = strtoll(p, &q, 10);
+        p = q;
+        if (*p++ != '-')
+            return 0;
+        last = size - 1;
+        if (isdigit(*p)) {
+            last = strtoll(p, &q, 10);
+            p = q;
+            if (last < first)
+                return 0;
+            last = FFMIN(last, size - 1);
+        }
+        if (first >= size)
+            return -1;
+    }
+    skip_spaces(&p);
+    if (*p == ',')
+        return 0;
+    *start = first;
+    *end   = last + 1;
+    return 1;
+}
+
+/* open the file of a passthrough stream and prepare the reply header */
+static int http_start_send_file(HTTPContext *c)
+{
+    FFStream *stream = c->stream;
+    struct stat st;
+    int64_t size, start, end;
+    const char *mime_type;
+    char *p, *q;
+    int range = 0;
+
+    c->file_fd = open(stream->feed_filename, O_RDONLY);
+    if (c->file_fd < 0) {
+        http_log("Could not open '%s': %s\n", stream->feed_filename, strerror(errno));
+        return -1;
+    }
+    if (fstat(c->file_fd, &st) < 0) {
+        close(c->file_fd);
+        c->file_fd = -1;
+        return -1;
+    }
+    size  = st.st_size;
+    start = 0;
+    end   = size;
+
+    for (p = c->buffer; *p && *p != '\r' && *p != '\n'; ) {
+        if (strncasecmp(p, "Range:", 6) == 0) {
+            range = parse_byte_range(p + 6, size, &start, &end);
+            break;
+        }
+        p = strchr(p, '\n');
+        if (!p)
+            break;
+
+        p++;
+    }
+
+    q = c->buffer;
+    if (range < 0) {
+        close(c->file_fd);
+        c->file_fd = -1;
+        c->http_error = 416;
+        q += snprintf(q, c->buffer_size,
+                      "HTTP/1.0 416 Requested Range Not Satisfiable\r\n"
+                      "Content-Range: bytes */%"PRId64"\r\n"
+                      "\r\n", size);
+        c->buffer_ptr = c->buffer;
+        c->buffer_end = q;
+        c->state = HTTPSTATE_SEND_HEADER;
+        return 0;
+    }
+    if (start && lseek(c->file_fd, start, SEEK_SET) < 0) {
+        close(c->file_fd);
+        c->file_fd = -1;
+        return -1;
+    }
+    c->file_pos = start;
+    c->file_end = end;
+
+    mime_type = stream->fmt->mime_type;
+    if (!mime_type)
+        mime_type = "application/x-octet-stream";
+    if (range)
+        q += snprintf(q, q - (char *) c->buffer + c->buffer_size,
+                      "HTTP/1.0 206 Partial Content\r\n"
+                      "Content-Range: bytes %"PRId64"-%"PRId64"/%"PRId64"\r\n",
+                      start, end - 1, size);
+    else
+        q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "HTTP/1.0 200 OK\r\n");
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Accept-Ranges: bytes\r\n");
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Content-Length: %"PRId64"\r\n", end - start);
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "Content-Type: %s\r\n", mime_type);
+    q += snprintf(q, q - (char *) c->buffer + c->buffer_size, "\r\n");
+
+    /* prepare output buffer */
+    c->http_error = 0;
+    c->buffer_ptr = c->buffer;
+    c->buffer_end = q;
+    c->state = HTTPSTATE_SEND_HEADER;
+    return 0;
+}
+
+/* send the next part of the file of a passthrough stream. Return 1 once
+   the whole range has been sent */
+static int http_send_file(HTTPContext *c)
+{
+    int len;
+
+    if (c->file_pos >= c->file_end)
+        return 1;
+#if HAVE_SENDFILE
+    /* the kernel copies the data from the page cache to the socket */
+    len = sendfile(c->fd, c->file_fd, NULL,
+                   FFMIN(c->file_end - c->file_pos, SEND_FILE_CHUNK));
+    if (len == 0)
+        return -1; /* the file was truncated */
+#else
+    if (c->buffer_ptr >= c->buffer_end) {
+        len = read(c->file_fd, c->buffer,
+                   FFMIN(c->file_end - c->file_pos, c->buffer_size));
+        if (len <= 0)
+            return -1;
+        c->buffer_ptr = c->buffer;
+        c->buffer_end = c->buffer + len;
+    }
+    len = send(c->fd, c->buffer_ptr, c->buffer_end - c->buffer_ptr, 0);
+    if (len > 0)
+        c->buffer_ptr += len;
+#endif
+    if (len < 0) {
+        if (ff_neterrno() != FF_NETERROR(EAGAIN) &&
+            ff_neterrno() != FF_NETERROR(EINTR))
+            /* error : close connection */
+            return -1;
+        return 0;
+    }
+
+    c->file_pos += len;
+    c->data_count += len;
+    update_datarate(&c->datarate, c->data_count);
+    c->stream->bytes_served += len;
+    return c->file_pos >= c->file_end;
+}
+
 static int http_start_receive_data(HTTPContext *c)
 {
     int fd;
@@ -2606,6 +3519,9 @@ static int http_start_receive_data(HTTPContext *c)
         ffm_write_write_index(c->feed_fd, FFM_PACKET_SIZE);
         ftruncate(c->feed_fd, FFM_PACKET_SIZE);
         http_log("Truncating feed file '%s'\n", c->stream->feed_filename);
+        /* the packets in memory are not in the file anymore */
+        if (c->stream->ring)
+            feed_ring_reset(c->stream->ring);
     } else {
         if ((c->stream->feed_write_index = ffm_read_write_index(fd)) < 0) {
             http_log("Error reading write index from feed file: %s\n", strerror(errno));
@@ -2628,6 +3544,7 @@ static int http_start_receive_data(HTTPContext *c)
 static int http_receive_data(HTTPContext *c)
 {
     HTTPContext *c1;
+    FFStream *stream;
     int len, loop_run = 0;
 
     while (c->chunked_encoding && !c->chunk_size &&
@@ -2675,6 +3592,8 @@ static int http_receive_data(HTTPContext *c)
             c->buffer_ptr += len;
             c->data_count += len;
             update_datarate(&c->datarate, c->data_count);
+            c->stream->bytes_served += len;
+            c->stream->last_receive_time = cur_time;
         }
     }
 
@@ -2715,6 +3634,12 @@ static int http_receive_data(HTTPContext *c)
                 goto fail;
             }
 
+            /* parse and mux the new packets once for all the connections */
+            feed_ring_update(feed);
+            for (stream = first_stream; stream; stream = stream->next)
+                if (stream->output && stream->feed == feed)
+                    shared_output_update(stream);
+
             /* wake up any waiting connections */
             for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
                 if (c1->state == HTTPSTATE_WAIT_FEED &&
@@ -3330,6 +4255,7 @@ static HTTPContext *rtp_new_connection(struct sockaddr_in *from_addr,
         goto fail;
 
     c->fd = -1;
+    c->file_fd = -1;
     c->poll_entry = NULL;
     c->from_addr = *from_addr;
     c->buffer_size = IOBUFFER_INIT_SIZE;
@@ -3606,6 +4532,22 @@ static void extract_mpeg4_header(AVFormatContext *infile)
     }
 }
 
+/* return 1 if the files read by ifmt are in the format written by ofmt */
+static int match_container(AVInputFormat *ifmt, AVOutputFormat *ofmt)
+{
+    const char *p = ifmt->name;
+    int len = strlen(ofmt->name);
+
+    while (p) {
+        if (!strncmp(p, ofmt->name, len) && (!p[len] || p[len] == ','))
+            return 1;
+        p = strchr(p, ',');
+        if (p)
+            p++;
+    }
+    return 0;
+}
+
 /* compute the needed AVStream for each file */
 static void build_file_streams(void)
 {
@@ -3650,6 +4592,16 @@ static void build_file_streams(void)
                 for(i=0;i<infile->nb_streams;i++)
                     add_av_stream1(stream, infile->streams[i]->codec, 1);
 
+                /* if the file is already in the output format and nothing
+                   has to be changed, it is sent as it is */
+                if (stream->fmt && match_container(infile->iformat, stream->fmt) &&
+                    !stream->loop && !stream->max_time && !stream->is_multicast &&
+                    !stream->author[0] && !stream->title[0] &&
+                    !stream->copyright[0] && !stream->comment[0]) {
+                    http_log("Sending '%s' without remuxing\n", stream->feed_filename);
+                    stream->passthrough = 1;
+                }
+
                 av_close_input_file(infile);
             }
         }
@@ -4293,6 +5245,9 @@ static int parse_ffconfig(const char *filename)
                 if (!strcmp(arg, "status")) {
                     stream->stream_type = STREAM_TYPE_STATUS;
                     stream->fmt = NULL;
+                } else if (!strcmp(arg, "metrics")) {
+                    stream->stream_type = STREAM_TYPE_METRICS;
+                    stream->fmt = NULL;
                 } else {
                     stream->stream_type = STREAM_TYPE_LIVE;
                     /* jpeg cannot be used here, so use single frame jpeg */
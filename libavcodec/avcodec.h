@@ -32,7 +32,7 @@
 #include "libavutil/cpu.h"
 
 #define LIBAVCODEC_VERSION_MAJOR 52
-#define LIBAVCODEC_VERSION_MINOR 108
+#define LIBAVCODEC_VERSION_MINOR 109
 #define LIBAVCODEC_VERSION_MICRO  0
 
 #define LIBAVCODEC_VERSION_INT  AV_VERSION_INT(LIBAVCODEC_VERSION_MAJOR, \
@@ -4043,6 +4043,15 @@ typedef struct AVBitStreamFilter {
                   const uint8_t *buf, int buf_size, int keyframe);
     void (*close)(AVBitStreamFilterContext *bsfc);
     struct AVBitStreamFilter *next;
+    /**
+     * Filter a packet whose data may be modified, optional.
+     * The data should be rewritten in place if the result fits, otherwise
+     * it is replaced by a newly allocated buffer.
+     * @see av_bitstream_filter_filter_packet()
+     */
+    int (*filter_packet)(AVBitStreamFilterContext *bsfc,
+                         AVCodecContext *avctx, const char *args,
+                         AVPacket *pkt);
 } AVBitStreamFilter;
 
 void av_register_bitstream_filter(AVBitStreamFilter *bsf);
@@ -4051,6 +4060,25 @@ int av_bitstream_filter_filter(AVBitStreamFilterContext *bsfc,
                                AVCodecContext *avctx, const char *args,
                                uint8_t **poutbuf, int *poutbuf_size,
                                const uint8_t *buf, int buf_size, int keyframe);
+
+/**
+ * Filter a packet.
+ *
+ * If the packet owns its data, that is its destruct is av_destruct_packet,
+ * filters which support it rewrite the data in place instead of copying
+ * it to a new buffer. Otherwise the packet is given a new buffer if the
+ * filter changes the data, so when a packet is passed through a chain of
+ * filters only the first of them needs to allocate memory.
+ *
+ * @param pkt the packet, on success it contains the filtered data and
+ *            owns it if it owned the input data or a new buffer was
+ *            allocated
+ * @return 0 on success, a negative error code on failure, in which case
+ *         pkt is left unchanged
+ */
+int av_bitstream_filter_filter_packet(AVBitStreamFilterContext *bsfc,
+                                      AVCodecContext *avctx, const char *args,
+                                      AVPacket *pkt);
 void av_bitstream_filter_close(AVBitStreamFilterContext *bsf);
 
 AVBitStreamFilter *av_bitstream_filter_next(AVBitStreamFilter *f);
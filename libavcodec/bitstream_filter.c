@@ -63,3 +63,156 @@ int av_bitstream_filter_filter(AVBitStreamFilterContext *bsfc,
     *poutbuf_size= buf_size;
     return bsfc->filter->filter(bsfc, avctx, args, poutbuf, poutbuf_size, buf, buf_size, keyframe);
 }
+
+int av_bitstream_filter_filter_packet(AVBitStreamFilterContext *bsfc,
+                                      AVCodecContext *avctx, const char *args,
+                                      AVPacket *pkt)
+{
+    uint8_t *out;
+    int out_size, ret;
+
+    if (pkt->destruct == av_destruct_packet && bsfc->filter->filter_packet)
+        return bsfc->filter->filter_packet(bsfc, avctx, args, pkt);
+
+    ret = av_bitstream_filter_filter(bsfc, avctx, args, &out, &out_size,
+                                     pkt->data, pkt->size,
+                                     pkt->flags & AV_PKT_FLAG_KEY);
+    if (ret < 0)
+        return ret;
+
+    if (ret > 0) {
+        av_free_packet(pkt);
+        pkt->data     = out;
+        pkt->size     = out_size;
+        pkt->destruct = av_destruct_packet;
+    } else if (pkt->destruct == av_destruct_packet &&
+               out >= pkt->data && out + out_size <= pkt->data + pkt->size) {
+        /* the filter returned a part of the input, e.g. without a header,
+         * keep it at the start of the buffer so it can still be freed */
+        if (out != pkt->data)
+            memmove(pkt->data, out, out_size);
+        memset(pkt->data + out_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+        pkt->size = out_size;
+    } else if (pkt->destruct == av_destruct_packet && out != pkt->data) {
+        uint8_t *data = av_malloc(out_size + FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!data)
+            return AVERROR(ENOMEM);
+        memcpy(data, out, out_size);
+        memset(data + out_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+        av_free_packet(pkt);
+        pkt->data     = data;
+        pkt->size     = out_size;
+        pkt->destruct = av_destruct_packet;
+    } else {
+        pkt->data = out;
+        pkt->size = out_size;
+    }
+    return 0;
+}
+
+#ifdef TEST
+#undef printf
+
+static const uint8_t avcc[] = {
+    0x01, 0x64, 0x00, 0x1e, 0xff,               /* 4 byte NAL unit lengths */
+    0xe1, 0x00, 0x06, 0x67, 0x64, 0x00, 0x1e, 0xac, 0xd9, /* SPS */
+    0x01, 0x00, 0x04, 0x68, 0xeb, 0xe3, 0xcb,   /* PPS */
+};
+static const uint8_t mp4_idr[] = {
+    0x00, 0x00, 0x00, 0x06, 0x65, 0x88, 0x84, 0x00, 0x33, 0xff,
+};
+static const uint8_t mp4_non_idr[] = {
+    0x00, 0x00, 0x00, 0x04, 0x41, 0x9a, 0x02, 0x03,
+    0x00, 0x00, 0x00, 0x02, 0x41, 0x9b,
+};
+static const uint8_t annexb_idr[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1e, 0xac, 0xd9,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb,
+    0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x33, 0xff,
+};
+
+static AVCodecContext *open_h264_context(void)
+{
+    AVCodecContext *avctx = avcodec_alloc_context();
+
+    avctx->codec_id       = CODEC_ID_H264;
+    avctx->extradata      = av_mallocz(sizeof(avcc) + FF_INPUT_BUFFER_PADDING_SIZE);
+    avctx->extradata_size = sizeof(avcc);
+    memcpy(avctx->extradata, avcc, sizeof(avcc));
+    return avctx;
+}
+
+/**
+ * Filter a packet holding a copy of buf through all filters of the chain
+ * and print the result.
+ */
+static void test_filters(const char *name, AVCodecContext *avctx,
+                         AVBitStreamFilterContext **bsfc, int nb_bsfc,
+                         const uint8_t *buf, int buf_size, int keyframe)
+{
+    AVPacket pkt;
+    uint8_t *data;
+    int i, ret = 0;
+
+    av_new_packet(&pkt, buf_size);
+    memcpy(pkt.data, buf, buf_size);
+    if (keyframe)
+        pkt.flags |= AV_PKT_FLAG_KEY;
+    data = pkt.data;
+    for (i = 0; i < nb_bsfc && ret >= 0; i++)
+        ret = av_bitstream_filter_filter_packet(bsfc[i], avctx, NULL, &pkt);
+
+    printf("%s: ret %d, %s,", name, ret, pkt.data == data ? "in place" : "new buffer");
+    for (i = 0; i < pkt.size; i++)
+        printf(" %02x", pkt.data[i]);
+    for (i = 0; i < FF_INPUT_BUFFER_PADDING_SIZE; i++)
+        if (pkt.data[pkt.size + i])
+            break;
+    printf("%s\n", i < FF_INPUT_BUFFER_PADDING_SIZE ? ", padding not zeroed" : "");
+    av_free_packet(&pkt);
+}
+
+int main(void)
+{
+    AVCodecContext *avctx;
+    AVBitStreamFilterContext *bsfc[2];
+
+    avcodec_register_all();
+
+    /* 4 byte lengths replaced with start codes over the input */
+    avctx   = open_h264_context();
+    bsfc[0] = av_bitstream_filter_init("h264_mp4toannexb");
+    test_filters("mp4toannexb non-IDR", avctx, bsfc, 1,
+                 mp4_non_idr, sizeof(mp4_non_idr), 0);
+    /* SPS and PPS inserted, which needs a new buffer */
+    test_filters("mp4toannexb IDR", avctx, bsfc, 1,
+                 mp4_idr, sizeof(mp4_idr), 1);
+    av_bitstream_filter_close(bsfc[0]);
+    av_free(avctx->extradata);
+    av_free(avctx);
+
+    /* the end of the packet moved to the start of its own buffer */
+    avctx   = open_h264_context();
+    bsfc[0] = av_bitstream_filter_init("remove_extra");
+    test_filters("remove_extra", avctx, bsfc, 1,
+                 annexb_idr, sizeof(annexb_idr), 1);
+    av_bitstream_filter_close(bsfc[0]);
+    av_free(avctx->extradata);
+    av_free(avctx);
+
+    /* the SPS and PPS inserted by the first filter removed by the second */
+    avctx   = open_h264_context();
+    bsfc[0] = av_bitstream_filter_init("h264_mp4toannexb");
+    bsfc[1] = av_bitstream_filter_init("remove_extra");
+    test_filters("mp4toannexb,remove_extra IDR", avctx, bsfc, 2,
+                 mp4_idr, sizeof(mp4_idr), 1);
+    test_filters("mp4toannexb,remove_extra non-IDR", avctx, bsfc, 2,
+                 mp4_non_idr, sizeof(mp4_non_idr), 0);
+    av_bitstream_filter_close(bsfc[0]);
+    av_bitstream_filter_close(bsfc[1]);
+    av_free(avctx->extradata);
+    av_free(avctx);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,838 @@
+/*
+ * DSP functions test and benchmark
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * DSP functions test and benchmark.
+ * The DSP contexts are initialized once with all optimizations disabled
+ * and once for every CPU flag the CPU supports, each time adding the flag
+ * to the ones before. Every function pointer which differs from the C
+ * version is checked against it with random input, strides and source
+ * alignments, and optionally benchmarked.
+ *
+ * Only the libavcodec contexts are covered. The swscale functions are
+ * chosen by static init functions when sws_getContext() is called,
+ * depending on the SWS_CPU_CAPS flags, and stored in the internal
+ * SwsContext. The libavfilter ones are kept in the private context of
+ * each filter. Neither library is linked into libavcodec test programs.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+#include "libavutil/timer.h"
+#include "dsputil.h"
+#if CONFIG_H264DSP
+#include "h264dsp.h"
+#endif
+#if CONFIG_VP8_DECODER
+#include "vp8dsp.h"
+#endif
+#if CONFIG_VP5_DECODER || CONFIG_VP6_DECODER
+#include "vp56dsp.h"
+#endif
+
+#undef exit
+#undef printf
+#undef fprintf
+
+#define MAX_STRIDE 128
+#define BUF_SIZE   (MAX_STRIDE * 72)
+#define BLOCK_SIZE 256
+#define FLOAT_LEN  256
+#define MAX_FUNCS  1024
+
+#ifdef AV_READ_TIME
+#define BENCH_UNIT  "cycles"
+#define BENCH_RUNS  256
+#define BENCH_CALLS 16
+#else
+#define BENCH_UNIT  "ns"
+#define BENCH_RUNS  16
+#define BENCH_CALLS 1024
+#endif
+
+typedef struct DSPContexts {
+    DSPContext dsp;
+#if CONFIG_H264DSP
+    H264DSPContext h264;
+#endif
+#if CONFIG_VP8_DECODER
+    VP8DSPContext vp8;
+#endif
+#if CONFIG_VP5_DECODER || CONFIG_VP6_DECODER
+    VP56DSPContext vp56;
+#endif
+} DSPContexts;
+
+typedef void (*dsp_func)(void);
+
+enum FuncType {
+    PIXELS,
+    QPEL,
+    CHROMA,
+    CMP,
+    GET_PIXELS,
+    DIFF_PIXELS,
+    PIXELS_CLAMPED,
+    PIX_SUM,
+    ADD_BYTES,
+    DIFF_BYTES,
+    BSWAP_BUF,
+    VECTOR_FMUL,
+    VECTOR_FMUL_REVERSE,
+    VECTOR_FMUL_ADD,
+    VECTOR_CLIPF,
+    INT32_TO_FLOAT,
+    SCALARPRODUCT_FLOAT,
+    BUTTERFLIES_FLOAT,
+    SCALARPRODUCT_INT16,
+    H264_IDCT,
+    H264_WEIGHT,
+    H264_BIWEIGHT,
+    H264_LOOP_FILTER,
+    H264_LOOP_FILTER_INTRA,
+    VP8_IDCT,
+    VP8_WHT,
+    VP8_LOOP_FILTER,
+    VP8_LOOP_FILTER_UV,
+    VP8_LOOP_FILTER_SIMPLE,
+    VP8_MC,
+    VP56_EDGE_FILTER,
+};
+
+typedef struct FuncInfo {
+    char name[48];
+    int offset;                 ///< offset of the pointer in DSPContexts
+    enum FuncType type;
+    int w, h;                   ///< block size
+    int arg;                    ///< type specific
+} FuncInfo;
+
+/** arguments of one call, the pointers are offsets into the Buffers */
+typedef struct CallArgs {
+    int dst_off, src_off;
+    int stride, h, x, y, len;
+    int p[4];
+    int8_t tc0[4];
+    float f[2];
+} CallArgs;
+
+typedef struct Buffers {
+    DECLARE_ALIGNED(16, uint8_t, dst)[BUF_SIZE];
+    DECLARE_ALIGNED(16, uint8_t, dst2)[BUF_SIZE];
+    DECLARE_ALIGNED(16, uint8_t, src)[BUF_SIZE];
+    DECLARE_ALIGNED(16, uint8_t, src2)[BUF_SIZE];
+    DECLARE_ALIGNED(16, DCTELEM, block)[BLOCK_SIZE];
+    DECLARE_ALIGNED(16, DCTELEM, block2)[BLOCK_SIZE];
+    DECLARE_ALIGNED(16, float, fdst)[FLOAT_LEN];
+    DECLARE_ALIGNED(16, float, fsrc)[3][FLOAT_LEN];
+    DECLARE_ALIGNED(16, int32_t, isrc)[FLOAT_LEN];
+} Buffers;
+
+static const struct {
+    const char *name;
+    int flag;
+} cpu_flag_tab[] = {
+#if   ARCH_ARM
+    { "IWMMXT",   AV_CPU_FLAG_IWMMXT   },
+#elif ARCH_PPC
+    { "ALTIVEC",  AV_CPU_FLAG_ALTIVEC  },
+#elif ARCH_X86
+    { "MMX",      AV_CPU_FLAG_MMX      },
+    { "MMX2",     AV_CPU_FLAG_MMX2     },
+    { "3DNOW",    AV_CPU_FLAG_3DNOW    },
+    { "3DNOWEXT", AV_CPU_FLAG_3DNOWEXT },
+    { "SSE",      AV_CPU_FLAG_SSE      },
+    { "SSE2",     AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_SSE2SLOW },
+    { "SSE3",     AV_CPU_FLAG_SSE3 | AV_CPU_FLAG_SSE3SLOW },
+    { "SSSE3",    AV_CPU_FLAG_SSSE3    },
+    { "SSE4.1",   AV_CPU_FLAG_SSE4     },
+    { "SSE4.2",   AV_CPU_FLAG_SSE42    },
+#endif
+    { NULL }
+};
+
+static DSPContexts ctx_tmpl, ctx_c, ctx_prev, ctx_cur;
+static FuncInfo funcs[MAX_FUNCS];
+static int nb_funcs;
+static Buffers buf_ref, buf_new;
+static AVLFG prng;
+
+static void add_func(const void *member, enum FuncType type, int w, int h,
+                     int arg, const char *fmt, ...)
+{
+    FuncInfo *f = &funcs[nb_funcs++];
+    va_list vl;
+
+    va_start(vl, fmt);
+    vsnprintf(f->name, sizeof(f->name), fmt, vl);
+    va_end(vl);
+    f->offset = (const uint8_t *)member - (const uint8_t *)&ctx_tmpl;
+    f->type   = type;
+    f->w      = w;
+    f->h      = h;
+    f->arg    = arg;
+}
+
+#define FUNC(member, type, w, h, arg, ...) \
+    add_func(&ctx_tmpl.member, type, w, h, arg, __VA_ARGS__)
+
+static void register_funcs(void)
+{
+    static const char * const pix_names[] = { "put", "avg", "put_no_rnd", "avg_no_rnd" };
+    static const char * const qpel_names[] = { "put", "avg", "put_no_rnd" };
+    int i, j;
+
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 4; j++) {
+            int w = 16 >> i;
+            FUNC(dsp.put_pixels_tab[i][j],        PIXELS, w, w, j, "%s_pixels_tab[%d][%d]", pix_names[0], i, j);
+            FUNC(dsp.avg_pixels_tab[i][j],        PIXELS, w, w, j, "%s_pixels_tab[%d][%d]", pix_names[1], i, j);
+            FUNC(dsp.put_no_rnd_pixels_tab[i][j], PIXELS, w, w, j, "%s_pixels_tab[%d][%d]", pix_names[2], i, j);
+            FUNC(dsp.avg_no_rnd_pixels_tab[i][j], PIXELS, w, w, j, "%s_pixels_tab[%d][%d]", pix_names[3], i, j);
+        }
+    for (i = 0; i < 2; i++)
+        for (j = 0; j < 16; j++) {
+            int w = 16 >> i;
+            FUNC(dsp.put_qpel_pixels_tab[i][j],        QPEL, w, w, j, "%s_qpel_pixels_tab[%d][%d]", qpel_names[0], i, j);
+            FUNC(dsp.avg_qpel_pixels_tab[i][j],        QPEL, w, w, j, "%s_qpel_pixels_tab[%d][%d]", qpel_names[1], i, j);
+            FUNC(dsp.put_no_rnd_qpel_pixels_tab[i][j], QPEL, w, w, j, "%s_qpel_pixels_tab[%d][%d]", qpel_names[2], i, j);
+        }
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 16; j++) {
+            int w = 16 >> i;
+            FUNC(dsp.put_h264_qpel_pixels_tab[i][j], QPEL, w, w, j, "put_h264_qpel_pixels_tab[%d][%d]", i, j);
+            FUNC(dsp.avg_h264_qpel_pixels_tab[i][j], QPEL, w, w, j, "avg_h264_qpel_pixels_tab[%d][%d]", i, j);
+        }
+    for (i = 0; i < 3; i++) {
+        FUNC(dsp.put_h264_chroma_pixels_tab[i], CHROMA, 8 >> i, 8 >> i, 0, "put_h264_chroma_pixels_tab[%d]", i);
+        FUNC(dsp.avg_h264_chroma_pixels_tab[i], CHROMA, 8 >> i, 8 >> i, 0, "avg_h264_chroma_pixels_tab[%d]", i);
+    }
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 4; j++)
+            FUNC(dsp.pix_abs[i][j], CMP, 16 >> i, 16 >> i, 0, "pix_abs[%d][%d]", i, j);
+        FUNC(dsp.sad[i], CMP, 16 >> i, 16 >> i, 0, "sad[%d]", i);
+    }
+    for (i = 0; i < 3; i++)
+        FUNC(dsp.sse[i], CMP, 16 >> i, 16 >> i, 0, "sse[%d]", i);
+    FUNC(dsp.get_pixels,                GET_PIXELS,     8,  8,  0, "get_pixels");
+    FUNC(dsp.diff_pixels,               DIFF_PIXELS,    8,  8,  0, "diff_pixels");
+    FUNC(dsp.put_pixels_clamped,        PIXELS_CLAMPED, 8,  8,  0, "put_pixels_clamped");
+    FUNC(dsp.put_signed_pixels_clamped, PIXELS_CLAMPED, 8,  8,  0, "put_signed_pixels_clamped");
+    FUNC(dsp.add_pixels_clamped,        PIXELS_CLAMPED, 8,  8,  0, "add_pixels_clamped");
+    FUNC(dsp.pix_sum,                   PIX_SUM,        16, 16, 0, "pix_sum");
+    FUNC(dsp.pix_norm1,                 PIX_SUM,        16, 16, 0, "pix_norm1");
+    FUNC(dsp.add_bytes,                 ADD_BYTES,      0,  0,  0, "add_bytes");
+    FUNC(dsp.diff_bytes,                DIFF_BYTES,     0,  0,  0, "diff_bytes");
+    FUNC(dsp.bswap_buf,                 BSWAP_BUF,      0,  0,  0, "bswap_buf");
+
+    /* float_to_int16 is missing, the C version expects biased input */
+    FUNC(dsp.vector_fmul,                VECTOR_FMUL,         0, 0, 0, "vector_fmul");
+    FUNC(dsp.vector_fmul_reverse,        VECTOR_FMUL_REVERSE, 0, 0, 0, "vector_fmul_reverse");
+    FUNC(dsp.vector_fmul_add,            VECTOR_FMUL_ADD,     0, 0, 0, "vector_fmul_add");
+    FUNC(dsp.vector_clipf,               VECTOR_CLIPF,        0, 0, 0, "vector_clipf");
+    FUNC(dsp.int32_to_float_fmul_scalar, INT32_TO_FLOAT,      0, 0, 0, "int32_to_float_fmul_scalar");
+    FUNC(dsp.scalarproduct_float,        SCALARPRODUCT_FLOAT, 0, 0, 0, "scalarproduct_float");
+    FUNC(dsp.butterflies_float,          BUTTERFLIES_FLOAT,   0, 0, 0, "butterflies_float");
+    FUNC(dsp.scalarproduct_int16,        SCALARPRODUCT_INT16, 0, 0, 0, "scalarproduct_int16");
+
+#if CONFIG_H264DSP
+    /* arg: coefficient range and whether only the DC is set */
+    FUNC(h264.h264_idct_add,     H264_IDCT, 4, 4, 0, "h264_idct_add");
+    FUNC(h264.h264_idct8_add,    H264_IDCT, 8, 8, 0, "h264_idct8_add");
+    FUNC(h264.h264_idct_dc_add,  H264_IDCT, 4, 4, 1, "h264_idct_dc_add");
+    FUNC(h264.h264_idct8_dc_add, H264_IDCT, 8, 8, 1, "h264_idct8_dc_add");
+    for (i = 0; i < 10; i++) {
+        static const uint8_t sizes[10][2] = {
+            { 16, 16 }, { 16, 8 }, { 8, 16 }, { 8, 8 }, { 8, 4 },
+            {  4,  8 }, {  4, 4 }, { 4,  2 }, { 2, 4 }, { 2, 2 },
+        };
+        FUNC(h264.weight_h264_pixels_tab[i],   H264_WEIGHT,   sizes[i][0], sizes[i][1], 0, "weight_h264_pixels_tab[%d]", i);
+        FUNC(h264.biweight_h264_pixels_tab[i], H264_BIWEIGHT, sizes[i][0], sizes[i][1], 0, "biweight_h264_pixels_tab[%d]", i);
+    }
+    /* arg: 0 for luma, 1 for chroma */
+    FUNC(h264.h264_v_loop_filter_luma,         H264_LOOP_FILTER,       16, 16, 0, "h264_v_loop_filter_luma");
+    FUNC(h264.h264_h_loop_filter_luma,         H264_LOOP_FILTER,       16, 16, 0, "h264_h_loop_filter_luma");
+    FUNC(h264.h264_v_loop_filter_chroma,       H264_LOOP_FILTER,        8,  8, 1, "h264_v_loop_filter_chroma");
+    FUNC(h264.h264_h_loop_filter_chroma,       H264_LOOP_FILTER,        8,  8, 1, "h264_h_loop_filter_chroma");
+    FUNC(h264.h264_v_loop_filter_luma_intra,   H264_LOOP_FILTER_INTRA, 16, 16, 0, "h264_v_loop_filter_luma_intra");
+    FUNC(h264.h264_h_loop_filter_luma_intra,   H264_LOOP_FILTER_INTRA, 16, 16, 0, "h264_h_loop_filter_luma_intra");
+    FUNC(h264.h264_v_loop_filter_chroma_intra, H264_LOOP_FILTER_INTRA,  8,  8, 1, "h264_v_loop_filter_chroma_intra");
+    FUNC(h264.h264_h_loop_filter_chroma_intra, H264_LOOP_FILTER_INTRA,  8,  8, 1, "h264_h_loop_filter_chroma_intra");
+#endif
+
+#if CONFIG_VP8_DECODER
+    /* arg: number of 4x4 blocks and whether only the DC is set */
+    FUNC(vp8.vp8_idct_add,       VP8_IDCT, 4,  4, 0, "vp8_idct_add");
+    FUNC(vp8.vp8_idct_dc_add,    VP8_IDCT, 4,  4, 1, "vp8_idct_dc_add");
+    FUNC(vp8.vp8_idct_dc_add4y,  VP8_IDCT, 16, 4, 1, "vp8_idct_dc_add4y");
+    FUNC(vp8.vp8_idct_dc_add4uv, VP8_IDCT, 8,  8, 1, "vp8_idct_dc_add4uv");
+    FUNC(vp8.vp8_luma_dc_wht,    VP8_WHT,  0,  0, 0, "vp8_luma_dc_wht");
+    FUNC(vp8.vp8_luma_dc_wht_dc, VP8_WHT,  0,  0, 1, "vp8_luma_dc_wht_dc");
+    FUNC(vp8.vp8_v_loop_filter16y,       VP8_LOOP_FILTER,        16, 16, 0, "vp8_v_loop_filter16y");
+    FUNC(vp8.vp8_h_loop_filter16y,       VP8_LOOP_FILTER,        16, 16, 0, "vp8_h_loop_filter16y");
+    FUNC(vp8.vp8_v_loop_filter16y_inner, VP8_LOOP_FILTER,        16, 16, 0, "vp8_v_loop_filter16y_inner");
+    FUNC(vp8.vp8_h_loop_filter16y_inner, VP8_LOOP_FILTER,        16, 16, 0, "vp8_h_loop_filter16y_inner");
+    FUNC(vp8.vp8_v_loop_filter8uv,       VP8_LOOP_FILTER_UV,      8,  8, 0, "vp8_v_loop_filter8uv");
+    FUNC(vp8.vp8_h_loop_filter8uv,       VP8_LOOP_FILTER_UV,      8,  8, 0, "vp8_h_loop_filter8uv");
+    FUNC(vp8.vp8_v_loop_filter8uv_inner, VP8_LOOP_FILTER_UV,      8,  8, 0, "vp8_v_loop_filter8uv_inner");
+    FUNC(vp8.vp8_h_loop_filter8uv_inner, VP8_LOOP_FILTER_UV,      8,  8, 0, "vp8_h_loop_filter8uv_inner");
+    FUNC(vp8.vp8_v_loop_filter_simple,   VP8_LOOP_FILTER_SIMPLE, 16, 16, 0, "vp8_v_loop_filter_simple");
+    FUNC(vp8.vp8_h_loop_filter_simple,   VP8_LOOP_FILTER_SIMPLE, 16, 16, 0, "vp8_h_loop_filter_simple");
+    /* arg: vertical filter index << 2 | horizontal filter index, 16 for bilinear */
+    for (i = 0; i < 27; i++) {
+        int w = 16 >> (i / 9), v = i / 3 % 3, h = i % 3;
+        FUNC(vp8.put_vp8_epel_pixels_tab[i / 9][v][h],     VP8_MC, w, w, v << 2 | h,
+             "put_vp8_epel_pixels_tab[%d][%d][%d]", i / 9, v, h);
+        FUNC(vp8.put_vp8_bilinear_pixels_tab[i / 9][v][h], VP8_MC, w, w, v << 2 | h | 16,
+             "put_vp8_bilinear_pixels_tab[%d][%d][%d]", i / 9, v, h);
+    }
+#endif
+
+#if CONFIG_VP5_DECODER || CONFIG_VP6_DECODER
+    FUNC(vp56.edge_filter_hor, VP56_EDGE_FILTER, 12, 12, 0, "edge_filter_hor");
+    FUNC(vp56.edge_filter_ver, VP56_EDGE_FILTER, 12, 12, 0, "edge_filter_ver");
+#endif
+}
+
+static void init_contexts(DSPContexts *c, AVCodecContext *avctx, int flags)
+{
+    av_force_cpu_flags(flags);
+    memset(c, 0, sizeof(*c));
+    dsputil_init(&c->dsp, avctx);
+#if CONFIG_H264DSP
+    ff_h264dsp_init(&c->h264);
+#endif
+#if CONFIG_VP8_DECODER
+    ff_vp8dsp_init(&c->vp8);
+#endif
+#if CONFIG_VP5_DECODER || CONFIG_VP6_DECODER
+    ff_vp56dsp_init(&c->vp56, CODEC_ID_VP6);
+#endif
+}
+
+static dsp_func get_func(const DSPContexts *c, const FuncInfo *f)
+{
+    dsp_func func;
+    memcpy(&func, (const uint8_t *)c + f->offset, sizeof(func));
+    return func;
+}
+
+static unsigned rnd(void)
+{
+    return av_lfg_get(&prng);
+}
+
+static int rnd_range(int min, int max)
+{
+    return min + (int)(rnd() % (unsigned)(max - min + 1));
+}
+
+/**
+ * Fill a pixel buffer: mode 0 is noise, 1 and 2 are low and medium
+ * amplitude noise around a random level, which makes the loop filters
+ * actually filter.
+ */
+static void fill_pixels(uint8_t *p, int size, int mode)
+{
+    int i, base = rnd() & 0xff;
+
+    for (i = 0; i < size; i++) {
+        switch (mode) {
+        case 0:  p[i] = rnd();                                         break;
+        case 1:  p[i] = av_clip_uint8(base + (int)(rnd() &  7) -  4); break;
+        default: p[i] = av_clip_uint8(base + (int)(rnd() & 63) - 32); break;
+        }
+    }
+}
+
+static void fill_block(DCTELEM *block, int size, int range)
+{
+    int i;
+    for (i = 0; i < size; i++)
+        block[i] = rnd_range(-range, range - 1);
+}
+
+static void fill_floats(float *f, int size, float min, float max)
+{
+    int i;
+    for (i = 0; i < size; i++)
+        f[i] = min + (max - min) * (rnd() / (float)UINT32_MAX);
+}
+
+/**
+ * Pick random arguments for one call of f and fill buf_ref.
+ * @param bench set up the buffers so that repeated calls on the same
+ *              data keep the values in a sane range
+ */
+static void init_args(const FuncInfo *f, CallArgs *a, int iter, int bench)
+{
+    int i, mode = iter % 3;
+
+    memset(a, 0, sizeof(*a));
+    a->stride  = 32 << rnd_range(0, 2);
+    a->dst_off = 32 * a->stride + 32;
+    a->src_off = a->dst_off + (rnd() & 15);
+    a->h       = f->h;
+
+    fill_pixels(buf_ref.dst,  BUF_SIZE, mode);
+    fill_pixels(buf_ref.dst2, BUF_SIZE, mode);
+    fill_pixels(buf_ref.src,  BUF_SIZE, mode);
+    fill_pixels(buf_ref.src2, BUF_SIZE, mode);
+    fill_block(buf_ref.block,  BLOCK_SIZE, 512);
+    fill_block(buf_ref.block2, BLOCK_SIZE, 512);
+    for (i = 0; i < 3; i++)
+        fill_floats(buf_ref.fsrc[i], FLOAT_LEN, bench ? 0.99 : -2.0, bench ? 1.01 : 2.0);
+    fill_floats(buf_ref.fdst, FLOAT_LEN, -2.0, 2.0);
+    for (i = 0; i < FLOAT_LEN; i++)
+        buf_ref.isrc[i] = rnd();
+    a->len = bench ? FLOAT_LEN : 16 * rnd_range(1, FLOAT_LEN / 16);
+
+    switch (f->type) {
+    case CHROMA:
+        if (f->h >= 4 && (rnd() & 1))
+            a->h = f->h / 2;
+        a->x = rnd() & 7;
+        a->y = rnd() & 7;
+        break;
+    case CMP:
+        /* the 8 pixel wide versions are only used for 8x8 blocks */
+        if (f->w == 16 && (rnd() & 1))
+            a->h = 8;
+        break;
+    case ADD_BYTES:
+    case DIFF_BYTES:
+    case BSWAP_BUF:
+        /* diff_bytes_mmx handles at least 16 bytes */
+        a->dst_off = a->src_off = 0;
+        a->len = bench ? MAX_STRIDE : rnd_range(f->type == DIFF_BYTES ? 16 : 1, MAX_STRIDE);
+        break;
+    case VECTOR_CLIPF:
+        a->f[0] = -1.0 + rnd() / (float)UINT32_MAX;
+        a->f[1] =        rnd() / (float)UINT32_MAX;
+        break;
+    case INT32_TO_FLOAT:
+        a->f[0] = 1.0 / (1 << rnd_range(0, 31));
+        break;
+    case SCALARPRODUCT_INT16:
+        fill_block(buf_ref.block,  BLOCK_SIZE, 2048);
+        fill_block(buf_ref.block2, BLOCK_SIZE, 2048);
+        break;
+    case H264_IDCT:
+        memset(buf_ref.block, 0, sizeof(buf_ref.block));
+        fill_block(buf_ref.block, f->arg ? 1 : f->w * f->w, f->w == 4 ? 256 : 64);
+        break;
+    case H264_WEIGHT:
+    case H264_BIWEIGHT:
+        a->p[0] = rnd_range(0, 7);
+        a->p[1] = rnd_range(-64, 63);
+        a->p[2] = rnd_range(-64 - FFMIN(a->p[1], 0), 63 - FFMAX(a->p[1], 0));
+        a->p[3] = rnd_range(-32, 31);
+        break;
+    case H264_LOOP_FILTER:
+    case H264_LOOP_FILTER_INTRA:
+        a->p[0] = rnd_range(0, 255);
+        a->p[1] = rnd_range(0, 18);
+        for (i = 0; i < 4; i++)
+            a->tc0[i] = rnd_range(-1, f->arg ? 12 : 25);
+        break;
+    case VP8_IDCT:
+        memset(buf_ref.block, 0, sizeof(buf_ref.block));
+        for (i = 0; i < 4; i++)
+            fill_block(buf_ref.block + 16 * i, f->arg ? 1 : 16, 256);
+        break;
+    case VP8_WHT:
+        memset(buf_ref.block, 0, sizeof(buf_ref.block));
+        fill_block(buf_ref.block2, f->arg ? 1 : 16, 2048);
+        break;
+    case VP8_LOOP_FILTER:
+    case VP8_LOOP_FILTER_UV:
+    case VP8_LOOP_FILTER_SIMPLE:
+        a->p[0] = rnd_range(0, 127);
+        a->p[1] = rnd_range(0, 63);
+        a->p[2] = rnd_range(0, 3);
+        break;
+    case VP8_MC:
+        if (f->h > 4 && (rnd() & 1))
+            a->h = f->h / 2;
+        if (f->arg & 16) {
+            a->y = f->arg & 12 ? rnd_range(1, 7) : 0;
+            a->x = f->arg &  3 ? rnd_range(1, 7) : 0;
+        } else {
+            /* index 1 selects the 4 tap filters used for odd positions,
+             * index 2 the 6 tap ones used for even positions */
+            a->y = (f->arg >> 2) == 1 ? 2 * rnd_range(0, 3) + 1 :
+                   (f->arg >> 2) == 2 ? 2 * rnd_range(1, 3)     : 0;
+            a->x = (f->arg & 3)  == 1 ? 2 * rnd_range(0, 3) + 1 :
+                   (f->arg & 3)  == 2 ? 2 * rnd_range(1, 3)     : 0;
+        }
+        break;
+    case VP56_EDGE_FILTER:
+        a->p[0] = rnd_range(0, 63);
+        break;
+    default:
+        break;
+    }
+}
+
+static double call_func(const FuncInfo *f, dsp_func func, const CallArgs *a, Buffers *b)
+{
+    uint8_t *dst  = b->dst  + a->dst_off;
+    uint8_t *dst2 = b->dst2 + a->dst_off;
+    uint8_t *src  = b->src  + a->src_off;
+    uint8_t *src2 = b->src2 + a->src_off;
+    int stride    = a->stride;
+
+    switch (f->type) {
+    case PIXELS:
+        ((op_pixels_func)func)(dst, src, stride, a->h);
+        break;
+    case QPEL:
+        ((qpel_mc_func)func)(dst, src, stride);
+        break;
+    case CHROMA:
+        ((h264_chroma_mc_func)func)(dst, src, stride, a->h, a->x, a->y);
+        break;
+    case CMP:
+        return ((me_cmp_func)func)(NULL, dst, src, stride, a->h);
+    case GET_PIXELS:
+        ((void (*)(DCTELEM *, const uint8_t *, int))func)(b->block, dst, stride);
+        break;
+    case DIFF_PIXELS:
+        ((void (*)(DCTELEM *, const uint8_t *, const uint8_t *, int))func)(b->block, dst, dst2, stride);
+        break;
+    case PIXELS_CLAMPED:
+        ((void (*)(const DCTELEM *, uint8_t *, int))func)(b->block, dst, stride);
+        break;
+    case PIX_SUM:
+        return ((int (*)(uint8_t *, int))func)(dst, stride);
+    case ADD_BYTES:
+        ((void (*)(uint8_t *, uint8_t *, int))func)(b->dst, b->src, a->len);
+        break;
+    case DIFF_BYTES:
+        ((void (*)(uint8_t *, uint8_t *, uint8_t *, int))func)(b->dst, b->src, src2, a->len);
+        break;
+    case BSWAP_BUF:
+        ((void (*)(uint32_t *, const uint32_t *, int))func)((uint32_t *)b->dst, (const uint32_t *)b->src, a->len);
+        break;
+    case VECTOR_FMUL:
+        ((void (*)(float *, const float *, int))func)(b->fdst, b->fsrc[0], a->len);
+        break;
+    case VECTOR_FMUL_REVERSE:
+        ((void (*)(float *, const float *, const float *, int))func)(b->fdst, b->fsrc[0], b->fsrc[1], a->len);
+        break;
+    case VECTOR_FMUL_ADD:
+        ((void (*)(float *, const float *, const float *, const float *, int))func)(b->fdst, b->fsrc[0], b->fsrc[1], b->fsrc[2], a->len);
+        break;
+    case VECTOR_CLIPF:
+        ((void (*)(float *, const float *, float, float, int))func)(b->fdst, b->fsrc[0], a->f[0], a->f[1], a->len);
+        break;
+    case INT32_TO_FLOAT:
+        ((void (*)(float *, const int *, float, int))func)(b->fdst, b->isrc, a->f[0], a->len);
+        break;
+    case SCALARPRODUCT_FLOAT:
+        return ((float (*)(const float *, const float *, int))func)(b->fsrc[0], b->fsrc[1], a->len);
+    case BUTTERFLIES_FLOAT:
+        ((void (*)(float *, float *, int))func)(b->fsrc[0], b->fsrc[1], a->len);
+        break;
+    case SCALARPRODUCT_INT16:
+        return ((int32_t (*)(const int16_t *, const int16_t *, int, int))func)(b->block, b->block2, a->len, 0);
+    case H264_IDCT:
+    case VP8_IDCT:
+        ((void (*)(uint8_t *, DCTELEM *, int))func)(dst, b->block, stride);
+        break;
+#if CONFIG_H264DSP
+    case H264_WEIGHT:
+        ((h264_weight_func)func)(dst, stride, a->p[0], a->p[1], a->p[3]);
+        break;
+    case H264_BIWEIGHT:
+        ((h264_biweight_func)func)(dst, dst2, stride, a->p[0], a->p[1], a->p[2], a->p[3]);
+        break;
+#endif
+    case H264_LOOP_FILTER: {
+        int8_t tc0[4];
+        memcpy(tc0, a->tc0, sizeof(tc0));
+        ((void (*)(uint8_t *, int, int, int, int8_t *))func)(dst, stride, a->p[0], a->p[1], tc0);
+        break;
+    }
+    case H264_LOOP_FILTER_INTRA:
+        ((void (*)(uint8_t *, int, int, int))func)(dst, stride, a->p[0], a->p[1]);
+        break;
+    case VP8_WHT:
+        ((void (*)(DCTELEM *, DCTELEM *))func)(b->block, b->block2);
+        break;
+    case VP8_LOOP_FILTER:
+        ((void (*)(uint8_t *, int, int, int, int))func)(dst, stride, a->p[0], a->p[1], a->p[2]);
+        break;
+    case VP8_LOOP_FILTER_UV:
+        ((void (*)(uint8_t *, uint8_t *, int, int, int, int))func)(dst, dst2, stride, a->p[0], a->p[1], a->p[2]);
+        break;
+    case VP8_LOOP_FILTER_SIMPLE:
+        ((void (*)(uint8_t *, int, int))func)(dst, stride, a->p[0]);
+        break;
+#if CONFIG_VP8_DECODER
+    case VP8_MC:
+        ((vp8_mc_func)func)(dst, stride, src, stride, a->h, a->x, a->y);
+        break;
+#endif
+    case VP56_EDGE_FILTER:
+        ((void (*)(uint8_t *, int, int))func)(dst, stride, a->p[0]);
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+static int is_float_type(enum FuncType type)
+{
+    return type >= VECTOR_FMUL && type <= BUTTERFLIES_FLOAT;
+}
+
+static int cmp_floats(const float *a, const float *b, int size)
+{
+    int i;
+    for (i = 0; i < size; i++) {
+        float eps = FFMAX(fabsf(a[i]), fabsf(b[i])) * 1e-5 + 1e-6;
+        if (!(fabsf(a[i] - b[i]) <= eps) && !(isnan(a[i]) && isnan(b[i])))
+            return i;
+    }
+    return -1;
+}
+
+static int cmp_bytes(const void *a, const void *b, int size)
+{
+    const uint8_t *pa = a, *pb = b;
+    int i;
+    for (i = 0; i < size; i++)
+        if (pa[i] != pb[i])
+            return i;
+    return -1;
+}
+
+/**
+ * Compare the results of the reference and the tested function.
+ * @return NULL if they match, the name of the first differing buffer
+ *         otherwise, and the index in it in *pos
+ */
+static const char *compare_results(const FuncInfo *f, double ret_ref, double ret_new, int *pos)
+{
+    *pos = 0;
+    if (f->type == SCALARPRODUCT_FLOAT) {
+        if (fabs(ret_ref - ret_new) > fabs(ret_ref) * 1e-4 + 1e-4)
+            return "return value";
+    } else if (ret_ref != ret_new)
+        return "return value";
+    if ((*pos = cmp_bytes(buf_ref.dst,  buf_new.dst,  BUF_SIZE)) >= 0) return "dst";
+    if ((*pos = cmp_bytes(buf_ref.dst2, buf_new.dst2, BUF_SIZE)) >= 0) return "dst2";
+    /* the IDCTs may leave any values in the coefficients */
+    if (f->type != H264_IDCT && f->type != VP8_IDCT) {
+        if ((*pos = cmp_bytes(buf_ref.block,  buf_new.block,  sizeof(buf_ref.block)))  >= 0) return "block";
+        if ((*pos = cmp_bytes(buf_ref.block2, buf_new.block2, sizeof(buf_ref.block2))) >= 0) return "block2";
+    }
+    if (is_float_type(f->type)) {
+        if ((*pos = cmp_floats(buf_ref.fdst,    buf_new.fdst,    FLOAT_LEN)) >= 0) return "float dst";
+        if ((*pos = cmp_floats(buf_ref.fsrc[0], buf_new.fsrc[0], FLOAT_LEN)) >= 0) return "float src0";
+        if ((*pos = cmp_floats(buf_ref.fsrc[1], buf_new.fsrc[1], FLOAT_LEN)) >= 0) return "float src1";
+    }
+    return NULL;
+}
+
+static int check_func(const FuncInfo *f, dsp_func ref, dsp_func func,
+                      const char *cpu, int iterations)
+{
+    CallArgs a;
+    double ret_ref, ret_new;
+    const char *err;
+    int i, pos;
+
+    for (i = 0; i < iterations; i++) {
+        init_args(f, &a, i, 0);
+        buf_new = buf_ref;
+        ret_ref = call_func(f, ref,  &a, &buf_ref);
+        ret_new = call_func(f, func, &a, &buf_new);
+        emms_c();
+        if ((err = compare_results(f, ret_ref, ret_new, &pos))) {
+            printf("FAILED: %s %s: %s differs at %d (stride %d, src align %d, "
+                   "h %d, x %d, y %d, len %d, params %d %d %d %d)\n",
+                   cpu, f->name, err, pos, a.stride, a.src_off & 15,
+                   a.h, a.x, a.y, a.len, a.p[0], a.p[1], a.p[2], a.p[3]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t bench_time(void)
+{
+#ifdef AV_READ_TIME
+    return AV_READ_TIME();
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
+/**
+ * @return the best time per call over BENCH_RUNS runs of BENCH_CALLS calls
+ */
+static double bench_func(const FuncInfo *f, dsp_func func)
+{
+    CallArgs a;
+    uint64_t t, best = UINT64_MAX;
+    int i, j;
+
+    init_args(f, &a, 1, 1);
+    buf_new = buf_ref;
+    for (i = 0; i < BENCH_RUNS; i++) {
+        t = bench_time();
+        for (j = 0; j < BENCH_CALLS; j++)
+            call_func(f, func, &a, &buf_new);
+        t = bench_time() - t;
+        emms_c();
+        best = FFMIN(best, t);
+    }
+    return best / (double)BENCH_CALLS;
+}
+
+static void help(void)
+{
+    printf("usage: dsp-test [-h] [-b] [-v] [-n iterations] [-s seed] [-f filter]\n"
+           "test the optimized DSP functions against the C versions\n"
+           "-b           benchmark the functions, in "BENCH_UNIT" per call\n"
+           "-v           list the functions which only have a C version\n"
+           "-n N         check every function with N sets of random input\n"
+           "-s seed      random seed\n"
+           "-f filter    only test the functions whose name contains filter\n");
+}
+
+int main(int argc, char **argv)
+{
+    AVCodecContext *avctx;
+    const char *filter = NULL;
+    int bench = 0, verbose = 0, iterations = 64;
+    unsigned seed = 1;
+    int cpu_flags, flags = 0, i, j, c;
+    int nb_checked = 0, nb_failed = 0, nb_levels = 0;
+    uint8_t *tested;
+
+    while ((c = getopt(argc, argv, "hbvn:s:f:")) != -1) {
+        switch (c) {
+        case 'b': bench      = 1;                      break;
+        case 'v': verbose    = 1;                      break;
+        case 'n': iterations = atoi(optarg);           break;
+        case 's': seed       = strtoul(optarg, NULL, 0); break;
+        case 'f': filter     = optarg;                 break;
+        default:
+            help();
+            return 1;
+        }
+    }
+
+    avcodec_init();
+    av_lfg_init(&prng, seed);
+    register_funcs();
+    tested = av_mallocz(nb_funcs);
+    avctx = avcodec_alloc_context();
+    if (!tested || !avctx)
+        return 1;
+    /* no approximations, the results have to match exactly */
+    avctx->flags |= CODEC_FLAG_BITEXACT;
+
+    cpu_flags = av_get_cpu_flags();
+    printf("dsp-test: cpu flags 0x%08X, seed %u, %d iterations\n",
+           cpu_flags, seed, iterations);
+
+    init_contexts(&ctx_c, avctx, 0);
+    ctx_prev = ctx_c;
+    for (i = 0; cpu_flag_tab[i].name; i++) {
+        int header = 0;
+
+        if (!(cpu_flags & cpu_flag_tab[i].flag))
+            continue;
+        flags |= cpu_flags & cpu_flag_tab[i].flag;
+        init_contexts(&ctx_cur, avctx, flags);
+        nb_levels++;
+
+        for (j = 0; j < nb_funcs; j++) {
+            const FuncInfo *f = &funcs[j];
+            dsp_func ref  = get_func(&ctx_c, f);
+            dsp_func func = get_func(&ctx_cur, f);
+
+            if (!ref || !func || func == ref || func == get_func(&ctx_prev, f))
+                continue;
+            if (filter && !strstr(f->name, filter))
+                continue;
+            if (!header) {
+                printf("%s:\n", cpu_flag_tab[i].name);
+                header = 1;
+            }
+            tested[j] = 1;
+            nb_checked++;
+            if (check_func(f, ref, func, cpu_flag_tab[i].name, iterations) < 0) {
+                nb_failed++;
+                continue;
+            }
+            if (bench) {
+                double t_ref = bench_func(f, ref);
+                double t_new = bench_func(f, func);
+                printf("  %-40s C %9.1f  %-8s %9.1f  %5.2fx\n", f->name, t_ref,
+                       cpu_flag_tab[i].name, t_new, t_ref / FFMAX(t_new, 0.01));
+            } else
+                printf("  %-40s OK\n", f->name);
+        }
+        ctx_prev = ctx_cur;
+    }
+    av_force_cpu_flags(-1);
+
+    if (!nb_levels)
+        printf("no CPU extensions available\n");
+    if (verbose) {
+        printf("C only:\n");
+        for (j = 0; j < nb_funcs; j++) {
+            if (tested[j] || !get_func(&ctx_c, &funcs[j]) ||
+                (filter && !strstr(funcs[j].name, filter)))
+                continue;
+            if (bench)
+                printf("  %-40s C %9.1f\n", funcs[j].name, bench_func(&funcs[j], get_func(&ctx_c, &funcs[j])));
+            else
+                printf("  %s\n", funcs[j].name);
+        }
+    }
+    printf("%d functions checked, %d failed%s\n", nb_checked, nb_failed,
+           bench ? ", times in "BENCH_UNIT" per call" : "");
+
+    av_free(tested);
+    av_free(avctx);
+    return !!nb_failed;
+}
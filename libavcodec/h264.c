@@ -158,25 +158,8 @@ const uint8_t *ff_h264_decode_nal(H264Context *h, const uint8_t *src, int *dst_l
         printf("%2X ", src[i]);
 #endif
 
-#if HAVE_FAST_UNALIGNED
-# if HAVE_FAST_64BIT
-#   define RS 7
-    for(i=0; i+1<length; i+=9){
-        if(!((~AV_RN64A(src+i) & (AV_RN64A(src+i) - 0x0100010001000101ULL)) & 0x8000800080008080ULL))
-# else
-#   define RS 3
-    for(i=0; i+1<length; i+=5){
-        if(!((~AV_RN32A(src+i) & (AV_RN32A(src+i) - 0x01000101U)) & 0x80008080U))
-# endif
-            continue;
-        if(i>0 && !src[i]) i--;
-        while(src[i]) i++;
-#else
-#   define RS 0
-    for(i=0; i+1<length; i+=2){
-        if(src[i]) continue;
-        if(i>0 && src[i-1]==0) i--;
-#endif
+    for(i=0; i+1<length; i++){
+        i+= ff_startcode_find_candidate(src + i, length - i);
         if(i+2<length && src[i+1]==0 && src[i+2]<=3){
             if(src[i+2]!=3){
                 /* startcode, so we must be past the end */
@@ -184,7 +167,6 @@ const uint8_t *ff_h264_decode_nal(H264Context *h, const uint8_t *src, int *dst_l
             }
             break;
         }
-        i-= RS;
     }
 
     if(i>=length-1){ //no escaped 0
@@ -2664,10 +2646,14 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
             next_avc= buf_index + nalsize;
         } else {
             // start code prefix search
-            for(; buf_index + 3 < next_avc; buf_index++){
+            while(buf_index + 3 < next_avc){
                 // This should always succeed in the first iteration.
-                if(buf[buf_index] == 0 && buf[buf_index+1] == 0 && buf[buf_index+2] == 1)
+                buf_index += ff_startcode_find_candidate(buf + buf_index, next_avc - 3 - buf_index);
+                if(buf_index + 3 >= next_avc)
+                    break;
+                if(buf[buf_index+1] == 0 && buf[buf_index+2] == 1)
                     break;
+                buf_index++;
             }
 
             if(buf_index+3 >= buf_size) break;
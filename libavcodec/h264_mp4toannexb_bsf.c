@@ -28,105 +28,84 @@ typedef struct H264BSFContext {
     int      extradata_parsed;
 } H264BSFContext;
 
-static int alloc_and_copy(uint8_t **poutbuf,          int *poutbuf_size,
-                          const uint8_t *sps_pps, uint32_t sps_pps_size,
-                          const uint8_t *in,      uint32_t in_size) {
-    uint32_t offset = *poutbuf_size;
-    uint8_t nal_header_size = offset ? 3 : 4;
-    void *tmp;
-
-    *poutbuf_size += sps_pps_size+in_size+nal_header_size;
-    tmp = av_realloc(*poutbuf, *poutbuf_size);
-    if (!tmp)
-        return AVERROR(ENOMEM);
-    *poutbuf = tmp;
-    if (sps_pps)
-        memcpy(*poutbuf+offset, sps_pps, sps_pps_size);
-    memcpy(*poutbuf+sps_pps_size+nal_header_size+offset, in, in_size);
-    if (!offset) {
-        AV_WB32(*poutbuf+sps_pps_size, 1);
-    } else {
-        (*poutbuf+offset+sps_pps_size)[0] = (*poutbuf+offset+sps_pps_size)[1] = 0;
-        (*poutbuf+offset+sps_pps_size)[2] = 1;
+/**
+ * Replace the avcC extradata with its SPS and PPS NAL units in Annex B format.
+ */
+static int parse_extradata(H264BSFContext *ctx, AVCodecContext *avctx)
+{
+    uint16_t unit_size;
+    uint64_t total_size = 0;
+    uint8_t *out = NULL, unit_nb, sps_done = 0;
+    const uint8_t *extradata = avctx->extradata+4;
+    static const uint8_t nalu_header[4] = {0, 0, 0, 1};
+
+    /* retrieve length coded size */
+    ctx->length_size = (*extradata++ & 0x3) + 1;
+    if (ctx->length_size == 3)
+        return AVERROR(EINVAL);
+
+    /* retrieve sps and pps unit(s) */
+    unit_nb = *extradata++ & 0x1f; /* number of sps unit(s) */
+    if (!unit_nb) {
+        unit_nb = *extradata++; /* number of pps unit(s) */
+        sps_done++;
+    }
+    while (unit_nb--) {
+        void *tmp;
+
+        unit_size = AV_RB16(extradata);
+        total_size += unit_size+4;
+        if (total_size > INT_MAX - FF_INPUT_BUFFER_PADDING_SIZE ||
+            extradata+2+unit_size > avctx->extradata+avctx->extradata_size) {
+            av_free(out);
+            return AVERROR(EINVAL);
+        }
+        tmp = av_realloc(out, total_size + FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!tmp) {
+            av_free(out);
+            return AVERROR(ENOMEM);
+        }
+        out = tmp;
+        memcpy(out+total_size-unit_size-4, nalu_header, 4);
+        memcpy(out+total_size-unit_size,   extradata+2, unit_size);
+        extradata += 2+unit_size;
+
+        if (!unit_nb && !sps_done++)
+            unit_nb = *extradata++; /* number of pps unit(s) */
     }
 
+    memset(out + total_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    av_free(avctx->extradata);
+    avctx->extradata      = out;
+    avctx->extradata_size = total_size;
+    ctx->first_idr        = 1;
+    ctx->extradata_parsed = 1;
     return 0;
 }
 
-static int h264_mp4toannexb_filter(AVBitStreamFilterContext *bsfc,
-                                   AVCodecContext *avctx, const char *args,
-                                   uint8_t  **poutbuf, int *poutbuf_size,
-                                   const uint8_t *buf, int      buf_size,
-                                   int keyframe) {
-    H264BSFContext *ctx = bsfc->priv_data;
+/**
+ * Convert the length prefixed NAL units of a packet to Annex B format.
+ * Every NAL unit gets a 4 byte start code, so with 4 byte length fields
+ * and no parameter sets to insert the output has the size and layout of
+ * the input and can be written over it.
+ *
+ * @param out buffer for the output, may be equal to buf in the case above,
+ *            NULL to only compute the output size
+ * @return the output size, or a negative error code
+ */
+static int convert_nal_units(H264BSFContext *ctx, AVCodecContext *avctx,
+                             uint8_t *out, const uint8_t *buf, int buf_size)
+{
+    const uint8_t *buf_end = buf + buf_size;
+    int first_idr = ctx->first_idr;
     uint8_t unit_type;
     int32_t nal_size;
     uint32_t cumul_size = 0;
-    const uint8_t *buf_end = buf + buf_size;
+    int64_t out_size = 0;
 
-    /* nothing to filter */
-    if (!avctx->extradata || avctx->extradata_size < 6) {
-        *poutbuf = (uint8_t*) buf;
-        *poutbuf_size = buf_size;
-        return 0;
-    }
-
-    /* retrieve sps and pps NAL units from extradata */
-    if (!ctx->extradata_parsed) {
-        uint16_t unit_size;
-        uint64_t total_size = 0;
-        uint8_t *out = NULL, unit_nb, sps_done = 0;
-        const uint8_t *extradata = avctx->extradata+4;
-        static const uint8_t nalu_header[4] = {0, 0, 0, 1};
-
-        /* retrieve length coded size */
-        ctx->length_size = (*extradata++ & 0x3) + 1;
-        if (ctx->length_size == 3)
-            return AVERROR(EINVAL);
-
-        /* retrieve sps and pps unit(s) */
-        unit_nb = *extradata++ & 0x1f; /* number of sps unit(s) */
-        if (!unit_nb) {
-            unit_nb = *extradata++; /* number of pps unit(s) */
-            sps_done++;
-        }
-        while (unit_nb--) {
-            void *tmp;
-
-            unit_size = AV_RB16(extradata);
-            total_size += unit_size+4;
-            if (total_size > INT_MAX - FF_INPUT_BUFFER_PADDING_SIZE ||
-                extradata+2+unit_size > avctx->extradata+avctx->extradata_size) {
-                av_free(out);
-                return AVERROR(EINVAL);
-            }
-            tmp = av_realloc(out, total_size + FF_INPUT_BUFFER_PADDING_SIZE);
-            if (!tmp) {
-                av_free(out);
-                return AVERROR(ENOMEM);
-            }
-            out = tmp;
-            memcpy(out+total_size-unit_size-4, nalu_header, 4);
-            memcpy(out+total_size-unit_size,   extradata+2, unit_size);
-            extradata += 2+unit_size;
-
-            if (!unit_nb && !sps_done++)
-                unit_nb = *extradata++; /* number of pps unit(s) */
-        }
-
-        memset(out + total_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-        av_free(avctx->extradata);
-        avctx->extradata      = out;
-        avctx->extradata_size = total_size;
-        ctx->first_idr        = 1;
-        ctx->extradata_parsed = 1;
-    }
-
-    *poutbuf_size = 0;
-    *poutbuf = NULL;
     do {
         if (buf + ctx->length_size > buf_end)
-            goto fail;
+            return AVERROR(EINVAL);
 
         if (ctx->length_size == 1) {
             nal_size = buf[0];
@@ -139,39 +118,109 @@ static int h264_mp4toannexb_filter(AVBitStreamFilterContext *bsfc,
         unit_type = *buf & 0x1f;
 
         if (buf + nal_size > buf_end || nal_size < 0)
-            goto fail;
+            return AVERROR(EINVAL);
 
         /* prepend only to the first type 5 NAL unit of an IDR picture */
-        if (ctx->first_idr && unit_type == 5) {
-            if (alloc_and_copy(poutbuf, poutbuf_size,
-                               avctx->extradata, avctx->extradata_size,
-                               buf, nal_size) < 0)
-                goto fail;
-            ctx->first_idr = 0;
-        } else {
-            if (alloc_and_copy(poutbuf, poutbuf_size,
-                               NULL, 0,
-                               buf, nal_size) < 0)
-                goto fail;
-            if (!ctx->first_idr && unit_type == 1)
-                ctx->first_idr = 1;
+        if (first_idr && unit_type == 5) {
+            if (out)
+                memcpy(out + out_size, avctx->extradata, avctx->extradata_size);
+            out_size += avctx->extradata_size;
+            first_idr = 0;
+        } else if (!first_idr && unit_type == 1)
+            first_idr = 1;
+
+        if (out) {
+            AV_WB32(out + out_size, 1);
+            if (out + out_size + 4 != buf)
+                memcpy(out + out_size + 4, buf, nal_size);
         }
+        out_size += 4 + nal_size;
+        if (out_size > INT_MAX - FF_INPUT_BUFFER_PADDING_SIZE)
+            return AVERROR(EINVAL);
 
         buf += nal_size;
         cumul_size += nal_size + ctx->length_size;
     } while (cumul_size < buf_size);
 
-    return 1;
+    if (out)
+        ctx->first_idr = first_idr;
+    return out_size;
+}
+
+static int h264_mp4toannexb_filter(AVBitStreamFilterContext *bsfc,
+                                   AVCodecContext *avctx, const char *args,
+                                   uint8_t  **poutbuf, int *poutbuf_size,
+                                   const uint8_t *buf, int      buf_size,
+                                   int keyframe) {
+    H264BSFContext *ctx = bsfc->priv_data;
+    int ret, size;
+
+    /* nothing to filter */
+    if (!avctx->extradata || avctx->extradata_size < 6) {
+        *poutbuf = (uint8_t*) buf;
+        *poutbuf_size = buf_size;
+        return 0;
+    }
+
+    /* retrieve sps and pps NAL units from extradata */
+    if (!ctx->extradata_parsed && (ret = parse_extradata(ctx, avctx)) < 0)
+        return ret;
 
-fail:
-    av_freep(poutbuf);
     *poutbuf_size = 0;
-    return AVERROR(EINVAL);
+    *poutbuf = NULL;
+
+    size = convert_nal_units(ctx, avctx, NULL, buf, buf_size);
+    if (size < 0)
+        return size;
+    *poutbuf = av_malloc(size + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!*poutbuf)
+        return AVERROR(ENOMEM);
+    convert_nal_units(ctx, avctx, *poutbuf, buf, buf_size);
+    memset(*poutbuf + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    *poutbuf_size = size;
+
+    return 1;
+}
+
+static int h264_mp4toannexb_filter_packet(AVBitStreamFilterContext *bsfc,
+                                          AVCodecContext *avctx,
+                                          const char *args, AVPacket *pkt)
+{
+    H264BSFContext *ctx = bsfc->priv_data;
+    uint8_t *out;
+    int ret, size;
+
+    if (!avctx->extradata || avctx->extradata_size < 6)
+        return 0;
+
+    if (!ctx->extradata_parsed && (ret = parse_extradata(ctx, avctx)) < 0)
+        return ret;
+
+    size = convert_nal_units(ctx, avctx, NULL, pkt->data, pkt->size);
+    if (size < 0)
+        return size;
+
+    if (ctx->length_size == 4 && size == pkt->size) {
+        convert_nal_units(ctx, avctx, pkt->data, pkt->data, pkt->size);
+        return 0;
+    }
+
+    out = av_malloc(size + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!out)
+        return AVERROR(ENOMEM);
+    convert_nal_units(ctx, avctx, out, pkt->data, pkt->size);
+    memset(out + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    av_free_packet(pkt);
+    pkt->data     = out;
+    pkt->size     = size;
+    pkt->destruct = av_destruct_packet;
+
+    return 0;
 }
 
 AVBitStreamFilter h264_mp4toannexb_bsf = {
-    "h264_mp4toannexb",
-    sizeof(H264BSFContext),
-    h264_mp4toannexb_filter,
+    .name           = "h264_mp4toannexb",
+    .priv_data_size = sizeof(H264BSFContext),
+    .filter         = h264_mp4toannexb_filter,
+    .filter_packet  = h264_mp4toannexb_filter_packet,
 };
-
@@ -95,12 +95,13 @@ static int mjpeg2jpeg_filter(AVBitStreamFilterContext *bsfc,
     }
     output_size = buf_size - input_skip +
                   sizeof(jpeg_header) + dht_segment_size;
-    output = out = av_malloc(output_size);
+    output = out = av_malloc(output_size + FF_INPUT_BUFFER_PADDING_SIZE);
     if (!output)
         return AVERROR(ENOMEM);
     out = append(out, jpeg_header, sizeof(jpeg_header));
     out = append_dht_segment(out);
     out = append(out, buf + input_skip, buf_size - input_skip);
+    memset(out, 0, FF_INPUT_BUFFER_PADDING_SIZE);
     *poutbuf = output;
     *poutbuf_size = output_size;
     return 1;
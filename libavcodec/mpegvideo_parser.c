@@ -168,10 +168,10 @@ static int mpegvideo_split(AVCodecContext *avctx,
     int i;
     uint32_t state= -1;
 
-    for(i=0; i<buf_size; i++){
-        state= (state<<8) | buf[i];
+    for(i=0; i<buf_size; ){
+        i= ff_find_start_code(buf+i, buf+buf_size, &state) - buf;
         if(state != 0x1B3 && state != 0x1B5 && state < 0x200 && state >= 0x100)
-            return i-3;
+            return i-4;
     }
     return 0;
 }
@@ -21,26 +21,41 @@
 #include "avcodec.h"
 
 
+static void add_noise(unsigned int *state, int amount, uint8_t *buf, int buf_size){
+    int i;
+
+    for(i=0; i<buf_size; i++){
+        (*state) += buf[i] + 1;
+        if(*state % amount == 0)
+            buf[i] = *state;
+    }
+}
+
 static int noise(AVBitStreamFilterContext *bsfc, AVCodecContext *avctx, const char *args,
                      uint8_t **poutbuf, int *poutbuf_size,
                      const uint8_t *buf, int buf_size, int keyframe){
     unsigned int *state= bsfc->priv_data;
     int amount= args ? atoi(args) : (*state % 10001+1);
-    int i;
 
     *poutbuf= av_malloc(buf_size + FF_INPUT_BUFFER_PADDING_SIZE);
 
     memcpy(*poutbuf, buf, buf_size + FF_INPUT_BUFFER_PADDING_SIZE);
-    for(i=0; i<buf_size; i++){
-        (*state) += (*poutbuf)[i] + 1;
-        if(*state % amount == 0)
-            (*poutbuf)[i] = *state;
-    }
+    add_noise(state, amount, *poutbuf, buf_size);
     return 1;
 }
 
+static int noise_packet(AVBitStreamFilterContext *bsfc, AVCodecContext *avctx,
+                        const char *args, AVPacket *pkt){
+    unsigned int *state= bsfc->priv_data;
+    int amount= args ? atoi(args) : (*state % 10001+1);
+
+    add_noise(state, amount, pkt->data, pkt->size);
+    return 0;
+}
+
 AVBitStreamFilter noise_bsf={
-    "noise",
-    sizeof(int),
-    noise,
+    .name           = "noise",
+    .priv_data_size = sizeof(int),
+    .filter         = noise,
+    .filter_packet  = noise_packet,
 };
@@ -21,6 +21,7 @@
  */
 
 #include "parser.h"
+#include "startcode.h"
 
 static AVCodecParser *av_first_parser = NULL;
 
@@ -340,10 +341,10 @@ int ff_mpeg4video_split(AVCodecContext *avctx,
     int i;
     uint32_t state= -1;
 
-    for(i=0; i<buf_size; i++){
-        state= (state<<8) | buf[i];
+    for(i=0; i<buf_size; ){
+        i= ff_find_start_code(buf+i, buf+buf_size, &state) - buf;
         if(state == 0x1B3 || state == 0x1B6)
-            return i-3;
+            return i-4;
     }
     return 0;
 }
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Fast scanning for 00 00 01 start code prefixes.
+ */
+
+#include <assert.h>
+
+#include "libavutil/common.h"
+#include "libavutil/intreadwrite.h"
+#include "startcode.h"
+
+int ff_startcode_find_candidate_c(const uint8_t *buf, int size)
+{
+    int i = 0;
+
+#if HAVE_FAST_UNALIGNED
+    /* a word contains a zero byte if subtracting 1 from every byte borrows
+     * into a byte whose high bit was clear */
+#if HAVE_FAST_64BIT
+    while (i + 7 < size &&
+           !((~AV_RN64(buf + i) & (AV_RN64(buf + i) - 0x0101010101010101ULL)) &
+             0x8080808080808080ULL))
+        i += 8;
+#else
+    while (i + 3 < size &&
+           !((~AV_RN32(buf + i) & (AV_RN32(buf + i) - 0x01010101U)) &
+             0x80808080U))
+        i += 4;
+#endif
+#endif
+    for (; i < size; i++)
+        if (!buf[i])
+            break;
+    return i;
+}
+
+int (*ff_startcode_find_candidate)(const uint8_t *buf, int size) =
+    ff_startcode_find_candidate_c;
+
+const uint8_t *ff_find_start_code(const uint8_t * restrict p, const uint8_t *end, uint32_t * restrict state){
+    int i;
+
+    assert(p<=end);
+    if(p>=end)
+        return end;
+
+    for(i=0; i<3; i++){
+        uint32_t tmp= *state << 8;
+        *state= tmp + *(p++);
+        if(tmp == 0x100 || p==end)
+            return p;
+    }
+
+    while(p<end){
+        /* no start code can end before the first zero byte from p on */
+        if     (p[-1] > 1      ) p+= ff_startcode_find_candidate(p, end - p) + 3;
+        else if(p[-2]          ) p+= 2;
+        else if(p[-3]|(p[-1]-1)) p++;
+        else{
+            p++;
+            break;
+        }
+    }
+
+    p= FFMIN(p, end)-4;
+    *state= AV_RB32(p);
+
+    return p+4;
+}
+
+void ff_startcode_init(void)
+{
+    if (HAVE_MMX) ff_startcode_init_x86();
+}
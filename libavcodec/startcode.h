@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Fast scanning for 00 00 01 start code prefixes.
+ *
+ * Every start code begins with a zero byte, so the parsers skip over the
+ * bytes in between with ff_startcode_find_candidate(), which tests many
+ * bytes at a time, and only look at the bytes around each zero.
+ */
+
+#ifndef AVCODEC_STARTCODE_H
+#define AVCODEC_STARTCODE_H
+
+#include <stdint.h>
+
+/**
+ * Find the first zero byte of a buffer.
+ * Nothing past buf + size is read, so the buffer needs no padding.
+ * @return the offset of the first zero byte, or size if there is none
+ */
+extern int (*ff_startcode_find_candidate)(const uint8_t *buf, int size);
+
+int ff_startcode_find_candidate_c(const uint8_t *buf, int size);
+
+/**
+ * Find the next 00 00 01 xx start code.
+ * @param state the last 4 bytes seen, updated with the bytes consumed so
+ *              that start codes spanning several buffers are found
+ * @return pointer just past the start code, or end if none was found
+ */
+const uint8_t *ff_find_start_code(const uint8_t *p, const uint8_t *end, uint32_t *state);
+
+/**
+ * Select the fastest ff_startcode_find_candidate() for the CPU,
+ * called by avcodec_init().
+ */
+void ff_startcode_init(void);
+
+void ff_startcode_init_x86(void);
+
+#endif /* AVCODEC_STARTCODE_H */
@@ -29,6 +29,7 @@
 #include "libavutil/integer.h"
 #include "libavutil/crc.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/profile.h"
 #include "libavcore/audioconvert.h"
 #include "libavcore/imgutils.h"
 #include "libavcore/internal.h"
@@ -39,6 +40,7 @@
 #include "imgconvert.h"
 #include "audioconvert.h"
 #include "internal.h"
+#include "startcode.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <limits.h>
@@ -627,6 +629,7 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
                          AVPacket *avpkt)
 {
     int ret;
+    uint64_t t;
 
     *got_picture_ptr= 0;
     if((avctx->coded_width||avctx->coded_height) && av_image_check_size(avctx->coded_width, avctx->coded_height, 0, avctx))
@@ -635,10 +638,13 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
     avctx->pkt = avpkt;
 
     if((avctx->codec->capabilities & CODEC_CAP_DELAY) || avpkt->size){
+        t = av_profile_start();
         ret = avctx->codec->decode(avctx, picture, got_picture_ptr,
                                 avpkt);
 
         emms_c(); //needed to avoid an emms_c() call before every return;
+        if (t)
+            av_profile_stop(av_profile_get_probe("decode", avctx->codec->name), t);
 
         picture->pkt_dts= avpkt->dts;
 
@@ -669,6 +675,7 @@ int attribute_align_arg avcodec_decode_audio3(AVCodecContext *avctx, int16_t *sa
                          AVPacket *avpkt)
 {
     int ret;
+    uint64_t t;
 
     avctx->pkt = avpkt;
 
@@ -684,7 +691,10 @@ int attribute_align_arg avcodec_decode_audio3(AVCodecContext *avctx, int16_t *sa
             return -1;
         }
 
+        t = av_profile_start();
         ret = avctx->codec->decode(avctx, samples, frame_size_ptr, avpkt);
+        if (t)
+            av_profile_stop(av_profile_get_probe("decode", avctx->codec->name), t);
         avctx->frame_number++;
     }else{
         ret= 0;
@@ -1023,6 +1033,7 @@ void avcodec_init(void)
     initialized = 1;
 
     dsputil_static_init();
+    ff_startcode_init();
 }
 
 void avcodec_flush_buffers(AVCodecContext *avctx)
@@ -94,10 +94,9 @@ static int vc1_find_frame_end(ParseContext *pc, const uint8_t *buf,
 
     i=0;
     if(!pic_found){
-        for(i=0; i<buf_size; i++){
-            state= (state<<8) | buf[i];
+        while(i<buf_size){
+            i= ff_find_start_code(buf+i, buf+buf_size, &state) - buf;
             if(state == VC1_CODE_FRAME || state == VC1_CODE_FIELD){
-                i++;
                 pic_found=1;
                 break;
             }
@@ -108,12 +107,12 @@ static int vc1_find_frame_end(ParseContext *pc, const uint8_t *buf,
         /* EOF considered as end of frame */
         if (buf_size == 0)
             return 0;
-        for(; i<buf_size; i++){
-            state= (state<<8) | buf[i];
+        while(i<buf_size){
+            i= ff_find_start_code(buf+i, buf+buf_size, &state) - buf;
             if(IS_MARKER(state) && state != VC1_CODE_FIELD && state != VC1_CODE_SLICE){
                 pc->frame_start_found=0;
                 pc->state=-1;
-                return i-3;
+                return i-4;
             }
         }
     }
@@ -156,13 +155,13 @@ static int vc1_split(AVCodecContext *avctx,
     uint32_t state= -1;
     int charged=0;
 
-    for(i=0; i<buf_size; i++){
-        state= (state<<8) | buf[i];
+    for(i=0; i<buf_size; ){
+        i= ff_find_start_code(buf+i, buf+buf_size, &state) - buf;
         if(IS_MARKER(state)){
             if(state == VC1_CODE_SEQHDR || state == VC1_CODE_ENTRYPOINT){
                 charged=1;
             }else if(charged){
-                return i-3;
+                return i-4;
             }
         }
     }
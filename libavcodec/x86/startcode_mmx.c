@@ -0,0 +1,67 @@
+/*
+ * SSE2 optimized start code scanning
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/startcode.h"
+
+#if HAVE_SSE
+static int startcode_find_candidate_sse2(const uint8_t *buf, int size)
+{
+    x86_reg i = 0;
+    int mask;
+
+    if (size >= 32) {
+        /* compare 32 bytes per iteration against zero, stop at the first
+         * block containing a zero byte and let the C loop locate it */
+        __asm__ volatile(
+            "pxor       %%xmm0, %%xmm0      \n\t"
+            "1:                             \n\t"
+            "movdqu     (%2, %0), %%xmm1    \n\t"
+            "movdqu   16(%2, %0), %%xmm2    \n\t"
+            "pcmpeqb    %%xmm0, %%xmm1      \n\t"
+            "pcmpeqb    %%xmm0, %%xmm2      \n\t"
+            "por        %%xmm2, %%xmm1      \n\t"
+            "pmovmskb   %%xmm1, %1          \n\t"
+            "test       %1, %1              \n\t"
+            "jnz        2f                  \n\t"
+            "add        $32, %0             \n\t"
+            "cmp        %3, %0              \n\t"
+            "jle        1b                  \n\t"
+            "2:                             \n\t"
+            : "+r"(i), "=&r"(mask)
+            : "r"(buf), "r"((x86_reg)size - 32)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+        );
+    }
+    return i + ff_startcode_find_candidate_c(buf + i, size - i);
+}
+#endif
+
+void ff_startcode_init_x86(void)
+{
+#if HAVE_SSE
+    int mm_flags = av_get_cpu_flags();
+
+    if (mm_flags & AV_CPU_FLAG_SSE2)
+        ff_startcode_find_candidate = startcode_find_candidate_sse2;
+#endif
+}
@@ -22,7 +22,9 @@
 /* #define DEBUG */
 
 #include "libavutil/pixdesc.h"
+#include "libavutil/profile.h"
 #include "libavutil/rational.h"
+#include "libavutil/slab.h"
 #include "libavcore/audioconvert.h"
 #include "libavcore/imgutils.h"
 #include "avfilter.h"
@@ -45,21 +47,21 @@ const char *avfilter_license(void)
 
 AVFilterBufferRef *avfilter_ref_buffer(AVFilterBufferRef *ref, int pmask)
 {
-    AVFilterBufferRef *ret = av_malloc(sizeof(AVFilterBufferRef));
+    AVFilterBufferRef *ret = ff_slab_alloc(sizeof(AVFilterBufferRef));
     if (!ret)
         return NULL;
     *ret = *ref;
     if (ref->type == AVMEDIA_TYPE_VIDEO) {
-        ret->video = av_malloc(sizeof(AVFilterBufferRefVideoProps));
+        ret->video = ff_slab_alloc(sizeof(AVFilterBufferRefVideoProps));
         if (!ret->video) {
-            av_free(ret);
+            ff_slab_free(ret);
             return NULL;
         }
         *ret->video = *ref->video;
     } else if (ref->type == AVMEDIA_TYPE_AUDIO) {
-        ret->audio = av_malloc(sizeof(AVFilterBufferRefAudioProps));
+        ret->audio = ff_slab_alloc(sizeof(AVFilterBufferRefAudioProps));
         if (!ret->audio) {
-            av_free(ret);
+            ff_slab_free(ret);
             return NULL;
         }
         *ret->audio = *ref->audio;
@@ -75,9 +77,9 @@ void avfilter_unref_buffer(AVFilterBufferRef *ref)
         return;
     if (!(--ref->buf->refcount))
         ref->buf->free(ref->buf);
-    av_free(ref->video);
-    av_free(ref->audio);
-    av_free(ref);
+    ff_slab_free(ref->video);
+    ff_slab_free(ref->audio);
+    ff_slab_free(ref);
 }
 
 void avfilter_insert_pad(unsigned idx, unsigned *count, size_t padidx_off,
@@ -296,14 +298,14 @@ avfilter_get_video_buffer_ref_from_arrays(uint8_t *data[4], int linesize[4], int
                                           int w, int h, enum PixelFormat format)
 {
     AVFilterBuffer *pic = av_mallocz(sizeof(AVFilterBuffer));
-    AVFilterBufferRef *picref = av_mallocz(sizeof(AVFilterBufferRef));
+    AVFilterBufferRef *picref = ff_slab_mallocz(sizeof(AVFilterBufferRef));
 
     if (!pic || !picref)
         goto fail;
 
     picref->buf = pic;
     picref->buf->free = ff_avfilter_default_free_buffer;
-    if (!(picref->video = av_mallocz(sizeof(AVFilterBufferRefVideoProps))))
+    if (!(picref->video = ff_slab_mallocz(sizeof(AVFilterBufferRefVideoProps))))
         goto fail;
 
     pic->w = picref->video->w = w;
@@ -325,8 +327,8 @@ avfilter_get_video_buffer_ref_from_arrays(uint8_t *data[4], int linesize[4], int
 
 fail:
     if (picref && picref->video)
-        av_free(picref->video);
-    av_free(picref);
+        ff_slab_free(picref->video);
+    ff_slab_free(picref);
     av_free(pic);
     return NULL;
 }
@@ -432,6 +434,7 @@ void avfilter_draw_slice(AVFilterLink *link, int y, int h, int slice_dir)
     uint8_t *src[4], *dst[4];
     int i, j, vsub;
     void (*draw_slice)(AVFilterLink *, int, int, int);
+    uint64_t t;
 
     FF_DPRINTF_START(NULL, draw_slice); ff_dprintf_link(NULL, link, 0); dprintf(NULL, " y:%d h:%d dir:%d\n", y, h, slice_dir);
 
@@ -465,7 +468,11 @@ void avfilter_draw_slice(AVFilterLink *link, int y, int h, int slice_dir)
 
     if (!(draw_slice = link->dstpad->draw_slice))
         draw_slice = avfilter_default_draw_slice;
+    t = av_profile_start();
     draw_slice(link, y, h, slice_dir);
+    /* this includes the time spent in the next filters */
+    if (t)
+        av_profile_stop(av_profile_get_probe("draw_slice", link->dst->filter->name), t);
 }
 
 void avfilter_filter_samples(AVFilterLink *link, AVFilterBufferRef *samplesref)
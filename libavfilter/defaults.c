@@ -19,6 +19,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/slab.h"
 #include "libavcore/audioconvert.h"
 #include "libavcore/imgutils.h"
 #include "libavcore/samplefmt.h"
@@ -64,13 +65,13 @@ AVFilterBufferRef *avfilter_default_get_audio_buffer(AVFilterLink *link, int per
     int i, sample_size, chans_nb, bufsize, per_channel_size, step_size = 0;
     char *buf;
 
-    if (!samples || !(ref = av_mallocz(sizeof(AVFilterBufferRef))))
+    if (!samples || !(ref = ff_slab_mallocz(sizeof(AVFilterBufferRef))))
         goto fail;
 
     ref->buf                   = samples;
     ref->format                = sample_fmt;
 
-    ref->audio = av_mallocz(sizeof(AVFilterBufferRefAudioProps));
+    ref->audio = ff_slab_mallocz(sizeof(AVFilterBufferRefAudioProps));
     if (!ref->audio)
         goto fail;
 
@@ -127,8 +128,8 @@ AVFilterBufferRef *avfilter_default_get_audio_buffer(AVFilterLink *link, int per
 
 fail:
     if (ref && ref->audio)
-        av_free(ref->audio);
-    av_free(ref);
+        ff_slab_free(ref->audio);
+    ff_slab_free(ref);
     av_free(samples);
     return NULL;
 }
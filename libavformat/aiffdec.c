@@ -157,6 +157,12 @@ static unsigned int get_aiff_header(ByteIOContext *pb, AVCodecContext *codec,
     return num_frames;
 }
 
+static const AVProbeSignature aiff_signatures[] = {
+    { 0, 12, "FORM\0\0\0\0AIFF", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff" },
+    { 0, 12, "FORM\0\0\0\0AIFC", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff" },
+    { 0 }
+};
+
 static int aiff_probe(AVProbeData *p)
 {
     /* check file header */
@@ -321,4 +327,5 @@ AVInputFormat aiff_demuxer = {
     NULL,
     pcm_read_seek,
     .codec_tag= (const AVCodecTag* const []){ff_codec_aiff_tags, 0},
+    .signatures = aiff_signatures,
 };
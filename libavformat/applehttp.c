@@ -30,6 +30,17 @@
 #include "avformat.h"
 #include "internal.h"
 #include <unistd.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#include "network.h"
+#endif
+
+/* Number of segments fetched ahead of the current one for each variant */
+#define PREFETCH_SEGMENTS 2
+#define PREFETCH_THREADS  2
+#define MAX_PREFETCH     16
+
+#define INITIAL_BUFFER_SIZE 32768
 
 /*
  * An apple http stream consists of a playlist with media segment files,
@@ -48,6 +59,14 @@ struct segment {
     char url[MAX_URL_SIZE];
 };
 
+/*
+ * A file downloaded into memory, read through a ByteIOContext.
+ */
+struct prefetched_data {
+    uint8_t *buf;
+    int size, pos;
+};
+
 /*
  * Each variant has its own demuxer. If it currently is active,
  * it has an open ByteIOContext too, and potentially an AVPacket
@@ -57,6 +76,7 @@ struct variant {
     int bandwidth;
     char url[MAX_URL_SIZE];
     ByteIOContext *pb;
+    struct prefetched_data data; ///< segment data if pb reads from memory
     AVFormatContext *ctx;
     AVPacket pkt;
     int stream_offset;
@@ -67,6 +87,28 @@ struct variant {
     int needed;
 };
 
+enum PrefetchState {
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+    PREFETCH_FAILED,
+};
+
+/*
+ * A segment or playlist that is downloaded into memory by one of the
+ * prefetch threads, ahead of the point where the demuxer needs it.
+ */
+struct prefetch_item {
+    char url[MAX_URL_SIZE];
+    enum PrefetchState state;
+    int cancelled;
+    int serial;
+    int playlist;               ///< the data goes stale after target_duration
+    int64_t fetch_time;         ///< av_gettime() when the download finished
+    uint8_t *buf;
+    int size;
+};
+
 typedef struct AppleHTTPContext {
     int target_duration;
     int finished;
@@ -76,6 +118,16 @@ typedef struct AppleHTTPContext {
     int64_t last_load_time;
     int64_t last_packet_dts;
     int max_start_seq, min_end_seq;
+#if HAVE_PTHREADS
+    pthread_t threads[PREFETCH_THREADS];
+    int nb_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int abort_request;
+    URLContext *fetching[PREFETCH_THREADS]; ///< urls being downloaded
+    int serial;
+    struct prefetch_item *prefetch[MAX_PREFETCH];
+#endif
 } AppleHTTPContext;
 
 static int read_chomp_line(ByteIOContext *s, char *buf, int maxlen)
@@ -123,6 +175,34 @@ static void make_absolute_url(char *buf, int size, const char *base,
     av_strlcat(buf, rel, size);
 }
 
+static int read_prefetched(void *opaque, uint8_t *buf, int buf_size)
+{
+    struct prefetched_data *d = opaque;
+    int len = FFMIN(buf_size, d->size - d->pos);
+
+    memcpy(buf, d->buf + d->pos, len);
+    d->pos += len;
+    return len;
+}
+
+static void close_prefetched(ByteIOContext *pb, struct prefetched_data *d)
+{
+    av_free(pb->buffer);
+    av_free(pb);
+    av_freep(&d->buf);
+}
+
+static void close_segment(struct variant *var)
+{
+    if (var->data.buf) {
+        close_prefetched(var->pb, &var->data);
+        var->pb = NULL;
+    } else {
+        url_fclose(var->pb);
+        var->pb = NULL;
+    }
+}
+
 static void free_segment_list(struct variant *var)
 {
     int i;
@@ -140,7 +220,7 @@ static void free_variant_list(AppleHTTPContext *c)
         free_segment_list(var);
         av_free_packet(&var->pkt);
         if (var->pb)
-            url_fclose(var->pb);
+            close_segment(var);
         if (var->ctx) {
             var->ctx->pb = NULL;
             av_close_input_file(var->ctx);
@@ -174,6 +254,366 @@ static struct variant *new_variant(AppleHTTPContext *c, int bandwidth,
     return var;
 }
 
+#if HAVE_PTHREADS
+/*
+ * Register h as being downloaded, so that prefetch_uninit() can shut its
+ * connection down, or unregister it if reg is 0. Nothing is registered
+ * once the prefetching is being stopped.
+ * @return AVERROR(EINTR) if the prefetching is being stopped, 0 otherwise
+ */
+static int register_fetch(AppleHTTPContext *c, URLContext *h, int reg)
+{
+    int i, ret;
+
+    pthread_mutex_lock(&c->lock);
+    ret = c->abort_request ? AVERROR(EINTR) : 0;
+    if (!reg || !ret) {
+        /* there are never more downloads than threads */
+        for (i = 0; i < PREFETCH_THREADS; i++) {
+            if (c->fetching[i] == (reg ? NULL : h)) {
+                c->fetching[i] = reg ? h : NULL;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return ret;
+}
+#endif
+
+/*
+ * Download a whole URL into a newly allocated buffer.
+ */
+static int fetch_url(AppleHTTPContext *c, const char *url,
+                     uint8_t **bufp, int *sizep)
+{
+    URLContext *h;
+    uint8_t *buf = NULL, *tmp;
+    int ret, size = 0, alloc = 0;
+
+    if ((ret = url_open(&h, url, URL_RDONLY)) < 0)
+        return ret;
+#if HAVE_PTHREADS
+    if ((ret = register_fetch(c, h, 1)) < 0)
+        goto end;
+#endif
+    while (1) {
+#if HAVE_PTHREADS
+        int abort_request;
+
+        pthread_mutex_lock(&c->lock);
+        abort_request = c->abort_request;
+        pthread_mutex_unlock(&c->lock);
+        if (abort_request) {
+            ret = AVERROR(EINTR);
+            break;
+        }
+#endif
+        if (size == alloc) {
+            alloc = FFMAX(2 * alloc, 64 * 1024);
+            tmp = av_realloc(buf, alloc);
+            if (!tmp) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            buf = tmp;
+        }
+        ret = url_read(h, buf + size, alloc - size);
+        if (ret <= 0) {
+            if (ret == AVERROR_EOF)
+                ret = 0;
+            break;
+        }
+        size += ret;
+    }
+#if HAVE_PTHREADS
+    /* a read cut short by prefetch_uninit() looks like the end of file */
+    if (register_fetch(c, h, 0) < 0)
+        ret = AVERROR(EINTR);
+end:
+#endif
+    url_close(h);
+    if (ret < 0) {
+        av_free(buf);
+        return ret;
+    }
+    *bufp  = buf;
+    *sizep = size;
+    return 0;
+}
+
+#if HAVE_PTHREADS
+static void free_prefetch_item(struct prefetch_item *item)
+{
+    av_free(item->buf);
+    av_free(item);
+}
+
+static void *prefetch_thread(void *arg)
+{
+    AppleHTTPContext *c = arg;
+    struct prefetch_item *item;
+    uint8_t *buf = NULL;
+    int i, ret, size = 0;
+
+    /* c->lock is held everywhere in this loop except around fetch_url() */
+    pthread_mutex_lock(&c->lock);
+    while (!c->abort_request) {
+        item = NULL;
+        for (i = 0; i < MAX_PREFETCH; i++) {
+            if (c->prefetch[i] && c->prefetch[i]->state == PREFETCH_QUEUED) {
+                item = c->prefetch[i];
+                break;
+            }
+        }
+        if (!item) {
+            pthread_cond_wait(&c->cond, &c->lock);
+            continue;
+        }
+        item->state = PREFETCH_RUNNING;
+        pthread_mutex_unlock(&c->lock);
+
+        ret = fetch_url(c, item->url, &buf, &size);
+
+        pthread_mutex_lock(&c->lock);
+        if (item->cancelled) {
+            /* Already removed from the list while we were downloading */
+            if (ret >= 0)
+                av_free(buf);
+            av_free(item);
+            continue;
+        }
+        if (ret < 0) {
+            if (!c->abort_request)
+                av_log(NULL, AV_LOG_WARNING, "Unable to prefetch %s\n",
+                       item->url);
+            item->state = PREFETCH_FAILED;
+        } else {
+            item->buf        = buf;
+            item->size       = size;
+            item->state      = PREFETCH_DONE;
+            item->fetch_time = av_gettime();
+        }
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+static void remove_prefetch_item(AppleHTTPContext *c, int i)
+{
+    if (c->prefetch[i]->state == PREFETCH_RUNNING)
+        c->prefetch[i]->cancelled = 1;
+    else
+        free_prefetch_item(c->prefetch[i]);
+    c->prefetch[i] = NULL;
+}
+
+/*
+ * Find the item for a url. A downloaded live playlist older than
+ * target_duration is dropped instead, so that it gets fetched again.
+ */
+static int find_prefetch_item(AppleHTTPContext *c, const char *url)
+{
+    struct prefetch_item *item;
+    int i;
+
+    for (i = 0; i < MAX_PREFETCH; i++) {
+        item = c->prefetch[i];
+        if (!item || strcmp(item->url, url))
+            continue;
+        if (item->playlist && item->state == PREFETCH_DONE &&
+            av_gettime() - item->fetch_time >= c->target_duration * 1000000LL) {
+            remove_prefetch_item(c, i);
+            return -1;
+        }
+        return i;
+    }
+    return -1;
+}
+#endif
+
+/*
+ * Queue a url for download by the prefetch threads, unless it already
+ * is queued. If all slots are in use, the oldest finished download is
+ * dropped; if there is none, the request is ignored.
+ *
+ * @param playlist 1 if url is a playlist which is reloaded periodically
+ */
+static void prefetch_url(AppleHTTPContext *c, const char *url, int playlist)
+{
+#if HAVE_PTHREADS
+    struct prefetch_item *item;
+    int i, slot = -1, oldest = -1;
+
+    if (!c->nb_threads)
+        return;
+    pthread_mutex_lock(&c->lock);
+    if (find_prefetch_item(c, url) >= 0)
+        goto end;
+    for (i = 0; i < MAX_PREFETCH && slot < 0; i++) {
+        if (!c->prefetch[i])
+            slot = i;
+        else if (c->prefetch[i]->state >= PREFETCH_DONE &&
+                 (oldest < 0 ||
+                  c->prefetch[i]->serial < c->prefetch[oldest]->serial))
+            oldest = i;
+    }
+    if (slot < 0 && oldest >= 0) {
+        remove_prefetch_item(c, oldest);
+        slot = oldest;
+    }
+    if (slot < 0 || !(item = av_mallocz(sizeof(*item))))
+        goto end;
+    av_strlcpy(item->url, url, sizeof(item->url));
+    item->state    = PREFETCH_QUEUED;
+    item->serial   = c->serial++;
+    item->playlist = playlist;
+    c->prefetch[slot] = item;
+    pthread_cond_signal(&c->cond);
+end:
+    pthread_mutex_unlock(&c->lock);
+#endif
+}
+
+/*
+ * Check whether a playlist has been downloaded in the background. If it
+ * is neither queued nor downloaded recently, it is queued, and 0 is
+ * returned.
+ * Without prefetch threads, everything is always ready to be fetched
+ * synchronously.
+ */
+static int prefetch_ready(AppleHTTPContext *c, const char *url)
+{
+#if HAVE_PTHREADS
+    int i, ready = 0;
+
+    if (!c->nb_threads)
+        return 1;
+    pthread_mutex_lock(&c->lock);
+    i = find_prefetch_item(c, url);
+    if (i >= 0)
+        ready = c->prefetch[i]->state >= PREFETCH_DONE;
+    pthread_mutex_unlock(&c->lock);
+    if (i < 0)
+        prefetch_url(c, url, 1);
+    return ready;
+#else
+    return 1;
+#endif
+}
+
+/*
+ * Take the downloaded data for a url out of the prefetch list, waiting
+ * for the download to finish if it is in progress. A download that
+ * hasn't been started yet is dropped, since reading it directly is
+ * faster than waiting for the complete file, and so is a stale playlist.
+ *
+ * @return 0 and a ByteIOContext reading the data kept in d in *pb, or a
+ *         negative value if the url has to be opened directly
+ */
+static int open_prefetched(AppleHTTPContext *c, const char *url,
+                           ByteIOContext **pb, struct prefetched_data *d)
+{
+#if HAVE_PTHREADS
+    struct prefetch_item *item = NULL;
+    uint8_t *io_buf;
+    int i;
+
+    if (!c->nb_threads)
+        return AVERROR(ENOENT);
+    pthread_mutex_lock(&c->lock);
+    if ((i = find_prefetch_item(c, url)) >= 0) {
+        while (c->prefetch[i]->state == PREFETCH_RUNNING)
+            pthread_cond_wait(&c->cond, &c->lock);
+        if (c->prefetch[i]->state == PREFETCH_DONE)
+            item = c->prefetch[i];
+        else
+            remove_prefetch_item(c, i);
+        c->prefetch[i] = NULL;
+    }
+    pthread_mutex_unlock(&c->lock);
+    if (!item)
+        return AVERROR(ENOENT);
+    /* The data is copied out through a separate IO buffer, since the
+     * ByteIOContext may reallocate the buffer it is given. */
+    io_buf = av_malloc(INITIAL_BUFFER_SIZE);
+    *pb = io_buf ? av_alloc_put_byte(io_buf, INITIAL_BUFFER_SIZE, 0, d,
+                                     read_prefetched, NULL, NULL) : NULL;
+    if (!*pb) {
+        av_free(io_buf);
+        free_prefetch_item(item);
+        return AVERROR(ENOMEM);
+    }
+    (*pb)->is_streamed = 1;
+    d->buf  = item->buf;
+    d->size = item->size;
+    d->pos  = 0;
+    av_free(item);
+    return 0;
+#else
+    return AVERROR(ENOENT);
+#endif
+}
+
+static void prefetch_flush(AppleHTTPContext *c)
+{
+#if HAVE_PTHREADS
+    int i;
+
+    if (!c->nb_threads)
+        return;
+    pthread_mutex_lock(&c->lock);
+    for (i = 0; i < MAX_PREFETCH; i++)
+        if (c->prefetch[i])
+            remove_prefetch_item(c, i);
+    pthread_mutex_unlock(&c->lock);
+#endif
+}
+
+static void prefetch_init(AppleHTTPContext *c)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    for (c->nb_threads = 0; c->nb_threads < PREFETCH_THREADS; c->nb_threads++) {
+        if (pthread_create(&c->threads[c->nb_threads], NULL,
+                           prefetch_thread, c)) {
+            av_log(NULL, AV_LOG_WARNING, "Unable to start prefetch thread\n");
+            break;
+        }
+    }
+#endif
+}
+
+static void prefetch_uninit(AppleHTTPContext *c)
+{
+#if HAVE_PTHREADS
+    int i;
+
+    pthread_mutex_lock(&c->lock);
+    c->abort_request = 1;
+    pthread_cond_broadcast(&c->cond);
+    /* Unblock the threads waiting for data on a stalled connection. A
+     * thread still connecting is only stopped when the connection attempt
+     * ends. */
+    for (i = 0; i < PREFETCH_THREADS; i++) {
+        int fd = c->fetching[i] ? url_get_file_handle(c->fetching[i]) : -1;
+        if (fd >= 0)
+            shutdown(fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&c->lock);
+    for (i = 0; i < c->nb_threads; i++)
+        pthread_join(c->threads[i], NULL);
+    /* All threads are gone, so nothing is in the RUNNING state anymore */
+    for (i = 0; i < MAX_PREFETCH; i++)
+        if (c->prefetch[i])
+            free_prefetch_item(c->prefetch[i]);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->cond);
+#endif
+}
+
 struct variant_info {
     char bandwidth[20];
 };
@@ -274,6 +714,23 @@ fail:
     return ret;
 }
 
+/*
+ * Reload a variant playlist, using the copy downloaded in the background
+ * if there is one.
+ */
+static int reload_playlist(AppleHTTPContext *c, struct variant *var)
+{
+    ByteIOContext *in;
+    struct prefetched_data d;
+    int ret;
+
+    if (open_prefetched(c, var->url, &in, &d) < 0)
+        return parse_playlist(c, var->url, var, NULL);
+    ret = parse_playlist(c, var->url, var, in);
+    close_prefetched(in, &d);
+    return ret;
+}
+
 static int applehttp_read_header(AVFormatContext *s, AVFormatParameters *ap)
 {
     AppleHTTPContext *c = s->priv_data;
@@ -346,6 +803,7 @@ static int applehttp_read_header(AVFormatContext *s, AVFormatParameters *ap)
     if (!c->finished && c->min_end_seq - c->max_start_seq > 3)
         c->cur_seq_no = c->min_end_seq - 2;
 
+    prefetch_init(c);
     return 0;
 fail:
     free_variant_list(c);
@@ -354,7 +812,7 @@ fail:
 
 static int open_variant(AppleHTTPContext *c, struct variant *var, int skip)
 {
-    int ret;
+    int ret, i, idx = c->cur_seq_no - var->start_seq_no;
 
     if (c->cur_seq_no < var->start_seq_no) {
         av_log(NULL, AV_LOG_WARNING,
@@ -362,14 +820,18 @@ static int open_variant(AppleHTTPContext *c, struct variant *var, int skip)
                var->start_seq_no, var->url);
         return 0;
     }
-    if (c->cur_seq_no - var->start_seq_no >= var->n_segments)
+    if (idx >= var->n_segments)
         return c->finished ? AVERROR_EOF : 0;
-    ret = url_fopen(&var->pb,
-                    var->segments[c->cur_seq_no - var->start_seq_no]->url,
-                    URL_RDONLY);
-    if (ret < 0)
-        return ret;
+    if (open_prefetched(c, var->segments[idx]->url,
+                        &var->pb, &var->data) < 0) {
+        ret = url_fopen(&var->pb, var->segments[idx]->url, URL_RDONLY);
+        if (ret < 0)
+            return ret;
+    }
     var->ctx->pb = var->pb;
+    /* Start downloading the following segments while this one is read */
+    for (i = 1; i <= PREFETCH_SEGMENTS && idx + i < var->n_segments; i++)
+        prefetch_url(c, var->segments[idx + i]->url, 0);
     /* If this is a new segment in parallel with another one already opened,
      * skip ahead so they're all at the same dts. */
     if (skip && c->last_packet_dts != AV_NOPTS_VALUE) {
@@ -421,8 +883,7 @@ start:
                    "Closing variant stream %d, no longer needed\n", i);
             av_free_packet(&var->pkt);
             reset_packet(&var->pkt);
-            url_fclose(var->pb);
-            var->pb = NULL;
+            close_segment(var);
             changed = 1;
         } else if (!var->pb && var->needed) {
             if (first)
@@ -470,8 +931,7 @@ start:
     for (i = 0; i < c->n_variants; i++) {
         struct variant *var = c->variants[i];
         if (var->pb) {
-            url_fclose(var->pb);
-            var->pb = NULL;
+            close_segment(var);
         }
     }
     /* Indicate that we're opening the next segment, not opening a new
@@ -483,13 +943,23 @@ reload:
         /* If this is a live stream and target_duration has elapsed since
          * the last playlist reload, reload the variant playlists now. */
         int64_t now = av_gettime();
+        int ready = 1;
+        /* The playlists are downloaded in the background, and the reload
+         * is postponed until they have arrived, as long as there still are
+         * known segments left to play. */
         if (now - c->last_load_time >= c->target_duration*1000000) {
+            for (i = 0; i < c->n_variants; i++)
+                if (c->variants[i]->needed)
+                    ready &= prefetch_ready(c, c->variants[i]->url);
+        }
+        if (now - c->last_load_time >= c->target_duration*1000000 &&
+            (ready || c->cur_seq_no >= c->min_end_seq)) {
             c->max_start_seq = 0;
             c->min_end_seq   = INT_MAX;
             for (i = 0; i < c->n_variants; i++) {
                 struct variant *var = c->variants[i];
                 if (var->needed) {
-                    if ((ret = parse_playlist(c, var->url, var, NULL)) < 0)
+                    if ((ret = reload_playlist(c, var)) < 0)
                         return ret;
                     c->max_start_seq = FFMAX(c->max_start_seq,
                                              var->start_seq_no);
@@ -525,6 +995,7 @@ static int applehttp_close(AVFormatContext *s)
 {
     AppleHTTPContext *c = s->priv_data;
 
+    prefetch_uninit(c);
     free_variant_list(c);
     return 0;
 }
@@ -544,12 +1015,12 @@ static int applehttp_read_seek(AVFormatContext *s, int stream_index,
     for (i = 0; i < c->n_variants; i++) {
         struct variant *var = c->variants[i];
         if (var->pb) {
-            url_fclose(var->pb);
-            var->pb = NULL;
+            close_segment(var);
         }
         av_free_packet(&var->pkt);
         reset_packet(&var->pkt);
     }
+    prefetch_flush(c);
 
     timestamp = av_rescale_rnd(timestamp, 1, stream_index >= 0 ?
                                s->streams[stream_index]->time_base.den :
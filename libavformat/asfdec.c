@@ -136,6 +136,12 @@ static void get_str16_nolen(ByteIOContext *pb, int len, char *buf, int buf_size)
     *q = '\0';
 }
 
+/* ff_asf_header */
+static const AVProbeSignature asf_signatures[] = {
+    { 0, 16, "\x30\x26\xB2\x75\x8E\x66\xCF\x11\xA6\xD9\x00\xAA\x00\x62\xCE\x6C" },
+    { 0 }
+};
+
 static int asf_probe(AVProbeData *pd)
 {
     /* check file header */
@@ -1266,4 +1272,5 @@ AVInputFormat asf_demuxer = {
     asf_read_close,
     asf_read_seek,
     asf_read_pts,
+    .signatures = asf_signatures,
 };
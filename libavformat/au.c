@@ -105,6 +105,11 @@ static int au_write_trailer(AVFormatContext *s)
 }
 #endif /* CONFIG_AU_MUXER */
 
+static const AVProbeSignature au_signatures[] = {
+    { 0, 4, ".snd" },
+    { 0 }
+};
+
 static int au_probe(AVProbeData *p)
 {
     /* check file header */
@@ -193,6 +198,7 @@ AVInputFormat au_demuxer = {
     NULL,
     pcm_read_seek,
     .codec_tag= (const AVCodecTag* const []){codec_au_tags, 0},
+    .signatures = au_signatures,
 };
 #endif
 
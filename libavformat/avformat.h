@@ -22,7 +22,7 @@
 #define AVFORMAT_AVFORMAT_H
 
 #define LIBAVFORMAT_VERSION_MAJOR 52
-#define LIBAVFORMAT_VERSION_MINOR 93
+#define LIBAVFORMAT_VERSION_MINOR 98
 #define LIBAVFORMAT_VERSION_MICRO  0
 
 #define LIBAVFORMAT_VERSION_INT AV_VERSION_INT(LIBAVFORMAT_VERSION_MAJOR, \
@@ -299,6 +299,27 @@ typedef struct AVProbeData {
 #define AVPROBE_SCORE_MAX 100               ///< maximum score, half of that is used for file-extension-based detection
 #define AVPROBE_PADDING_SIZE 32             ///< extra allocated bytes at the end of the probe buffer
 
+/**
+ * A byte pattern identifying a format, see AVInputFormat.signatures.
+ */
+typedef struct AVProbeSignature {
+    int offset;         ///< position of the pattern in the probe buffer
+    int size;           ///< length of the pattern in bytes
+    const char *bytes;  ///< expected bytes, only the bits set in mask are compared
+    const char *mask;   ///< bits to compare in each byte, NULL to compare all bits
+} AVProbeSignature;
+
+/**
+ * Statistics about the probing of the input format of a file.
+ */
+typedef struct AVProbeStats {
+    int nb_rounds;              ///< number of probe buffers which were tried
+    int nb_read_probe;          ///< number of read_probe() calls
+    int nb_signature_matches;   ///< number of rounds decided by a signature
+    int probe_size;             ///< size of the last probe buffer in bytes
+    int64_t time;               ///< time spent probing in microseconds
+} AVProbeStats;
+
 typedef struct AVFormatParameters {
     AVRational time_base;
     int sample_rate;
@@ -498,6 +519,15 @@ typedef struct AVInputFormat {
     const AVMetadataConv *metadata_conv;
 #endif
 
+    /**
+     * Byte patterns identifying the format, terminated by an entry with a
+     * size of 0. A probe buffer matching one of them is detected as this
+     * format with AVPROBE_SCORE_MAX without calling any read_probe(), so a
+     * signature must only match data no other demuxer would claim and for
+     * which read_probe() returns AVPROBE_SCORE_MAX.
+     */
+    const AVProbeSignature *signatures;
+
     /* private fields */
     struct AVInputFormat *next;
 } AVInputFormat;
@@ -925,6 +955,21 @@ typedef struct AVFormatContext {
      * - decoding: Unused.
      */
     int64_t start_time_realtime;
+
+    /**
+     * Statistics about the probing of the input format.
+     * - encoding: unused
+     * - decoding: Set by av_open_input_file() if it probed the format.
+     */
+    AVProbeStats probe_stats;
+
+    /**
+     * Maximum wall clock time in microseconds av_find_stream_info() may
+     * spend reading and decoding packets, 0 for no limit.
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    int max_analyze_time;
 } AVFormatContext;
 
 typedef struct AVPacketList {
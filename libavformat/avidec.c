@@ -81,6 +81,17 @@ static const char avi_headers[][8] = {
     { 0 }
 };
 
+#define RIFF_MASK "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff"
+/* the same as avi_headers, the file size is not compared */
+static const AVProbeSignature avi_signatures[] = {
+    { 0, 12, "RIFF\0\0\0\0AVI ",   RIFF_MASK },
+    { 0, 12, "RIFF\0\0\0\0AVIX",   RIFF_MASK },
+    { 0, 12, "RIFF\0\0\0\0AVI\x19", RIFF_MASK },
+    { 0, 12, "ON2 \0\0\0\0ON2f",   RIFF_MASK },
+    { 0, 12, "RIFF\0\0\0\0AMV ",   RIFF_MASK },
+    { 0 }
+};
+
 static int avi_load_index(AVFormatContext *s);
 static int guess_ni_flag(AVFormatContext *s);
 
@@ -1389,4 +1400,5 @@ AVInputFormat avi_demuxer = {
     avi_read_packet,
     avi_read_close,
     avi_read_seek,
+    .signatures = avi_signatures,
 };
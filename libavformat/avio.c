@@ -26,6 +26,7 @@
 #include "libavutil/opt.h"
 #include "os_support.h"
 #include "avformat.h"
+#include "internal.h"
 #if CONFIG_NETWORK
 #include "network.h"
 #endif
@@ -255,6 +256,28 @@ int url_write(URLContext *h, const unsigned char *buf, int size)
     return retry_transfer_wrapper(h, buf, size, h->prot->url_write);
 }
 
+int ff_url_write_batch(URLContext *h, const uint8_t * const *bufs,
+                       const int *sizes, int nb)
+{
+    int i, ret;
+
+    if (!(h->flags & (URL_WRONLY | URL_RDWR)))
+        return AVERROR(EIO);
+    for (i = 0; i < nb; i++)
+        if (h->max_packet_size && sizes[i] > h->max_packet_size)
+            return AVERROR(EIO);
+
+    if (h->prot->url_write_batch)
+        return h->prot->url_write_batch(h, bufs, sizes, nb);
+
+    for (i = 0; i < nb; i++) {
+        ret = url_write(h, bufs[i], sizes[i]);
+        if (ret < 0)
+            return i ? i : ret;
+    }
+    return nb;
+}
+
 int64_t url_seek(URLContext *h, int64_t pos, int whence)
 {
     int64_t ret;
@@ -271,6 +271,13 @@ typedef struct URLProtocol {
     int (*url_get_file_handle)(URLContext *h);
     int priv_data_size;
     const AVClass *priv_data_class;
+    /**
+     * Write nb packets at once, each as if written by its own url_write()
+     * call. Optional, for packet based protocols.
+     * @return the number of packets written, or a negative error code
+     */
+    int (*url_write_batch)(URLContext *h, const uint8_t * const *bufs,
+                           const int *sizes, int nb);
 } URLProtocol;
 
 #if FF_API_REGISTER_PROTOCOL
@@ -333,6 +340,13 @@ typedef struct {
     int (*read_pause)(void *opaque, int pause);
     int64_t (*read_seek)(void *opaque, int stream_index,
                          int64_t timestamp, int flags);
+    /**
+     * Write several packets at once, set if the underlying protocol
+     * supports it. Returns the number of packets written or a negative
+     * error code.
+     */
+    int (*write_packets)(void *opaque, const uint8_t * const *bufs,
+                         const int *sizes, int nb);
 } ByteIOContext;
 
 int init_put_byte(ByteIOContext *s,
@@ -70,6 +70,7 @@ int init_put_byte(ByteIOContext *s,
     }
     s->read_pause = NULL;
     s->read_seek  = NULL;
+    s->write_packets = NULL;
     return 0;
 }
 
@@ -148,6 +149,32 @@ void put_flush_packet(ByteIOContext *s)
     s->must_flush = 0;
 }
 
+void ff_put_packets(ByteIOContext *s, const uint8_t * const *bufs,
+                    const int *sizes, int nb)
+{
+    int i, ret;
+
+    flush_buffer(s);
+    s->must_flush = 0;
+    i = 0;
+    if (s->write_packets && !s->update_checksum) {
+        if (s->error)
+            return;
+        ret = s->write_packets(s->opaque, bufs, sizes, nb);
+        if (ret < 0) {
+            s->error = ret;
+            return;
+        }
+        for (i = 0; i < ret; i++)
+            s->pos += sizes[i];
+        /* write whatever the batch left over one packet at a time */
+    }
+    for (; i < nb; i++) {
+        put_buffer(s, bufs[i], sizes[i]);
+        put_flush_packet(s);
+    }
+}
+
 int64_t url_fseek(ByteIOContext *s, int64_t offset, int whence)
 {
     int64_t offset1;
@@ -627,6 +654,8 @@ int url_fdopen(ByteIOContext **s, URLContext *h)
     if(h->prot) {
         (*s)->read_pause = (int (*)(void *, int))h->prot->url_read_pause;
         (*s)->read_seek  = (int64_t (*)(void *, int, int64_t, int))h->prot->url_read_seek;
+        if (h->prot->url_write_batch)
+            (*s)->write_packets = (int (*)(void *, const uint8_t * const *, const int *, int))ff_url_write_batch;
     }
     return 0;
 }
@@ -114,6 +114,11 @@ static int flac_read_header(AVFormatContext *s,
     return 0;
 }
 
+static const AVProbeSignature flac_signatures[] = {
+    { 0, 4, "fLaC" },
+    { 0 }
+};
+
 static int flac_probe(AVProbeData *p)
 {
     uint8_t *bufptr = p->buf;
@@ -133,4 +138,5 @@ AVInputFormat flac_demuxer = {
     .flags= AVFMT_GENERIC_INDEX,
     .extensions = "flac",
     .value = CODEC_ID_FLAC,
+    .signatures = flac_signatures,
 };
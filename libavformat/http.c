@@ -29,6 +29,13 @@
 #include "os_support.h"
 #include "httpauth.h"
 #include "libavutil/opt.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#if HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#include <sys/time.h>
 
 /* XXX: POST protocol is not completely implemented because ffmpeg uses
    only a subset of it. */
@@ -36,6 +43,8 @@
 /* used for protocol handling */
 #define BUFFER_SIZE 1024
 #define MAX_REDIRECTS 8
+/** largest unread response body that is skipped to reuse the connection */
+#define MAX_DRAIN_SIZE (64 * 1024)
 
 typedef struct {
     const AVClass *class;
@@ -49,11 +58,17 @@ typedef struct {
     HTTPAuthState auth_state;
     unsigned char headers[BUFFER_SIZE];
     int willclose;          /**< Set if the server correctly handles Connection: close and will close the connection after feeding us the content. */
+    int multiple_requests;  /**< Ask for persistent connections and reuse them for seeks and later requests. */
+    int keep_alive;         /**< Set if the server keeps the connection open after the current response. */
+    char cnx_url[1024];     /**< URL of the lower level connection hd, used to match reusable connections. */
+    uint8_t *drained;       /**< Rest of the response, read to reuse the connection for a seek that then failed. */
+    int drained_size, drained_pos;
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
 static const AVOption options[] = {
 {"chunksize", "use chunked transfer-encoding for posts, -1 disables it, 0 enables it", OFFSET(chunksize), FF_OPT_TYPE_INT64, 0, -1, 0 }, /* Default to 0, for chunked POSTs */
+{"multiple_requests", "use persistent connections, 0 disables it", OFFSET(multiple_requests), FF_OPT_TYPE_INT, 1, 0, 1 },
 {NULL}
 };
 static const AVClass httpcontext_class = {
@@ -85,6 +100,146 @@ void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
            &((HTTPContext*)src->priv_data)->auth_state, sizeof(HTTPAuthState));
 }
 
+/**
+ * Idle persistent connections, kept after http_close() so that following
+ * requests to the same server, such as the segments of an HTTP live
+ * stream, skip the TCP handshake.
+ */
+#define POOL_SIZE 4
+#define POOL_MAX_IDLE 5000000 /* in microseconds */
+
+#if HAVE_PTHREADS
+static struct {
+    URLContext *hd;
+    char cnx_url[1024];
+    int64_t time;
+} pool[POOL_SIZE];
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void pool_free(void)
+{
+    int i;
+
+    pthread_mutex_lock(&pool_lock);
+    for (i = 0; i < POOL_SIZE; i++) {
+        url_close(pool[i].hd);
+        pool[i].hd = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void pool_init(void)
+{
+    atexit(pool_free);
+}
+#endif
+
+/**
+ * Check that an idle connection has not been closed by the server, in
+ * which case it would be readable.
+ */
+static int cnx_is_alive(URLContext *hd)
+{
+    int fd = url_get_file_handle(hd);
+    fd_set rfds;
+    struct timeval tv = { 0, 0 };
+
+    if (fd < 0)
+        return 0;
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    return select(fd + 1, &rfds, NULL, NULL, &tv) == 0;
+}
+
+static URLContext *pool_get(const char *cnx_url)
+{
+    URLContext *hd = NULL;
+#if HAVE_PTHREADS
+    int64_t now = av_gettime();
+    int i;
+
+    pthread_mutex_lock(&pool_lock);
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (!pool[i].hd)
+            continue;
+        if (now - pool[i].time > POOL_MAX_IDLE || !cnx_is_alive(pool[i].hd)) {
+            url_close(pool[i].hd);
+            pool[i].hd = NULL;
+        } else if (!hd && !strcmp(pool[i].cnx_url, cnx_url)) {
+            hd = pool[i].hd;
+            pool[i].hd = NULL;
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+#endif
+    return hd;
+}
+
+static void pool_put(const char *cnx_url, URLContext *hd)
+{
+#if HAVE_PTHREADS
+    int i, slot = 0;
+
+    pthread_once(&pool_once, pool_init);
+    pthread_mutex_lock(&pool_lock);
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (!pool[i].hd) {
+            slot = i;
+            break;
+        }
+        if (pool[i].time < pool[slot].time)
+            slot = i;
+    }
+    if (pool[slot].hd)
+        url_close(pool[slot].hd);
+    pool[slot].hd   = hd;
+    pool[slot].time = av_gettime();
+    av_strlcpy(pool[slot].cnx_url, cnx_url, sizeof(pool[slot].cnx_url));
+    pthread_mutex_unlock(&pool_lock);
+#else
+    url_close(hd);
+#endif
+}
+
+static int http_read(URLContext *h, uint8_t *buf, int size);
+
+/**
+ * Skip the rest of the current response so that the connection can
+ * carry another request.
+ * @param rest if not NULL, set to a buffer holding the skipped data, of
+ *             the size the rest of the response had, to be av_free()d
+ * @return 0 if the connection is idle and can be reused, <0 otherwise
+ */
+static int http_drain(URLContext *h, uint8_t **rest)
+{
+    HTTPContext *s = h->priv_data;
+    uint8_t buf[BUFFER_SIZE], *dst = NULL;
+    int len, pos = 0;
+
+    if (!s->hd || !s->multiple_requests || !s->keep_alive ||
+        (h->flags & URL_WRONLY) || s->chunksize >= 0 || s->filesize < 0 ||
+        s->filesize - s->off > MAX_DRAIN_SIZE)
+        return -1;
+    if (rest && !(dst = av_malloc(FFMAX(s->filesize - s->off, 1))))
+        return AVERROR(ENOMEM);
+    while (s->off < s->filesize) {
+        len = FFMIN(sizeof(buf), s->filesize - s->off);
+        len = http_read(h, dst ? dst + pos : buf, len);
+        if (len <= 0)
+            goto fail;
+        pos += len;
+    }
+    if (s->buf_ptr != s->buf_end)
+        goto fail;
+    if (rest)
+        *rest = dst;
+    return 0;
+fail:
+    av_free(dst);
+    return -1;
+}
+
 /* return non zero if error */
 static int http_open_cnx(URLContext *h)
 {
@@ -93,10 +248,10 @@ static int http_open_cnx(URLContext *h)
     char auth[1024];
     char path1[1024];
     char buf[1024];
-    int port, use_proxy, err, location_changed = 0, redirects = 0;
+    int port, use_proxy, err, location_changed = 0, redirects = 0, reused;
     HTTPAuthType cur_auth_type;
     HTTPContext *s = h->priv_data;
-    URLContext *hd = NULL;
+    URLContext *hd = s->hd;
 
     proxy_path = getenv("http_proxy");
     use_proxy = (proxy_path != NULL) && !getenv("no_proxy") &&
@@ -123,17 +278,37 @@ static int http_open_cnx(URLContext *h)
         port = 80;
 
     ff_url_join(buf, sizeof(buf), "tcp", NULL, hostname, port, NULL);
-    err = url_open(&hd, buf, URL_RDWR);
-    if (err < 0)
-        goto fail;
+    /* a connection still open here is idle and can carry this request,
+     * if it goes to the same server */
+    if (hd && strcmp(buf, s->cnx_url)) {
+        url_close(hd);
+        hd = NULL;
+    }
+    if (!hd && s->multiple_requests)
+        hd = pool_get(buf);
+    reused = !!hd;
+    if (!hd) {
+        err = url_open(&hd, buf, URL_RDWR);
+        if (err < 0)
+            goto fail;
+    }
 
     s->hd = hd;
+    av_strlcpy(s->cnx_url, buf, sizeof(s->cnx_url));
     cur_auth_type = s->auth_state.auth_type;
-    if (http_connect(h, path, hoststr, auth, &location_changed) < 0)
+    if (http_connect(h, path, hoststr, auth, &location_changed) < 0) {
+        if (reused) {
+            /* the server may have closed the idle connection meanwhile */
+            url_close(hd);
+            s->hd = hd = NULL;
+            goto redo;
+        }
         goto fail;
+    }
     if (s->http_code == 401) {
         if (cur_auth_type == HTTP_AUTH_NONE && s->auth_state.auth_type != HTTP_AUTH_NONE) {
             url_close(hd);
+            s->hd = hd = NULL;
             goto redo;
         } else
             goto fail;
@@ -142,6 +317,7 @@ static int http_open_cnx(URLContext *h)
         && location_changed == 1) {
         /* url moved, get next */
         url_close(hd);
+        s->hd = hd = NULL;
         if (redirects++ >= MAX_REDIRECTS)
             return AVERROR(EIO);
         location_changed = 0;
@@ -219,6 +395,8 @@ static int process_line(URLContext *h, char *line, int line_count,
 
     p = line;
     if (line_count == 0) {
+        /* HTTP/1.1 connections are persistent unless stated otherwise */
+        s->keep_alive = !strncmp(line, "HTTP/1.1", 8);
         while (!isspace(*p) && *p != '\0')
             p++;
         while (isspace(*p))
@@ -269,8 +447,12 @@ static int process_line(URLContext *h, char *line, int line_count,
         } else if (!strcmp (tag, "Authentication-Info")) {
             ff_http_auth_handle_header(&s->auth_state, tag, p);
         } else if (!strcmp (tag, "Connection")) {
-            if (!strcmp(p, "close"))
+            if (!strcmp(p, "close")) {
                 s->willclose = 1;
+                s->keep_alive = 0;
+            } else if (!strcasecmp(p, "keep-alive")) {
+                s->keep_alive = 1;
+            }
         }
     }
     return 1;
@@ -310,7 +492,8 @@ static int http_connect(URLContext *h, const char *path, const char *hoststr,
         len += av_strlcatf(headers + len, sizeof(headers) - len,
                            "Range: bytes=%"PRId64"-\r\n", s->off);
     if (!has_header(s->headers, "\r\nConnection: "))
-        len += av_strlcpy(headers + len, "Connection: close\r\n",
+        len += av_strlcpy(headers + len, s->multiple_requests && !post ?
+                          "Connection: keep-alive\r\n" : "Connection: close\r\n",
                           sizeof(headers)-len);
     if (!has_header(s->headers, "\r\nHost: "))
         len += av_strlcatf(headers + len, sizeof(headers) - len,
@@ -342,6 +525,7 @@ static int http_connect(URLContext *h, const char *path, const char *hoststr,
     s->off = 0;
     s->filesize = -1;
     s->willclose = 0;
+    s->keep_alive = 0;
     if (post) {
         /* Pretend that it did work. We didn't read any header yet, since
          * we've still to send the POST data, but the code calling this
@@ -375,6 +559,15 @@ static int http_read(URLContext *h, uint8_t *buf, int size)
     HTTPContext *s = h->priv_data;
     int len;
 
+    if (s->drained) {
+        len = FFMIN(size, s->drained_size - s->drained_pos);
+        memcpy(buf, s->drained + s->drained_pos, len);
+        s->drained_pos += len;
+        s->off         += len;
+        return len;
+    }
+    if (!s->hd)
+        return AVERROR(EIO);
     if (s->chunksize >= 0) {
         if (!s->chunksize) {
             char line[32];
@@ -455,8 +648,13 @@ static int http_close(URLContext *h)
         ret = ret > 0 ? 0 : ret;
     }
 
-    if (s->hd)
-        url_close(s->hd);
+    if (s->hd) {
+        if (http_drain(h, NULL) < 0)
+            url_close(s->hd);
+        else
+            pool_put(s->cnx_url, s->hd);
+    }
+    av_freep(&s->drained);
     return ret;
 }
 
@@ -465,22 +663,40 @@ static int64_t http_seek(URLContext *h, int64_t off, int whence)
     HTTPContext *s = h->priv_data;
     URLContext *old_hd = s->hd;
     int64_t old_off = s->off;
-    uint8_t old_buf[BUFFER_SIZE];
-    int old_buf_size;
+    uint8_t old_buf[BUFFER_SIZE], *rest = NULL;
+    int old_buf_size, rest_size;
 
     if (whence == AVSEEK_SIZE)
         return s->filesize;
     else if ((s->filesize == -1 && whence == SEEK_END) || h->is_streamed)
         return -1;
 
-    /* we save the old context in case the seek fails */
-    old_buf_size = s->buf_end - s->buf_ptr;
-    memcpy(old_buf, s->buf_ptr, old_buf_size);
-    s->hd = NULL;
     if (whence == SEEK_CUR)
         off += s->off;
     else if (whence == SEEK_END)
         off += s->filesize;
+
+    rest_size = s->filesize - s->off;
+    if (http_drain(h, &rest) == 0) {
+        /* send the range request on the same connection */
+        s->off = off;
+        if (http_open_cnx(h) < 0) {
+            /* the old connection is gone, but the drain read the rest of
+             * its response, so continue reading from there */
+            s->drained      = rest;
+            s->drained_size = rest_size;
+            s->drained_pos  = 0;
+            s->off          = old_off;
+            return -1;
+        }
+        av_free(rest);
+        return off;
+    }
+
+    /* we save the old context in case the seek fails */
+    old_buf_size = s->buf_end - s->buf_ptr;
+    memcpy(old_buf, s->buf_ptr, old_buf_size);
+    s->hd = NULL;
     s->off = off;
 
     /* if it fails, continue on old connection */
@@ -493,6 +709,7 @@ static int64_t http_seek(URLContext *h, int64_t off, int whence)
         return -1;
     }
     url_close(old_hd);
+    av_freep(&s->drained);
     return off;
 }
 
@@ -500,6 +717,8 @@ static int
 http_get_file_handle(URLContext *h)
 {
     HTTPContext *s = h->priv_data;
+    if (!s->hd)
+        return -1;
     return url_get_file_handle(s->hd);
 }
 
@@ -76,6 +76,25 @@ void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
 
 void ff_read_frame_flush(AVFormatContext *s);
 
+/**
+ * Write several packets to a packet based URLContext, using the
+ * protocol's url_write_batch() if available, one url_write() per packet
+ * otherwise.
+ * @return the number of packets written, or a negative error code
+ */
+int ff_url_write_batch(URLContext *h, const uint8_t * const *bufs,
+                       const int *sizes, int nb);
+
+/**
+ * Write several packets to a packetized ByteIOContext (max_packet_size
+ * set), as if each were written with put_buffer() and put_flush_packet().
+ * If the protocol the context writes to supports it, the packets are
+ * passed on in a single write_packets() call; packets the batch did not
+ * write are written one at a time.
+ */
+void ff_put_packets(ByteIOContext *s, const uint8_t * const *bufs,
+                    const int *sizes, int nb);
+
 #define NTP_OFFSET 2208988800ULL
 #define NTP_OFFSET_US (NTP_OFFSET * 1000000ULL)
 
@@ -94,12 +113,14 @@ uint64_t ff_ntp_time(void);
  * @param logctx the log context
  * @param offset the offset within the bytestream to probe from
  * @param max_probe_size the maximum probe buffer size (zero for default)
+ * @param stats if not NULL, the probing statistics are accumulated here
  * @return 0 in case of success, a negative value corresponding to an
  * AVERROR code otherwise
  */
 int ff_probe_input_buffer(ByteIOContext **pb, AVInputFormat **fmt,
                           const char *filename, void *logctx,
-                          unsigned int offset, unsigned int max_probe_size);
+                          unsigned int offset, unsigned int max_probe_size,
+                          AVProbeStats *stats);
 
 #if FF_API_URL_SPLIT
 /**
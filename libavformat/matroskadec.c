@@ -237,6 +237,9 @@ typedef struct {
 
     int done;
 
+    /* seekhead entry of the cues, plus one, if they have not been read yet */
+    int cues_parsing_deferred;
+
     /* What to skip before effectively reading a packet. */
     int skip_to_keyframe;
     uint64_t skip_to_timecode;
@@ -690,28 +693,28 @@ static int ebml_read_master(MatroskaDemuxContext *matroska, uint64_t length)
 }
 
 /*
- * Read signed/unsigned "EBML" numbers.
+ * Read signed/unsigned "EBML" numbers, not reading more than size bytes.
  * Return: number of bytes processed, < 0 on error
  */
 static int matroska_ebmlnum_uint(MatroskaDemuxContext *matroska,
-                                 uint8_t *data, uint32_t size, uint64_t *num)
+                                 ByteIOContext *pb, uint32_t size, uint64_t *num)
 {
-    ByteIOContext pb;
-    init_put_byte(&pb, data, size, 0, NULL, NULL, NULL, NULL);
-    return ebml_read_num(matroska, &pb, FFMIN(size, 8), num);
+    if (!size)
+        return AVERROR_INVALIDDATA;
+    return ebml_read_num(matroska, pb, FFMIN(size, 8), num);
 }
 
 /*
  * Same as above, but signed.
  */
 static int matroska_ebmlnum_sint(MatroskaDemuxContext *matroska,
-                                 uint8_t *data, uint32_t size, int64_t *num)
+                                 ByteIOContext *pb, uint32_t size, int64_t *num)
 {
     uint64_t unum;
     int res;
 
     /* read as unsigned number first */
-    if ((res = matroska_ebmlnum_uint(matroska, data, size, &unum)) < 0)
+    if ((res = matroska_ebmlnum_uint(matroska, pb, size, &unum)) < 0)
         return res;
 
     /* make signed (weird way) */
@@ -1088,6 +1091,48 @@ static void matroska_convert_tags(AVFormatContext *s)
     }
 }
 
+/*
+ * Parse the element a seekhead entry points to. The caller has to restore
+ * the position and the parser state afterwards.
+ * Return: < 0 if no more entries can be parsed
+ */
+static int matroska_parse_seekhead_entry(MatroskaDemuxContext *matroska, int idx)
+{
+    EbmlList *seekhead_list = &matroska->seekhead;
+    MatroskaSeekhead *seekhead = seekhead_list->elem;
+    int64_t offset = seekhead[idx].pos + matroska->segment_start;
+    MatroskaLevel level;
+
+    /* seek */
+    if (url_fseek(matroska->ctx->pb, offset, SEEK_SET) != offset)
+        return 0;
+
+    /* We don't want to lose our seekhead level, so we add
+     * a dummy. This is a crude hack. */
+    if (matroska->num_levels == EBML_MAX_DEPTH) {
+        av_log(matroska->ctx, AV_LOG_INFO,
+               "Max EBML element depth (%d) reached, "
+               "cannot parse further.\n", EBML_MAX_DEPTH);
+        return AVERROR_INVALIDDATA;
+    }
+
+    level.start = 0;
+    level.length = (uint64_t)-1;
+    matroska->levels[matroska->num_levels] = level;
+    matroska->num_levels++;
+    matroska->current_id = 0;
+
+    ebml_parse(matroska, matroska_segment, matroska);
+
+    /* remove dummy level */
+    while (matroska->num_levels) {
+        uint64_t length = matroska->levels[--matroska->num_levels].length;
+        if (length == (uint64_t)-1)
+            break;
+    }
+    return 0;
+}
+
 static void matroska_execute_seekhead(MatroskaDemuxContext *matroska)
 {
     EbmlList *seekhead_list = &matroska->seekhead;
@@ -1095,7 +1140,6 @@ static void matroska_execute_seekhead(MatroskaDemuxContext *matroska)
     uint32_t level_up = matroska->level_up;
     int64_t before_pos = url_ftell(matroska->ctx->pb);
     uint32_t saved_id = matroska->current_id;
-    MatroskaLevel level;
     int i;
 
     // we should not do any seeking in the streaming case
@@ -1104,46 +1148,76 @@ static void matroska_execute_seekhead(MatroskaDemuxContext *matroska)
         return;
 
     for (i=0; i<seekhead_list->nb_elem; i++) {
-        int64_t offset = seekhead[i].pos + matroska->segment_start;
-
         if (seekhead[i].pos <= before_pos
             || seekhead[i].id == MATROSKA_ID_SEEKHEAD
             || seekhead[i].id == MATROSKA_ID_CLUSTER)
             continue;
 
-        /* seek */
-        if (url_fseek(matroska->ctx->pb, offset, SEEK_SET) != offset)
+        /* The cues are usually at the end of the file and only needed for
+         * seeking, so they are only read on the first seek. */
+        if (seekhead[i].id == MATROSKA_ID_CUES && !matroska->index.nb_elem) {
+            matroska->cues_parsing_deferred = i + 1;
             continue;
+        }
 
-        /* We don't want to lose our seekhead level, so we add
-         * a dummy. This is a crude hack. */
-        if (matroska->num_levels == EBML_MAX_DEPTH) {
-            av_log(matroska->ctx, AV_LOG_INFO,
-                   "Max EBML element depth (%d) reached, "
-                   "cannot parse further.\n", EBML_MAX_DEPTH);
+        if (matroska_parse_seekhead_entry(matroska, i) < 0)
             break;
-        }
+    }
 
-        level.start = 0;
-        level.length = (uint64_t)-1;
-        matroska->levels[matroska->num_levels] = level;
-        matroska->num_levels++;
-        matroska->current_id = 0;
+    /* seek back */
+    url_fseek(matroska->ctx->pb, before_pos, SEEK_SET);
+    matroska->level_up = level_up;
+    matroska->current_id = saved_id;
+}
 
-        ebml_parse(matroska, matroska_segment, matroska);
+static void matroska_add_index_entries(MatroskaDemuxContext *matroska)
+{
+    EbmlList *index_list;
+    MatroskaIndex *index;
+    int index_scale = 1;
+    int i, j;
 
-        /* remove dummy level */
-        while (matroska->num_levels) {
-            uint64_t length = matroska->levels[--matroska->num_levels].length;
-            if (length == (uint64_t)-1)
-                break;
+    index_list = &matroska->index;
+    index = index_list->elem;
+    if (index_list->nb_elem
+        && index[0].time > 100000000000000/matroska->time_scale) {
+        av_log(matroska->ctx, AV_LOG_WARNING, "Working around broken index.\n");
+        index_scale = matroska->time_scale;
+    }
+    for (i=0; i<index_list->nb_elem; i++) {
+        EbmlList *pos_list = &index[i].pos;
+        MatroskaIndexPos *pos = pos_list->elem;
+        for (j=0; j<pos_list->nb_elem; j++) {
+            MatroskaTrack *track = matroska_find_track_by_num(matroska,
+                                                              pos[j].track);
+            if (track && track->stream)
+                av_add_index_entry(track->stream,
+                                   pos[j].pos + matroska->segment_start,
+                                   index[i].time/index_scale, 0, 0,
+                                   AVINDEX_KEYFRAME);
         }
     }
+}
+
+/*
+ * Read the cues whose parsing was deferred by matroska_execute_seekhead().
+ */
+static void matroska_parse_cues(MatroskaDemuxContext *matroska)
+{
+    uint32_t level_up = matroska->level_up;
+    int64_t before_pos = url_ftell(matroska->ctx->pb);
+    uint32_t saved_id = matroska->current_id;
+    int num_levels = matroska->num_levels;
+
+    matroska_parse_seekhead_entry(matroska, matroska->cues_parsing_deferred - 1);
+    matroska->cues_parsing_deferred = 0;
 
-    /* seek back */
     url_fseek(matroska->ctx->pb, before_pos, SEEK_SET);
     matroska->level_up = level_up;
     matroska->current_id = saved_id;
+    matroska->num_levels = num_levels;
+
+    matroska_add_index_entries(matroska);
 }
 
 static int matroska_aac_profile(char *codec_id)
@@ -1175,9 +1249,6 @@ static int matroska_read_header(AVFormatContext *s, AVFormatParameters *ap)
     EbmlList *chapters_list = &matroska->chapters;
     MatroskaChapter *chapters;
     MatroskaTrack *tracks;
-    EbmlList *index_list;
-    MatroskaIndex *index;
-    int index_scale = 1;
     uint64_t max_start = 0;
     Ebml ebml = { 0 };
     AVStream *st;
@@ -1504,26 +1575,7 @@ static int matroska_read_header(AVFormatContext *s, AVFormatParameters *ap)
             max_start = chapters[i].start;
         }
 
-    index_list = &matroska->index;
-    index = index_list->elem;
-    if (index_list->nb_elem
-        && index[0].time > 100000000000000/matroska->time_scale) {
-        av_log(matroska->ctx, AV_LOG_WARNING, "Working around broken index.\n");
-        index_scale = matroska->time_scale;
-    }
-    for (i=0; i<index_list->nb_elem; i++) {
-        EbmlList *pos_list = &index[i].pos;
-        MatroskaIndexPos *pos = pos_list->elem;
-        for (j=0; j<pos_list->nb_elem; j++) {
-            MatroskaTrack *track = matroska_find_track_by_num(matroska,
-                                                              pos[j].track);
-            if (track && track->stream)
-                av_add_index_entry(track->stream,
-                                   pos[j].pos + matroska->segment_start,
-                                   index[i].time/index_scale, 0, 0,
-                                   AVINDEX_KEYFRAME);
-        }
-    }
+    matroska_add_index_entries(matroska);
 
     matroska_convert_tags(s);
 
@@ -1572,10 +1624,15 @@ static void matroska_clear_queue(MatroskaDemuxContext *matroska)
     }
 }
 
-static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
-                                int size, int64_t pos, uint64_t cluster_time,
-                                uint64_t duration, int is_keyframe,
-                                int64_t cluster_pos)
+/*
+ * Parse a Block or SimpleBlock of the given size from pb. The frames are
+ * read straight into their packets, and the data of blocks which are not
+ * wanted is skipped without being read.
+ */
+static int matroska_parse_block(MatroskaDemuxContext *matroska,
+                                ByteIOContext *pb, int size, int64_t pos,
+                                uint64_t cluster_time, uint64_t duration,
+                                int is_keyframe, int64_t cluster_pos)
 {
     uint64_t timecode = AV_NOPTS_VALUE;
     MatroskaTrack *track;
@@ -1583,32 +1640,31 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
     AVStream *st;
     AVPacket *pkt;
     int16_t block_time;
-    uint32_t *lace_size = NULL;
+    uint32_t lace_size[256];
     int n, flags, laces = 0;
     uint64_t num;
+    int64_t block_end = url_ftell(pb) + size;
 
-    if ((n = matroska_ebmlnum_uint(matroska, data, size, &num)) < 0) {
+    if ((n = matroska_ebmlnum_uint(matroska, pb, size, &num)) < 0) {
         av_log(matroska->ctx, AV_LOG_ERROR, "EBML block data error\n");
-        return res;
+        goto skip;
     }
-    data += n;
     size -= n;
 
     track = matroska_find_track_by_num(matroska, num);
     if (size <= 3 || !track || !track->stream) {
         av_log(matroska->ctx, AV_LOG_INFO,
                "Invalid stream %"PRIu64" or size %u\n", num, size);
-        return res;
+        goto skip;
     }
     st = track->stream;
     if (st->discard >= AVDISCARD_ALL)
-        return res;
+        goto skip;
     if (duration == AV_NOPTS_VALUE)
         duration = track->default_duration / matroska->time_scale;
 
-    block_time = AV_RB16(data);
-    data += 2;
-    flags = *data++;
+    block_time = get_be16(pb);
+    flags = get_byte(pb);
     size -= 3;
     if (is_keyframe == -1)
         is_keyframe = flags & 0x80 ? AV_PKT_FLAG_KEY : 0;
@@ -1626,14 +1682,13 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
 
     if (matroska->skip_to_keyframe && track->type != MATROSKA_TRACK_TYPE_SUBTITLE) {
         if (!is_keyframe || timecode < matroska->skip_to_timecode)
-            return res;
+            goto skip;
         matroska->skip_to_keyframe = 0;
     }
 
     switch ((flags & 0x06) >> 1) {
         case 0x0: /* no lacing */
             laces = 1;
-            lace_size = av_mallocz(sizeof(int));
             lace_size[0] = size;
             break;
 
@@ -1641,10 +1696,9 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
         case 0x2: /* fixed-size lacing */
         case 0x3: /* EBML lacing */
             assert(size>0); // size <=3 is checked before size-=3 above
-            laces = (*data) + 1;
-            data += 1;
+            laces = get_byte(pb) + 1;
             size -= 1;
-            lace_size = av_mallocz(laces * sizeof(int));
+            memset(lace_size, 0, laces * sizeof(*lace_size));
 
             switch ((flags & 0x06) >> 1) {
                 case 0x1: /* Xiph lacing */ {
@@ -1656,9 +1710,8 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
                                 res = -1;
                                 break;
                             }
-                            temp = *data;
+                            temp = get_byte(pb);
                             lace_size[n] += temp;
-                            data += 1;
                             size -= 1;
                             if (temp != 0xff)
                                 break;
@@ -1676,25 +1729,23 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
 
                 case 0x3: /* EBML lacing */ {
                     uint32_t total;
-                    n = matroska_ebmlnum_uint(matroska, data, size, &num);
+                    n = matroska_ebmlnum_uint(matroska, pb, size, &num);
                     if (n < 0) {
                         av_log(matroska->ctx, AV_LOG_INFO,
                                "EBML block data error\n");
                         break;
                     }
-                    data += n;
                     size -= n;
                     total = lace_size[0] = num;
                     for (n = 1; res == 0 && n < laces - 1; n++) {
                         int64_t snum;
                         int r;
-                        r = matroska_ebmlnum_sint(matroska, data, size, &snum);
+                        r = matroska_ebmlnum_sint(matroska, pb, size, &snum);
                         if (r < 0) {
                             av_log(matroska->ctx, AV_LOG_INFO,
                                    "EBML block data error\n");
                             break;
                         }
-                        data += r;
                         size -= r;
                         lace_size[n] = lace_size[n - 1] + snum;
                         total += lace_size[n];
@@ -1708,6 +1759,11 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
 
     if (res == 0) {
         for (n = 0; n < laces; n++) {
+            if (lace_size[n] > size) {
+                av_log(matroska->ctx, AV_LOG_ERROR, "Invalid packet size\n");
+                break;
+            }
+
             if ((st->codec->codec_id == CODEC_ID_RA_288 ||
                  st->codec->codec_id == CODEC_ID_COOK ||
                  st->codec->codec_id == CODEC_ID_SIPR ||
@@ -1722,6 +1778,15 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
                 int x;
 
                 if (!track->audio.pkt_cnt) {
+                    /* the deinterleaving below may read past a short lace */
+                    uint8_t *data = av_mallocz(FFMAX(lace_size[n], FFMAX(h/2*cfs, w)));
+                    if (!data) {
+                        res = AVERROR(ENOMEM);
+                        break;
+                    }
+                    get_buffer(pb, data, lace_size[n]);
+                    size -= lace_size[n];
+
                     if (st->codec->codec_id == CODEC_ID_RA_288)
                         for (x=0; x<h/2; x++)
                             memcpy(track->audio.buf+x*2*w+y*cfs,
@@ -1731,6 +1796,7 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
                     else
                         for (x=0; x<w/sps; x++)
                             memcpy(track->audio.buf+sps*(h*x+((h+1)/2)*(y&1)+(y>>1)), data+x*sps, sps);
+                    av_free(data);
 
                     if (++track->audio.sub_packet_cnt >= h) {
                         if (st->codec->codec_id == CODEC_ID_SIPR)
@@ -1738,6 +1804,9 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
                         track->audio.sub_packet_cnt = 0;
                         track->audio.pkt_cnt = h*w / a;
                     }
+                } else {
+                    url_fskip(pb, lace_size[n]);
+                    size -= lace_size[n];
                 }
                 while (track->audio.pkt_cnt) {
                     pkt = av_mallocz(sizeof(AVPacket));
@@ -1751,32 +1820,53 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
             } else {
                 MatroskaTrackEncoding *encodings = track->encodings.elem;
                 int offset = 0, pkt_size = lace_size[n];
-                uint8_t *pkt_data = data;
-
-                if (pkt_size > size) {
-                    av_log(matroska->ctx, AV_LOG_ERROR, "Invalid packet size\n");
-                    break;
-                }
+                uint8_t *data = NULL, *pkt_data = NULL;
 
                 if (encodings && encodings->scope & 1) {
+                    /* the frame has to be decoded before it is packetized */
+                    if (!(data = av_malloc(pkt_size))) {
+                        res = AVERROR(ENOMEM);
+                        break;
+                    }
+                    if (get_buffer(pb, data, pkt_size) != pkt_size) {
+                        av_free(data);
+                        res = AVERROR(EIO);
+                        break;
+                    }
+                    size -= lace_size[n];
+                    pkt_data = data;
                     offset = matroska_decode_buffer(&pkt_data,&pkt_size, track);
-                    if (offset < 0)
+                    if (offset < 0) {
+                        av_free(data);
                         continue;
+                    }
                 }
 
                 pkt = av_mallocz(sizeof(AVPacket));
-                /* XXX: prevent data copy... */
                 if (av_new_packet(pkt, pkt_size+offset) < 0) {
                     av_free(pkt);
+                    if (pkt_data != data)
+                        av_free(pkt_data);
+                    av_free(data);
                     res = AVERROR(ENOMEM);
                     break;
                 }
-                if (offset)
-                    memcpy (pkt->data, encodings->compression.settings.data, offset);
-                memcpy (pkt->data+offset, pkt_data, pkt_size);
-
-                if (pkt_data != data)
-                    av_free(pkt_data);
+                if (data) {
+                    if (offset)
+                        memcpy (pkt->data, encodings->compression.settings.data, offset);
+                    memcpy (pkt->data+offset, pkt_data, pkt_size);
+                    if (pkt_data != data)
+                        av_free(pkt_data);
+                    av_free(data);
+                } else {
+                    if (get_buffer(pb, pkt->data, pkt_size) != pkt_size) {
+                        av_free_packet(pkt);
+                        av_free(pkt);
+                        res = AVERROR(EIO);
+                        break;
+                    }
+                    size -= lace_size[n];
+                }
 
                 if (n == 0)
                     pkt->flags = is_keyframe;
@@ -1809,37 +1899,98 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
 
             if (timecode != AV_NOPTS_VALUE)
                 timecode = duration ? timecode + duration : AV_NOPTS_VALUE;
-            data += lace_size[n];
-            size -= lace_size[n];
         }
     }
 
-    av_free(lace_size);
+skip:
+    if (url_ftell(pb) != block_end)
+        url_fseek(pb, block_end, SEEK_SET);
     return res;
 }
 
+/*
+ * Parse the next cluster, handing each block to matroska_parse_block() as
+ * soon as it is read. Only SimpleBlocks and BlockGroups need to be handled
+ * quickly, the other elements go through the generic EBML parser.
+ */
 static int matroska_parse_cluster(MatroskaDemuxContext *matroska)
 {
+    ByteIOContext *pb = matroska->ctx->pb;
     MatroskaCluster cluster = { 0 };
-    EbmlList *blocks_list;
-    MatroskaBlock *blocks;
-    int i, res;
-    int64_t pos = url_ftell(matroska->ctx->pb);
+    MatroskaBlock block;
+    uint64_t id, length;
+    int res;
+    int64_t pos = url_ftell(pb);
     matroska->prev_pkt = NULL;
     if (matroska->current_id)
         pos -= 4;  /* sizeof the ID which was already read */
-    res = ebml_parse(matroska, matroska_clusters, &cluster);
-    blocks_list = &cluster.blocks;
-    blocks = blocks_list->elem;
-    for (i=0; i<blocks_list->nb_elem; i++)
-        if (blocks[i].bin.size > 0 && blocks[i].bin.data) {
-            int is_keyframe = blocks[i].non_simple ? !blocks[i].reference : -1;
-            res=matroska_parse_block(matroska,
-                                     blocks[i].bin.data, blocks[i].bin.size,
-                                     blocks[i].bin.pos,  cluster.timecode,
-                                     blocks[i].duration, is_keyframe,
-                                     pos);
+
+    if (!matroska->current_id) {
+        if ((res = ebml_read_num(matroska, pb, 4, &id)) < 0)
+            goto end;
+        matroska->current_id = id | 1 << 7*res;
+    }
+    if (matroska->current_id != MATROSKA_ID_CLUSTER) {
+        res = ebml_parse(matroska, matroska_clusters, &cluster);
+        goto end;
+    }
+
+    matroska->current_id = 0;
+    if ((res = ebml_read_length(matroska, pb, &length)) < 0 ||
+        (res = ebml_read_master(matroska, length)) < 0)
+        goto end;
+
+    while (!res && !ebml_level_end(matroska)) {
+        if (!matroska->current_id) {
+            if ((res = ebml_read_num(matroska, pb, 4, &id)) < 0)
+                break;
+            matroska->current_id = id | 1 << 7*res;
+            res = 0;
         }
+
+        switch (matroska->current_id) {
+        case MATROSKA_ID_SIMPLEBLOCK: {
+            MatroskaLevel *level = &matroska->levels[matroska->num_levels-1];
+            matroska->current_id = 0;
+            if ((res = ebml_read_length(matroska, pb, &length)) < 0)
+                break;
+            if (length > INT_MAX ||
+                url_ftell(pb) + length > level->start + level->length) {
+                av_log(matroska->ctx, AV_LOG_ERROR,
+                       "Invalid SimpleBlock length %"PRIu64"\n", length);
+                res = AVERROR_INVALIDDATA;
+                break;
+            }
+            res = matroska_parse_block(matroska, pb, length, url_ftell(pb),
+                                       cluster.timecode, AV_NOPTS_VALUE, -1,
+                                       pos);
+            break;
+        }
+        case MATROSKA_ID_BLOCKGROUP:
+            memset(&block, 0, sizeof(block));
+            matroska->current_id = 0;
+            if ((res = ebml_read_length(matroska, pb, &length)) < 0 ||
+                (res = ebml_read_master(matroska, length)) < 0)
+                break;
+            res = ebml_parse_nest(matroska, matroska_blockgroup, &block);
+            if (!res && block.bin.size > 0 && block.bin.data) {
+                ByteIOContext bpb;
+                init_put_byte(&bpb, block.bin.data, block.bin.size, 0,
+                              NULL, NULL, NULL, NULL);
+                res = matroska_parse_block(matroska, &bpb, block.bin.size,
+                                           block.bin.pos, cluster.timecode,
+                                           block.duration,
+                                           block.non_simple ? !block.reference : -1,
+                                           pos);
+            }
+            ebml_free(matroska_blockgroup, &block);
+            break;
+        default:
+            res = ebml_parse_id(matroska, matroska_cluster,
+                                matroska->current_id, &cluster);
+        }
+    }
+end:
     ebml_free(matroska_cluster, &cluster);
     if (res < 0)  matroska->done = 1;
     return res;
@@ -1866,6 +2017,9 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
     AVStream *st = s->streams[stream_index];
     int i, index, index_sub, index_min;
 
+    if (matroska->cues_parsing_deferred)
+        matroska_parse_cues(matroska);
+
     if (!st->nb_index_entries)
         return 0;
     timestamp = FFMAX(timestamp, st->index_entries[0].timestamp);
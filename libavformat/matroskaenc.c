@@ -30,6 +30,7 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/random_seed.h"
 #include "libavutil/lfg.h"
+#include "libavutil/opt.h"
 #include "libavcodec/xiph.h"
 #include "libavcodec/mpeg4audio.h"
 #include <strings.h>
@@ -73,6 +74,7 @@ typedef struct {
 #define MODE_WEBM       0x02
 
 typedef struct MatroskaMuxContext {
+    const AVClass   *class;
     int             mode;
     ByteIOContext   *dyn_bc;
     ebml_master     segment;
@@ -88,6 +90,9 @@ typedef struct MatroskaMuxContext {
 
     unsigned int    audio_buffer_size;
     AVPacket        cur_audio_pkt;
+
+    int             live;               ///< write without seeking back, clusters have unknown size
+    int             have_video;
 } MatroskaMuxContext;
 
 
@@ -847,8 +852,10 @@ static int mkv_write_header(AVFormatContext *s)
 
     // reserve space for the duration
     mkv->duration = 0;
-    mkv->duration_offset = url_ftell(pb);
-    put_ebml_void(pb, 11);                  // assumes double-precision float to be written
+    if (!mkv->live) {
+        mkv->duration_offset = url_ftell(pb);
+        put_ebml_void(pb, 11);              // assumes double-precision float to be written
+    }
     end_ebml_master(pb, segment_info);
 
     ret = mkv_write_tracks(s);
@@ -862,12 +869,19 @@ static int mkv_write_header(AVFormatContext *s)
         if (ret < 0) return ret;
     }
 
-    if (url_is_streamed(s->pb))
+    if (url_is_streamed(s->pb) || mkv->live)
         mkv_write_seekhead(pb, mkv->main_seekhead);
 
-    mkv->cues = mkv_start_cues(mkv->segment_offset);
-    if (mkv->cues == NULL)
-        return AVERROR(ENOMEM);
+    // cues are only written at the end of a seekable file
+    if (!url_is_streamed(s->pb) && !mkv->live) {
+        mkv->cues = mkv_start_cues(mkv->segment_offset);
+        if (mkv->cues == NULL)
+            return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < s->nb_streams; i++)
+        if (s->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+            mkv->have_video = 1;
 
     av_init_packet(&mkv->cur_audio_pkt);
     mkv->cur_audio_pkt.size = 0;
@@ -1038,7 +1052,7 @@ static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         return AVERROR(EINVAL);
     }
 
-    if (url_is_streamed(s->pb)) {
+    if (url_is_streamed(s->pb) && !mkv->live) {
         if (!mkv->dyn_bc)
             url_open_dyn_buf(&mkv->dyn_bc);
         pb = mkv->dyn_bc;
@@ -1065,7 +1079,7 @@ static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         end_ebml_master(pb, blockgroup);
     }
 
-    if (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe) {
+    if (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe && mkv->cues) {
         ret = mkv_add_cuepoint(mkv->cues, pkt->stream_index, ts, mkv->cluster_pos);
         if (ret < 0) return ret;
     }
@@ -1090,24 +1104,41 @@ static int mkv_copy_packet(MatroskaMuxContext *mkv, const AVPacket *pkt)
 static int mkv_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MatroskaMuxContext *mkv = s->priv_data;
-    ByteIOContext *pb = url_is_streamed(s->pb) ? mkv->dyn_bc : s->pb;
+    int use_dyn_bc = url_is_streamed(s->pb) && !mkv->live;
+    ByteIOContext *pb = use_dyn_bc ? mkv->dyn_bc : s->pb;
     AVCodecContext *codec = s->streams[pkt->stream_index]->codec;
     int ret, keyframe = !!(pkt->flags & AV_PKT_FLAG_KEY);
     int64_t ts = mkv->tracks[pkt->stream_index].write_dts ? pkt->dts : pkt->pts;
-    int cluster_size = url_ftell(pb) - (url_is_streamed(s->pb) ? 0 : mkv->cluster_pos);
-
-    // start a new cluster every 5 MB or 5 sec, or 32k / 1 sec for streaming or
-    // after 4k and on a keyframe
-    if (mkv->cluster_pos &&
-        ((url_is_streamed(s->pb) && (cluster_size > 32*1024 || ts > mkv->cluster_pts + 1000))
-         ||                      cluster_size > 5*1024*1024 || ts > mkv->cluster_pts + 5000
-         || (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe && cluster_size > 4*1024))) {
+    int cluster_size = url_ftell(pb) - (use_dyn_bc ? 0 : mkv->cluster_pos);
+    int new_cluster;
+
+    if (mkv->live && mkv->have_video) {
+        // in live mode, every cluster starts with a video keyframe so that
+        // it can be decoded on its own; only break that rule before the
+        // 16 bit block timecodes would overflow
+        new_cluster = (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe) ||
+                      ts > mkv->cluster_pts + 30000;
+    } else {
+        // start a new cluster every 5 MB or 5 sec, or 32k / 1 sec for streaming or
+        // after 4k and on a keyframe
+        new_cluster =
+            ((url_is_streamed(s->pb) || mkv->live) &&
+             (cluster_size > 32*1024 || ts > mkv->cluster_pts + 1000))
+            || cluster_size > 5*1024*1024 || ts > mkv->cluster_pts + 5000
+            || (codec->codec_type == AVMEDIA_TYPE_VIDEO && keyframe && cluster_size > 4*1024);
+    }
+    if (mkv->cluster_pos && new_cluster) {
         av_log(s, AV_LOG_DEBUG, "Starting new cluster at offset %" PRIu64
                " bytes, pts %" PRIu64 "\n", url_ftell(pb), ts);
-        end_ebml_master(pb, mkv->cluster);
         mkv->cluster_pos = 0;
-        if (mkv->dyn_bc)
-            mkv_flush_dynbuf(s);
+        if (mkv->live) {
+            // the cluster size stays unknown, just send out what we have
+            put_flush_packet(pb);
+        } else {
+            end_ebml_master(pb, mkv->cluster);
+            if (mkv->dyn_bc)
+                mkv_flush_dynbuf(s);
+        }
     }
 
     // check if we have an audio packet cached
@@ -1149,11 +1180,11 @@ static int mkv_write_trailer(AVFormatContext *s)
     if (mkv->dyn_bc) {
         end_ebml_master(mkv->dyn_bc, mkv->cluster);
         mkv_flush_dynbuf(s);
-    } else if (mkv->cluster_pos) {
+    } else if (mkv->cluster_pos && !mkv->live) {
         end_ebml_master(pb, mkv->cluster);
     }
 
-    if (!url_is_streamed(pb)) {
+    if (!url_is_streamed(pb) && !mkv->live) {
         cuespos = mkv_write_cues(pb, mkv->cues, s->nb_streams);
 
         ret = mkv_add_seekhead_entry(mkv->main_seekhead, MATROSKA_ID_CUES    , cuespos);
@@ -1169,14 +1200,25 @@ static int mkv_write_trailer(AVFormatContext *s)
         url_fseek(pb, currentpos, SEEK_SET);
     }
 
-    end_ebml_master(pb, mkv->segment);
+    if (!mkv->live)
+        end_ebml_master(pb, mkv->segment);
     av_free(mkv->tracks);
     av_destruct_packet(&mkv->cur_audio_pkt);
     put_flush_packet(pb);
     return 0;
 }
 
+#define OFFSET(x) offsetof(MatroskaMuxContext, x)
+static const AVOption options[] = {
+    { "live", "write a live stream: no seeking back, no cues, clusters of unknown size starting on keyframes", OFFSET(live), FF_OPT_TYPE_INT, 0, 0, 1, AV_OPT_FLAG_ENCODING_PARAM },
+    { NULL },
+};
+
 #if CONFIG_MATROSKA_MUXER
+static const AVClass matroska_class = {
+    "matroska muxer", av_default_item_name, options, LIBAVUTIL_VERSION_INT
+};
+
 AVOutputFormat matroska_muxer = {
     "matroska",
     NULL_IF_CONFIG_SMALL("Matroska file format"),
@@ -1191,10 +1233,15 @@ AVOutputFormat matroska_muxer = {
     .flags = AVFMT_GLOBALHEADER | AVFMT_VARIABLE_FPS,
     .codec_tag = (const AVCodecTag* const []){ff_codec_bmp_tags, ff_codec_wav_tags, 0},
     .subtitle_codec = CODEC_ID_TEXT,
+    .priv_class = &matroska_class,
 };
 #endif
 
 #if CONFIG_WEBM_MUXER
+static const AVClass webm_class = {
+    "webm muxer", av_default_item_name, options, LIBAVUTIL_VERSION_INT
+};
+
 AVOutputFormat webm_muxer = {
     "webm",
     NULL_IF_CONFIG_SMALL("WebM file format"),
@@ -1207,10 +1254,15 @@ AVOutputFormat webm_muxer = {
     mkv_write_packet,
     mkv_write_trailer,
     .flags = AVFMT_GLOBALHEADER | AVFMT_VARIABLE_FPS,
+    .priv_class = &webm_class,
 };
 #endif
 
 #if CONFIG_MATROSKA_AUDIO_MUXER
+static const AVClass mka_class = {
+    "matroska audio muxer", av_default_item_name, options, LIBAVUTIL_VERSION_INT
+};
+
 AVOutputFormat matroska_audio_muxer = {
     "matroska",
     NULL_IF_CONFIG_SMALL("Matroska file format"),
@@ -1224,5 +1276,6 @@ AVOutputFormat matroska_audio_muxer = {
     mkv_write_trailer,
     .flags = AVFMT_GLOBALHEADER,
     .codec_tag = (const AVCodecTag* const []){ff_codec_wav_tags, 0},
+    .priv_class = &mka_class,
 };
 #endif
@@ -22,10 +22,137 @@
 #include "avformat.h"
 #include "metadata.h"
 
+/* Tags are indexed by a hash table once a struct holds that many of them,
+ * smaller ones are simply scanned. */
+#define INDEX_MIN_TAGS    8
+#define INDEX_EMPTY      -1
+#define INDEX_DELETED    -2
+
+/* Copied strings up to that size are packed in a list of blocks freed
+ * with the struct, the larger ones are allocated separately. Once the
+ * overwritten strings waste too much of the blocks, new strings are
+ * allocated separately as well. */
+#define ARENA_MAX_STRING  256
+#define ARENA_MIN_BLOCK  1024
+#define ARENA_MAX_BLOCK  (32 * 1024)
+#define ARENA_MAX_WASTE  (64 * 1024)
+
+#define OWNED_KEY   1
+#define OWNED_VALUE 2
+
+struct MetadataBlock {
+    struct MetadataBlock *next;
+    unsigned size, used;
+};
+
+static int match_key(const char *s, const char *key, int flags)
+{
+    unsigned int j;
+
+    if(flags & AV_METADATA_MATCH_CASE) for(j=0;         s[j]  ==         key[j]  && key[j]; j++);
+    else                               for(j=0; toupper(s[j]) == toupper(key[j]) && key[j]; j++);
+    if(key[j])
+        return 0;
+    if(s[j] && !(flags & AV_METADATA_IGNORE_SUFFIX))
+        return 0;
+    return 1;
+}
+
+static unsigned int hash_key(const char *key)
+{
+    unsigned int h = 0;
+
+    while (*key)
+        h = h * 31 + toupper(*key++);
+    return h;
+}
+
+static int *index_slot(AVMetadata *m, int i)
+{
+    unsigned int mask = m->index_size - 1;
+    unsigned int slot = hash_key(m->elems[i].key) & mask;
+
+    while (m->index[slot] != i)
+        slot = (slot + 1) & mask;
+    return &m->index[slot];
+}
+
+static void index_insert(AVMetadata *m, int i)
+{
+    unsigned int mask = m->index_size - 1;
+    unsigned int slot = hash_key(m->elems[i].key) & mask;
+
+    while (m->index[slot] >= 0)
+        slot = (slot + 1) & mask;
+    if (m->index[slot] == INDEX_EMPTY)
+        m->index_used++;
+    m->index[slot] = i;
+}
+
+/**
+ * Make sure the hash table can take one more tag, rebuild it without the
+ * deleted slots if needed. If this fails the tags are scanned instead.
+ */
+static void index_reserve(AVMetadata *m)
+{
+    int i, size = 16;
+
+    if (m->index ? 2 * (m->index_used + 1) <= m->index_size
+                 : m->count + 1 < INDEX_MIN_TAGS)
+        return;
+
+    while (size < 4 * (m->count + 1))
+        size <<= 1;
+    av_freep(&m->index);
+    m->index_size = m->index_used = 0;
+    if (!(m->index = av_malloc(size * sizeof(*m->index))))
+        return;
+    m->index_size = size;
+    for (i = 0; i < size; i++)
+        m->index[i] = INDEX_EMPTY;
+    for (i = 0; i < m->count; i++)
+        index_insert(m, i);
+}
+
+static char *metadata_strdup(AVMetadata *m, const char *s, int *owned, int bit)
+{
+    struct MetadataBlock *b = m->arena;
+    unsigned int len = strlen(s) + 1;
+    char *ptr;
+
+    if (len > ARENA_MAX_STRING || m->arena_waste > ARENA_MAX_WASTE) {
+        *owned |= bit;
+        return av_strdup(s);
+    }
+    if (!b || b->used + len > b->size) {
+        unsigned int size = b ? FFMIN(2 * b->size, ARENA_MAX_BLOCK) : ARENA_MIN_BLOCK;
+        if (!(b = av_malloc(sizeof(*b) + size))) {
+            *owned |= bit;
+            return av_strdup(s);
+        }
+        b->next = m->arena;
+        b->size = size;
+        b->used = 0;
+        m->arena = b;
+    }
+    ptr = (char *)(b + 1) + b->used;
+    b->used += len;
+    memcpy(ptr, s, len);
+    return ptr;
+}
+
+static void metadata_strfree(AVMetadata *m, char *s, int owned)
+{
+    if (owned)
+        av_free(s);
+    else if (s)
+        m->arena_waste += strlen(s) + 1;
+}
+
 AVMetadataTag *
 av_metadata_get(AVMetadata *m, const char *key, const AVMetadataTag *prev, int flags)
 {
-    unsigned int i, j;
+    unsigned int i;
 
     if(!m)
         return NULL;
@@ -33,15 +160,24 @@ av_metadata_get(AVMetadata *m, const char *key, const AVMetadataTag *prev, int f
     if(prev) i= prev - m->elems + 1;
     else     i= 0;
 
+    if (m->index && !(flags & AV_METADATA_IGNORE_SUFFIX)) {
+        /* the first match after prev in tag order, not in probe order */
+        unsigned int mask = m->index_size - 1;
+        unsigned int slot = hash_key(key) & mask;
+        int best = -1;
+
+        for (; m->index[slot] != INDEX_EMPTY; slot = (slot + 1) & mask) {
+            int idx = m->index[slot];
+            if (idx >= (int)i && (best < 0 || idx < best) &&
+                match_key(m->elems[idx].key, key, flags))
+                best = idx;
+        }
+        return best >= 0 ? &m->elems[best] : NULL;
+    }
+
     for(; i<m->count; i++){
-        const char *s= m->elems[i].key;
-        if(flags & AV_METADATA_MATCH_CASE) for(j=0;         s[j]  ==         key[j]  && key[j]; j++);
-        else                               for(j=0; toupper(s[j]) == toupper(key[j]) && key[j]; j++);
-        if(key[j])
-            continue;
-        if(s[j] && !(flags & AV_METADATA_IGNORE_SUFFIX))
-            continue;
-        return &m->elems[i];
+        if (match_key(m->elems[i].key, key, flags))
+            return &m->elems[i];
     }
     return NULL;
 }
@@ -50,38 +186,71 @@ int av_metadata_set2(AVMetadata **pm, const char *key, const char *value, int fl
 {
     AVMetadata *m= *pm;
     AVMetadataTag *tag= av_metadata_get(m, key, NULL, flags);
+    char *new_key = NULL;
+    int owned = 0;
 
-    if(!m)
-        m=*pm= av_mallocz(sizeof(*m));
+    if(!m && !(m=*pm= av_mallocz(sizeof(*m))))
+        return AVERROR(ENOMEM);
 
     if(tag){
+        int i = tag - m->elems, last = m->count - 1;
+
         if (flags & AV_METADATA_DONT_OVERWRITE)
             return 0;
-        av_free(tag->value);
-        av_free(tag->key);
-        *tag= m->elems[--m->count];
-    }else{
-        AVMetadataTag *tmp= av_realloc(m->elems, (m->count+1) * sizeof(*m->elems));
-        if(tmp){
-            m->elems= tmp;
-        }else
+        if (m->index) {
+            *index_slot(m, i) = INDEX_DELETED;
+            if (i != last)
+                *index_slot(m, last) = i;
+        }
+        /* a tag replaced under the same key keeps its copy of the key */
+        if (value && !(flags & AV_METADATA_DONT_STRDUP_KEY) && !strcmp(tag->key, key)) {
+            new_key = tag->key;
+            owned   = m->owned[i] & OWNED_KEY;
+        } else
+            metadata_strfree(m, tag->key, m->owned[i] & OWNED_KEY);
+        metadata_strfree(m, tag->value, m->owned[i] & OWNED_VALUE);
+        *tag= m->elems[last];
+        m->owned[i] = m->owned[last];
+        m->count--;
+    }else if(value && m->count == m->size){
+        int size = FFMAX(4, 2 * m->size);
+        AVMetadataTag *tmp= av_realloc(m->elems, size * sizeof(*m->elems));
+        if(!tmp)
+            return AVERROR(ENOMEM);
+        m->elems= tmp;
+        if (!(tmp = av_realloc(m->owned, size * sizeof(*m->owned))))
             return AVERROR(ENOMEM);
+        m->owned = (uint8_t *)tmp;
+        m->size = size;
     }
     if(value){
-        if(flags & AV_METADATA_DONT_STRDUP_KEY){
-            m->elems[m->count].key  = key;
+        AVMetadataTag *t = &m->elems[m->count];
+
+        if (new_key) {
+            t->key  = new_key;
+        } else if(flags & AV_METADATA_DONT_STRDUP_KEY){
+            t->key  = key;
+            owned  |= OWNED_KEY;
         }else
-        m->elems[m->count].key  = av_strdup(key  );
+        t->key  = metadata_strdup(m, key, &owned, OWNED_KEY);
         if(flags & AV_METADATA_DONT_STRDUP_VAL){
-            m->elems[m->count].value= value;
+            t->value= value;
+            owned  |= OWNED_VALUE;
         }else
-        m->elems[m->count].value= av_strdup(value);
+        t->value= metadata_strdup(m, value, &owned, OWNED_VALUE);
+        if (!t->key || !t->value) {
+            metadata_strfree(m, t->key,   owned & OWNED_KEY);
+            metadata_strfree(m, t->value, owned & OWNED_VALUE);
+            return AVERROR(ENOMEM);
+        }
+        m->owned[m->count] = owned;
+        index_reserve(m);
+        if (m->index)
+            index_insert(m, m->count);
         m->count++;
     }
-    if(!m->count) {
-        av_free(m->elems);
-        av_freep(pm);
-    }
+    if(!m->count)
+        av_metadata_free(pm);
 
     return 0;
 }
@@ -105,10 +274,19 @@ void av_metadata_free(AVMetadata **pm)
 
     if(m){
         while(m->count--){
-            av_free(m->elems[m->count].key);
-            av_free(m->elems[m->count].value);
+            if (m->owned[m->count] & OWNED_KEY)
+                av_free(m->elems[m->count].key);
+            if (m->owned[m->count] & OWNED_VALUE)
+                av_free(m->elems[m->count].value);
+        }
+        while (m->arena) {
+            struct MetadataBlock *next = m->arena->next;
+            av_free(m->arena);
+            m->arena = next;
         }
         av_free(m->elems);
+        av_free(m->owned);
+        av_free(m->index);
     }
     av_freep(pm);
 }
@@ -166,3 +344,59 @@ void av_metadata_copy(AVMetadata **dst, AVMetadata *src, int flags)
     while ((t = av_metadata_get(src, "", t, AV_METADATA_IGNORE_SUFFIX)))
         av_metadata_set2(dst, t->key, t->value, flags);
 }
+
+#ifdef TEST
+#include "libavutil/lfg.h"
+
+#undef printf
+
+static AVMetadataTag *scan_get(AVMetadata *m, const char *key,
+                               const AVMetadataTag *prev, int flags)
+{
+    int i = prev ? prev - m->elems + 1 : 0;
+
+    for (; m && i < m->count; i++)
+        if (match_key(m->elems[i].key, key, flags))
+            return &m->elems[i];
+    return NULL;
+}
+
+int main(void)
+{
+    static const char *const keys[] = { "title", "Title", "TITLE", "artist",
+        "album", "album_artist", "track", "date", "comment", "genre", "lyrics" };
+    AVMetadata *m = NULL;
+    AVMetadataTag *t, *ref;
+    char key[32], value[300];
+    int i, n, flags, errors = 0;
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 1);
+    for (i = 0; i < 50000; i++) {
+        n = av_lfg_get(&lfg) % 300;
+        if (av_lfg_get(&lfg) & 1)
+            snprintf(key, sizeof(key), "%s", keys[n % FF_ARRAY_ELEMS(keys)]);
+        else
+            snprintf(key, sizeof(key), "%s%d", keys[n % FF_ARRAY_ELEMS(keys)], n);
+        memset(value, 'a' + i % 26, n);
+        value[n] = 0;
+        flags = av_lfg_get(&lfg) & (AV_METADATA_MATCH_CASE | AV_METADATA_DONT_OVERWRITE);
+        av_metadata_set2(&m, key, av_lfg_get(&lfg) % 8 ? value : NULL, flags);
+
+        flags = av_lfg_get(&lfg) & (AV_METADATA_MATCH_CASE | AV_METADATA_IGNORE_SUFFIX);
+        t = ref = NULL;
+        do {
+            t   = av_metadata_get(m, key, t,   flags);
+            ref = scan_get       (m, key, ref, flags);
+            if (t != ref) {
+                printf("mismatch for %s, flags %d\n", key, flags);
+                errors++;
+                break;
+            }
+        } while (t);
+    }
+    printf("%d tags, %d errors\n", m ? m->count : 0, errors);
+    av_metadata_free(&m);
+    return !!errors;
+}
+#endif
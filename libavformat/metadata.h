@@ -33,6 +33,13 @@
 struct AVMetadata{
     int count;
     AVMetadataTag *elems;
+    int size;                       ///< number of allocated elems
+    uint8_t *owned;                 ///< per tag, whether key and value were allocated separately
+    int *index;                     ///< hash table of the tag indices, NULL for few tags
+    int index_size;                 ///< number of slots of index, a power of 2
+    int index_used;                 ///< slots holding a tag or a deleted tag
+    struct MetadataBlock *arena;    ///< blocks holding the copied strings
+    unsigned int arena_waste;       ///< bytes of the blocks used by removed strings
 };
 
 struct AVMetadataConv{
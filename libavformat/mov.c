@@ -2231,6 +2231,17 @@ static const MOVParseTableEntry mov_default_parse_table[] = {
 { 0, NULL }
 };
 
+/* the "obvious" first atoms of mov_probe(), whatever their size */
+static const AVProbeSignature mov_signatures[] = {
+    { 4, 4, "ftyp" },
+    { 4, 4, "moov" },
+    { 4, 4, "mdat" },
+    { 4, 4, "jP  " },
+    { 4, 4, "pnot" },
+    { 4, 4, "udta" },
+    { 0 }
+};
+
 static int mov_probe(AVProbeData *p)
 {
     unsigned int offset;
@@ -2576,4 +2587,5 @@ AVInputFormat mov_demuxer = {
     mov_read_packet,
     mov_read_close,
     mov_read_seek,
+    .signatures = mov_signatures,
 };
@@ -84,6 +84,7 @@ struct Program {
     unsigned int id; //program id/service id
     unsigned int nb_pids;
     unsigned int pids[MAX_PIDS_PER_PROGRAM];
+    int pmt_found; ///< the PMT of the program has been parsed
 };
 
 struct MpegTSContext {
@@ -185,9 +186,38 @@ static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
     p = &ts->prg[ts->nb_prg];
     p->id = programid;
     p->nb_pids = 0;
+    p->pmt_found = 0;
     ts->nb_prg++;
 }
 
+/**
+ * @return 1 if the PMTs of all the programs of the PAT have been parsed
+ */
+static int all_pmts_found(MpegTSContext *ts)
+{
+    int i;
+
+    if (!ts->nb_prg)
+        return 0;
+    for(i=0; i<ts->nb_prg; i++)
+        if(!ts->prg[i].pmt_found)
+            return 0;
+    return 1;
+}
+
+static void set_pmt_found(MpegTSContext *ts, unsigned int programid)
+{
+    int i;
+
+    for(i=0; i<ts->nb_prg; i++)
+        if(ts->prg[i].id == programid)
+            ts->prg[i].pmt_found = 1;
+    /* all the streams are known now, so av_find_stream_info() can stop
+       as soon as it has their parameters */
+    if (all_pmts_found(ts))
+        ts->stream->ctx_flags &= ~AVFMTCTX_NOHEADER;
+}
+
 static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned int pid)
 {
     int i;
@@ -1101,6 +1131,7 @@ static void pmt_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
         }
         p = desc_list_end;
     }
+    set_pmt_found(ts, h->id);
 
  out:
     av_free(mp4_dec_config_descr);
@@ -1237,16 +1268,19 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     int64_t pos;
 
     pid = AV_RB16(packet + 1) & 0x1fff;
-    if(pid && discard_pid(ts, pid))
-        return 0;
     is_start = packet[1] & 0x40;
     tss = ts->pids[pid];
-    if (ts->auto_guess && tss == NULL && is_start) {
+    /* look up the filter first, it is much cheaper than discard_pid() */
+    if (!tss && !(ts->auto_guess && is_start))
+        return 0;
+    if(pid && discard_pid(ts, pid))
+        return 0;
+    if (!tss) {
         add_pes_stream(ts, pid, -1);
         tss = ts->pids[pid];
+        if (!tss)
+            return 0;
     }
-    if (!tss)
-        return 0;
 
     /* continuity check (currently not used) */
     cc = (packet[3] & 0xf);
@@ -1329,18 +1363,33 @@ static int mpegts_resync(AVFormatContext *s)
     return -1;
 }
 
-/* return -1 if error or EOF. Return 0 if OK. */
-static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size)
+/**
+ * Read the next TS packet.
+ * When the whole raw packet is available in the I/O buffer, *data points
+ * directly into it and no copy is made; otherwise the packet is copied
+ * into buf and *data points to buf.
+ * @return 0 if OK, <0 if error or EOF
+ */
+static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size,
+                       const uint8_t **data)
 {
     ByteIOContext *pb = s->pb;
     int skip, len;
 
     for(;;) {
-        len = get_buffer(pb, buf, TS_PACKET_SIZE);
-        if (len != TS_PACKET_SIZE)
-            return AVERROR(EIO);
+        /* the trailing bytes of 192/204 byte packets must be buffered too,
+         * so that skipping them cannot refill the buffer under *data */
+        if (pb->buf_end - pb->buf_ptr >= raw_packet_size) {
+            *data = pb->buf_ptr;
+            pb->buf_ptr += TS_PACKET_SIZE;
+        } else {
+            len = get_buffer(pb, buf, TS_PACKET_SIZE);
+            if (len != TS_PACKET_SIZE)
+                return AVERROR(EIO);
+            *data = buf;
+        }
         /* check paquet sync byte */
-        if (buf[0] != 0x47) {
+        if ((*data)[0] != 0x47) {
             /* find a new packet start */
             url_fseek(pb, -TS_PACKET_SIZE, SEEK_CUR);
             if (mpegts_resync(s) < 0)
@@ -1357,10 +1406,35 @@ static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size)
     return 0;
 }
 
+/**
+ * Drop packets of PIDs without a filter straight from the I/O buffer,
+ * checking only the sync byte and PID of each, until a packet that needs
+ * handling, a bad sync byte or the end of the buffered data is reached.
+ * @return the number of packets skipped
+ */
+static int skip_unwanted_packets(MpegTSContext *ts, int max_packets)
+{
+    ByteIOContext *pb = ts->stream->pb;
+    const int raw_packet_size = ts->raw_packet_size;
+    uint8_t *p = pb->buf_ptr;
+    int n = 0;
+
+    while (n < max_packets && pb->buf_end - p >= raw_packet_size && p[0] == 0x47) {
+        int pid = AV_RB16(p + 1) & 0x1fff;
+        if (ts->pids[pid] || (ts->auto_guess && (p[1] & 0x40)))
+            break;
+        p += raw_packet_size;
+        n++;
+    }
+    pb->buf_ptr = p;
+    return n;
+}
+
 static int handle_packets(MpegTSContext *ts, int nb_packets)
 {
     AVFormatContext *s = ts->stream;
     uint8_t packet[TS_PACKET_SIZE];
+    const uint8_t *data;
     int packet_num, ret;
 
     ts->stop_parse = 0;
@@ -1368,13 +1442,14 @@ static int handle_packets(MpegTSContext *ts, int nb_packets)
     for(;;) {
         if (ts->stop_parse>0)
             break;
+        packet_num += skip_unwanted_packets(ts, nb_packets ? nb_packets - packet_num - 1 : INT_MAX);
         packet_num++;
         if (nb_packets != 0 && packet_num >= nb_packets)
             break;
-        ret = read_packet(s, packet, ts->raw_packet_size);
+        ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             return ret;
-        ret = handle_packet(ts, packet);
+        ret = handle_packet(ts, data);
         if (ret != 0)
             return ret;
     }
@@ -1486,13 +1561,17 @@ static int mpegts_read_header(AVFormatContext *s,
 
         dprintf(ts->stream, "tuning done\n");
 
-        s->ctx_flags |= AVFMTCTX_NOHEADER;
+        /* streams of programs whose PMT has not been seen yet are added
+           while reading packets */
+        if (!all_pmts_found(ts))
+            s->ctx_flags |= AVFMTCTX_NOHEADER;
     } else {
         AVStream *st;
         int pcr_pid, pid, nb_packets, nb_pcrs, ret, pcr_l;
         int64_t pcrs[2], pcr_h;
         int packet_count[2];
         uint8_t packet[TS_PACKET_SIZE];
+        const uint8_t *data;
 
         /* only read packets */
 
@@ -1508,12 +1587,12 @@ static int mpegts_read_header(AVFormatContext *s,
         nb_pcrs = 0;
         nb_packets = 0;
         for(;;) {
-            ret = read_packet(s, packet, ts->raw_packet_size);
+            ret = read_packet(s, packet, ts->raw_packet_size, &data);
             if (ret < 0)
                 return -1;
-            pid = AV_RB16(packet + 1) & 0x1fff;
+            pid = AV_RB16(data + 1) & 0x1fff;
             if ((pcr_pid == -1 || pcr_pid == pid) &&
-                parse_pcr(&pcr_h, &pcr_l, packet) == 0) {
+                parse_pcr(&pcr_h, &pcr_l, data) == 0) {
                 pcr_pid = pid;
                 packet_count[nb_pcrs] = nb_packets;
                 pcrs[nb_pcrs] = pcr_h * 300 + pcr_l;
@@ -1553,15 +1632,18 @@ static int mpegts_raw_read_packet(AVFormatContext *s,
     int64_t pcr_h, next_pcr_h, pos;
     int pcr_l, next_pcr_l;
     uint8_t pcr_buf[12];
+    const uint8_t *data;
 
     if (av_new_packet(pkt, TS_PACKET_SIZE) < 0)
         return AVERROR(ENOMEM);
     pkt->pos= url_ftell(s->pb);
-    ret = read_packet(s, pkt->data, ts->raw_packet_size);
+    ret = read_packet(s, pkt->data, ts->raw_packet_size, &data);
     if (ret < 0) {
         av_free_packet(pkt);
         return ret;
     }
+    if (data != pkt->data)
+        memcpy(pkt->data, data, TS_PACKET_SIZE);
     if (ts->mpeg2ts_compute_pcr) {
         /* compute exact PCR for each packet */
         if (parse_pcr(&pcr_h, &pcr_l, pkt->data) == 0) {
@@ -39,6 +39,8 @@ typedef struct MpegTSSection {
     int cc;
     void (*write_packet)(struct MpegTSSection *s, const uint8_t *packet);
     void *opaque;
+    uint8_t *packets; ///< TS packets of the last written section, for retransmission
+    int nb_packets;
 } MpegTSSection;
 
 typedef struct MpegTSService {
@@ -64,17 +66,20 @@ typedef struct MpegTSWrite {
     int tsid;
     int64_t first_pcr;
     int mux_rate; ///< set to 1 when VBR
+    uint8_t *null_packets; ///< NULL_PACKET_BATCH null packets, for CBR stuffing
 } MpegTSWrite;
 
+/* number of null packets written at once when stuffing */
+#define NULL_PACKET_BATCH 16
+
 /* NOTE: 4 bytes must be left at the end for the crc32 */
 static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
 {
-    MpegTSWrite *ts = ((AVFormatContext*)s->opaque)->priv_data;
     unsigned int crc;
-    unsigned char packet[TS_PACKET_SIZE];
+    unsigned char *packet;
     const unsigned char *buf_ptr;
     unsigned char *q;
-    int first, b, len1, left;
+    int first, b, len1, left, nb_packets, n = 0;
 
     crc = av_bswap32(av_crc(av_crc_get_table(AV_CRC_32_IEEE), -1, buf, len - 4));
     buf[len - 4] = (crc >> 24) & 0xff;
@@ -82,10 +87,21 @@ static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
     buf[len - 2] = (crc >> 8) & 0xff;
     buf[len - 1] = (crc) & 0xff;
 
+    /* Keep the packets, the section can then be retransmitted by only
+     * updating the continuity counters. */
+    nb_packets = (len + 1 + TS_PACKET_SIZE - 5) / (TS_PACKET_SIZE - 4);
+    if (nb_packets > s->nb_packets) {
+        av_free(s->packets);
+        s->packets = av_malloc(nb_packets * TS_PACKET_SIZE);
+    }
+    s->nb_packets = s->packets ? nb_packets : 0;
+
     /* send each packet */
     buf_ptr = buf;
     while (len > 0) {
+        unsigned char tmp[TS_PACKET_SIZE];
         first = (buf == buf_ptr);
+        packet = s->packets ? s->packets + n++ * TS_PACKET_SIZE : tmp;
         q = packet;
         *q++ = 0x47;
         b = (s->pid >> 8);
@@ -148,6 +164,24 @@ static int mpegts_write_section1(MpegTSSection *s, int tid, int id,
     return 0;
 }
 
+/**
+ * Write the packets of the last section written again, as the tables
+ * don't change while muxing.
+ * @return 0 if there is no section to retransmit
+ */
+static int mpegts_resend_section(MpegTSSection *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_packets; i++) {
+        uint8_t *packet = s->packets + i * TS_PACKET_SIZE;
+        s->cc = (s->cc + 1) & 0xf;
+        packet[3] = 0x10 | s->cc;
+        s->write_packet(s, packet);
+    }
+    return s->nb_packets;
+}
+
 /*********************************************/
 /* mpegts writer */
 
@@ -482,6 +516,17 @@ static int mpegts_write_header(AVFormatContext *s)
     ts->mux_rate = s->mux_rate ? s->mux_rate : 1;
 
     if (ts->mux_rate > 1) {
+        ts->null_packets = av_malloc(NULL_PACKET_BATCH * TS_PACKET_SIZE);
+        if (!ts->null_packets)
+            return AVERROR(ENOMEM);
+        for (i = 0; i < NULL_PACKET_BATCH; i++) {
+            uint8_t *q = ts->null_packets + i * TS_PACKET_SIZE;
+            q[0] = 0x47;
+            q[1] = 0x00 | 0x1f;
+            q[2] = 0xff;
+            q[3] = 0x10;
+            memset(q + 4, 0xff, TS_PACKET_SIZE - 4);
+        }
         service->pcr_packet_period = (ts->mux_rate * PCR_RETRANS_TIME) /
             (TS_PACKET_SIZE * 8 * 1000);
         ts->sdt_packet_period      = (ts->mux_rate * SDT_RETRANS_TIME) /
@@ -545,13 +590,16 @@ static void retransmit_si_info(AVFormatContext *s)
 
     if (++ts->sdt_packet_count == ts->sdt_packet_period) {
         ts->sdt_packet_count = 0;
-        mpegts_write_sdt(s);
+        if (!mpegts_resend_section(&ts->sdt))
+            mpegts_write_sdt(s);
     }
     if (++ts->pat_packet_count == ts->pat_packet_period) {
         ts->pat_packet_count = 0;
-        mpegts_write_pat(s);
+        if (!mpegts_resend_section(&ts->pat))
+            mpegts_write_pat(s);
         for(i = 0; i < ts->nb_services; i++) {
-            mpegts_write_pmt(s, ts->services[i]);
+            if (!mpegts_resend_section(&ts->services[i]->pmt))
+                mpegts_write_pmt(s, ts->services[i]);
         }
     }
 }
@@ -576,20 +624,59 @@ static uint8_t* write_pcr_bits(uint8_t *buf, int64_t pcr)
     return buf;
 }
 
-/* Write a single null transport stream packet */
-static void mpegts_insert_null_packet(AVFormatContext *s)
+/* Write nb null transport stream packets */
+static void mpegts_insert_null_packets(AVFormatContext *s, int nb)
 {
     MpegTSWrite *ts = s->priv_data;
-    uint8_t *q;
-    uint8_t buf[TS_PACKET_SIZE];
 
-    q = buf;
-    *q++ = 0x47;
-    *q++ = 0x00 | 0x1f;
-    *q++ = 0xff;
-    *q++ = 0x10;
-    memset(q, 0x0FF, TS_PACKET_SIZE - (q - buf));
-    put_buffer(s->pb, buf, TS_PACKET_SIZE);
+    while (nb > 0) {
+        int n = FFMIN(nb, NULL_PACKET_BATCH);
+        put_buffer(s->pb, ts->null_packets, n * TS_PACKET_SIZE);
+        nb -= n;
+    }
+}
+
+/**
+ * Return whether stuffing is needed before a packet written at byte
+ * position pos, to keep a PES with the given dts from being sent too early.
+ */
+static inline int need_stuffing(const MpegTSWrite *ts, int64_t pos,
+                                int64_t dts, int64_t delay)
+{
+    return dts - (av_rescale(pos + 11, 8 * PCR_TIME_BASE, ts->mux_rate) +
+                  ts->first_pcr) / 300 > delay;
+}
+
+/**
+ * Count how many more null packets can follow one at position pos without
+ * reaching the PES dts. Each of them counts towards the SI and PCR periods
+ * like any other packet, so stop short of the next retransmission.
+ */
+static int count_null_packets(AVFormatContext *s, MpegTSWriteStream *ts_st,
+                              int64_t pos, int64_t dts, int64_t delay)
+{
+    MpegTSWrite *ts = s->priv_data;
+    MpegTSService *service = ts_st->service;
+    int64_t n, max;
+
+    max = FFMIN(ts->sdt_packet_period - ts->sdt_packet_count,
+                ts->pat_packet_period - ts->pat_packet_count) - 1;
+    if (ts_st->pid == service->pcr_pid)
+        max = FFMIN(max, service->pcr_packet_period -
+                         service->pcr_packet_count - 1);
+    if (max <= 0)
+        return 0;
+
+    /* estimate from the byte position where the PCR reaches dts - delay,
+     * then correct for rounding */
+    n = av_rescale((dts - delay) * 300 - ts->first_pcr, ts->mux_rate,
+                   8 * PCR_TIME_BASE) - 11 - pos;
+    n = FFMAX(FFMIN(n / TS_PACKET_SIZE, max), 0);
+    while (n > 0 && !need_stuffing(ts, pos + (n - 1) * TS_PACKET_SIZE, dts, delay))
+        n--;
+    while (n < max && need_stuffing(ts, pos + n * TS_PACKET_SIZE, dts, delay))
+        n++;
+    return n;
 }
 
 /* Write a single transport stream packet with a PCR and no payload */
@@ -665,12 +752,21 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         }
 
         if (ts->mux_rate > 1 && dts != AV_NOPTS_VALUE &&
-            (dts - get_pcr(ts, s->pb)/300) > delay) {
+            need_stuffing(ts, url_ftell(s->pb), dts, delay)) {
             /* pcr insert gets priority over null packet insert */
-            if (write_pcr)
+            if (write_pcr) {
                 mpegts_insert_pcr_only(s, st);
-            else
-                mpegts_insert_null_packet(s);
+            } else {
+                /* write a run of null packets at once, as long as nothing
+                 * else is due */
+                int n = count_null_packets(s, ts_st, url_ftell(s->pb) + TS_PACKET_SIZE,
+                                           dts, delay);
+                ts->sdt_packet_count += n;
+                ts->pat_packet_count += n;
+                if (ts_st->pid == ts_st->service->pcr_pid)
+                    ts_st->service->pcr_packet_count += n;
+                mpegts_insert_null_packets(s, n + 1);
+            }
             continue; /* recalculate write_pcr and possibly retransmit si_info */
         }
 
@@ -937,11 +1033,15 @@ static int mpegts_write_end(AVFormatContext *s)
 
     for(i = 0; i < ts->nb_services; i++) {
         service = ts->services[i];
+        av_freep(&service->pmt.packets);
         av_freep(&service->provider_name);
         av_freep(&service->name);
         av_free(service);
     }
     av_free(ts->services);
+    av_freep(&ts->pat.packets);
+    av_freep(&ts->sdt.packets);
+    av_freep(&ts->null_packets);
 
     return 0;
 }
@@ -36,6 +36,7 @@
 #include <time.h>
 
 #include "libavutil/random_seed.h"
+#include "libavutil/slab.h"
 #include "libavcodec/bytestream.h"
 #include "audiointerleave.h"
 #include "avformat.h"
@@ -1835,7 +1836,7 @@ static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket
                 if(s->streams[pktl->pkt.stream_index]->last_in_packet_buffer == pktl)
                     s->streams[pktl->pkt.stream_index]->last_in_packet_buffer= NULL;
                 av_free_packet(&pktl->pkt);
-                av_freep(&pktl);
+                ff_slab_freep(&pktl);
                 pktl = next;
             }
             if (last)
@@ -1855,7 +1856,7 @@ static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket
             s->streams[pktl->pkt.stream_index]->last_in_packet_buffer= NULL;
         if(!s->packet_buffer)
             s->packet_buffer_end= NULL;
-        av_freep(&pktl);
+        ff_slab_freep(&pktl);
         return 1;
     } else {
     out:
@@ -30,6 +30,9 @@
 #define ff_neterrno() (-WSAGetLastError())
 #define FF_NETERROR(err) (-WSA##err)
 #define WSAEAGAIN WSAEWOULDBLOCK
+#ifndef SHUT_RDWR
+#define SHUT_RDWR SD_BOTH
+#endif
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
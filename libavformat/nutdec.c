@@ -155,6 +155,12 @@ static int64_t find_startcode(ByteIOContext *bc, uint64_t code, int64_t pos){
     }
 }
 
+/* the ID string followed by the main startcode */
+static const AVProbeSignature nut_signatures[] = {
+    { 0, sizeof(ID_STRING) + 7, ID_STRING "NM\x7A\x56\x1F\x5F\x04\xAD" },
+    { 0 }
+};
+
 static int nut_probe(AVProbeData *p){
     int i;
     uint64_t code= 0;
@@ -937,5 +943,6 @@ AVInputFormat nut_demuxer = {
     read_seek,
     .extensions = "nut",
     .codec_tag = (const AVCodecTag * const []) { ff_codec_bmp_tags, ff_nut_video_tags, ff_codec_wav_tags, ff_nut_subtitle_tags, 0 },
+    .signatures = nut_signatures,
 };
 #endif
@@ -638,6 +638,11 @@ static int ogg_read_seek(AVFormatContext *s, int stream_index, int64_t timestamp
     return ret;
 }
 
+static const AVProbeSignature ogg_signatures[] = {
+    { 0, 6, "OggS\0\0", "\xff\xff\xff\xff\xff\xf8" },
+    { 0 }
+};
+
 static int ogg_probe(AVProbeData *p)
 {
     if (p->buf[0] == 'O' && p->buf[1] == 'g' &&
@@ -660,4 +665,5 @@ AVInputFormat ogg_demuxer = {
     ogg_read_timestamp,
     .extensions = "ogg",
     .flags = AVFMT_GENERIC_INDEX,
+    .signatures = ogg_signatures,
 };
@@ -879,6 +879,12 @@ static int rm_read_close(AVFormatContext *s)
     return 0;
 }
 
+static const AVProbeSignature rm_signatures[] = {
+    { 0, 6, ".RMF\0\0" },
+    { 0, 4, ".ra\xfd" },
+    { 0 }
+};
+
 static int rm_probe(AVProbeData *p)
 {
     /* check file header */
@@ -945,6 +951,7 @@ AVInputFormat rm_demuxer = {
     rm_read_close,
     NULL,
     rm_read_dts,
+    .signatures = rm_signatures,
 };
 
 AVInputFormat rdt_demuxer = {
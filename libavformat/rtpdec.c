@@ -603,13 +603,21 @@ static void enqueue_packet(RTPDemuxContext *s, uint8_t *buf, int len)
         int16_t diff = seq - cur->seq;
         if (diff < 0)
             break;
+        if (!diff) {
+            /* Already queued, drop the duplicate */
+            s->nb_duplicate++;
+            av_free(buf);
+            return;
+        }
         prev = cur;
         cur = cur->next;
     }
 
     packet = av_mallocz(sizeof(*packet));
-    if (!packet)
+    if (!packet) {
+        av_free(buf);
         return;
+    }
     packet->recvtime = av_gettime();
     packet->seq = seq;
     packet->len = len;
@@ -640,9 +648,12 @@ static int rtp_parse_queued_packet(RTPDemuxContext *s, AVPacket *pkt)
     if (s->queue_len <= 0)
         return -1;
 
-    if (!has_next_packet(s))
+    if (!has_next_packet(s)) {
+        uint16_t missed = s->queue->seq - s->seq - 1;
         av_log(s->st ? s->st->codec : NULL, AV_LOG_WARNING,
-               "RTP: missed %d packets\n", s->queue->seq - s->seq - 1);
+               "RTP: missed %d packets\n", missed);
+        s->nb_missed += missed;
+    }
 
     /* Parse the first packet in the queue, and dequeue it */
     rv = rtp_parse_packet_internal(s, pkt, s->queue->buf, s->queue->len);
@@ -712,6 +723,7 @@ static int rtp_parse_one_packet(RTPDemuxContext *s, AVPacket *pkt,
             /* Packet older than the previously emitted one, drop */
             av_log(s->st ? s->st->codec : NULL, AV_LOG_WARNING,
                    "RTP: dropping old packet received too late\n");
+            s->nb_late++;
             return -1;
         } else if (diff <= 1) {
             /* Correct packet */
@@ -751,6 +763,10 @@ int rtp_parse_packet(RTPDemuxContext *s, AVPacket *pkt,
 
 void rtp_parse_close(RTPDemuxContext *s)
 {
+    if (s->queue_size > 1)
+        av_log(s->st ? s->st->codec : NULL, AV_LOG_VERBOSE,
+               "RTP: reordering queue: %u packets missed, %u late, %u duplicate\n",
+               s->nb_missed, s->nb_late, s->nb_duplicate);
     ff_rtp_reset_packet_queue(s);
     if (!strcmp(ff_rtp_enc_name(s->payload_type), "MP2T")) {
         ff_mpegts_parse_close(s->ts);
@@ -166,6 +166,9 @@ struct RTPDemuxContext {
     RTPPacket* queue; ///< A sorted queue of buffered packets not yet returned
     int queue_len;    ///< The number of packets in queue
     int queue_size;   ///< The size of queue, or 0 if reordering is disabled
+    unsigned int nb_missed;    ///< Packets never received before their successors were returned
+    unsigned int nb_late;      ///< Packets dropped because they arrived after their successors were returned
+    unsigned int nb_duplicate; ///< Packets dropped because they were already queued
     /*@}*/
 
     /* rtcp sender statistics receive */
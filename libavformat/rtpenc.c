@@ -23,6 +23,7 @@
 #include "mpegts.h"
 #include "internal.h"
 #include "libavutil/random_seed.h"
+#include "libavutil/intreadwrite.h"
 
 #include "rtpenc.h"
 
@@ -100,6 +101,11 @@ static int rtp_write_header(AVFormatContext *s1)
     if (s->buf == NULL) {
         return AVERROR(ENOMEM);
     }
+    s->batch_buf = av_malloc(RTP_MAX_BATCH * max_packet_size);
+    if (!s->batch_buf) {
+        av_freep(&s->buf);
+        return AVERROR(ENOMEM);
+    }
     s->max_payload_size = max_packet_size - 12;
 
     s->max_frames_per_packet = 0;
@@ -186,6 +192,17 @@ defaultcase:
     return 0;
 }
 
+/* write out the RTP packets collected by ff_rtp_send_data() */
+static void rtp_flush_batch(AVFormatContext *s1)
+{
+    RTPMuxContext *s = s1->priv_data;
+
+    if (s->batch_count) {
+        ff_put_packets(s1->pb, s->batch_data, s->batch_size, s->batch_count);
+        s->batch_count = 0;
+    }
+}
+
 /* send an rtcp sender report packet */
 static void rtcp_send_sr(AVFormatContext *s1, int64_t ntp_time)
 {
@@ -214,18 +231,36 @@ static void rtcp_send_sr(AVFormatContext *s1, int64_t ntp_time)
 void ff_rtp_send_data(AVFormatContext *s1, const uint8_t *buf1, int len, int m)
 {
     RTPMuxContext *s = s1->priv_data;
+    uint8_t *p;
 
     dprintf(s1, "rtp_send_data size=%d\n", len);
 
-    /* build the RTP header */
-    put_byte(s1->pb, (RTP_VERSION << 6));
-    put_byte(s1->pb, (s->payload_type & 0x7f) | ((m & 0x01) << 7));
-    put_be16(s1->pb, s->seq);
-    put_be32(s1->pb, s->timestamp);
-    put_be32(s1->pb, s->ssrc);
-
-    put_buffer(s1->pb, buf1, len);
-    put_flush_packet(s1->pb);
+    if (s->batch_count == RTP_MAX_BATCH || len > s->max_payload_size)
+        rtp_flush_batch(s1);
+
+    if (len > s->max_payload_size) {
+        /* does not fit in a batch slot, let url_write() deal with it */
+        put_byte(s1->pb, (RTP_VERSION << 6));
+        put_byte(s1->pb, (s->payload_type & 0x7f) | ((m & 0x01) << 7));
+        put_be16(s1->pb, s->seq);
+        put_be32(s1->pb, s->timestamp);
+        put_be32(s1->pb, s->ssrc);
+        put_buffer(s1->pb, buf1, len);
+        put_flush_packet(s1->pb);
+    } else {
+        /* build the RTP packet in the next batch slot */
+        p = s->batch_buf + s->batch_count * (s->max_payload_size + 12);
+        p[0] = RTP_VERSION << 6;
+        p[1] = (s->payload_type & 0x7f) | ((m & 0x01) << 7);
+        AV_WB16(p + 2, s->seq);
+        AV_WB32(p + 4, s->timestamp);
+        AV_WB32(p + 8, s->ssrc);
+        memcpy(p + 12, buf1, len);
+
+        s->batch_data[s->batch_count] = p;
+        s->batch_size[s->batch_count] = len + 12;
+        s->batch_count++;
+    }
 
     s->seq++;
     s->octet_count += len;
@@ -432,6 +467,7 @@ static int rtp_write_packet(AVFormatContext *s1, AVPacket *pkt)
         rtp_send_raw(s1, pkt->data, size);
         break;
     }
+    rtp_flush_batch(s1);
     return 0;
 }
 
@@ -440,6 +476,7 @@ static int rtp_write_trailer(AVFormatContext *s1)
     RTPMuxContext *s = s1->priv_data;
 
     av_freep(&s->buf);
+    av_freep(&s->batch_buf);
 
     return 0;
 }
@@ -24,6 +24,9 @@
 #include "avformat.h"
 #include "rtp.h"
 
+/** maximum number of RTP packets collected before they are written out */
+#define RTP_MAX_BATCH 32
+
 struct RTPMuxContext {
     AVFormatContext *ic;
     AVStream *st;
@@ -56,6 +59,15 @@ struct RTPMuxContext {
      * (1, 2 or 4)
      */
     int nal_length_size;
+
+    /**
+     * RTP packets built by ff_rtp_send_data() for the current frame,
+     * written out together at the end of each write_packet() call
+     */
+    uint8_t *batch_buf;
+    const uint8_t *batch_data[RTP_MAX_BATCH];
+    int batch_size[RTP_MAX_BATCH];
+    int batch_count;
 };
 
 typedef struct RTPMuxContext RTPMuxContext;
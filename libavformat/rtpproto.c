@@ -314,6 +314,27 @@ static int rtp_write(URLContext *h, const uint8_t *buf, int size)
     return ret;
 }
 
+static int rtp_write_batch(URLContext *h, const uint8_t * const *bufs,
+                           const int *sizes, int nb)
+{
+    RTPContext *s = h->priv_data;
+    int i, ret;
+
+    for (i = 0; i < nb; i++)
+        if (bufs[i][1] >= RTCP_SR && bufs[i][1] <= RTCP_APP)
+            break;
+    if (i == nb)
+        return ff_url_write_batch(s->rtp_hd, bufs, sizes, nb);
+
+    /* RTCP packets go to another socket, keep the packet order */
+    for (i = 0; i < nb; i++) {
+        ret = rtp_write(h, bufs[i], sizes[i]);
+        if (ret < 0)
+            return i ? i : ret;
+    }
+    return nb;
+}
+
 static int rtp_close(URLContext *h)
 {
     RTPContext *s = h->priv_data;
@@ -367,4 +388,5 @@ URLProtocol rtp_protocol = {
     NULL, /* seek */
     rtp_close,
     .url_get_file_handle = rtp_get_file_handle,
+    .url_write_batch     = rtp_write_batch,
 };
@@ -313,6 +313,11 @@ typedef struct RTSPState {
     /** Filter incoming UDP packets - receive packets only from the right
      * source address and port. */
     int filter_source;
+
+    /** Maximum number of packets held in the RTP reordering queue of each
+     * stream, or 0 for the default. Packets leave the queue after at most
+     * AVFormatContext.max_delay anyway. */
+    int reorder_queue_size;
 } RTSPState;
 
 /**
@@ -22,6 +22,7 @@
 
 #include "seek.h"
 #include "libavutil/mem.h"
+#include "libavutil/slab.h"
 #include "internal.h"
 
 // NOTE: implementation should be moved here in another patch, to keep patches
@@ -490,7 +491,7 @@ static void free_packet_list(AVPacketList *pktl)
         cur = pktl;
         pktl = cur->next;
         av_free_packet(&cur->pkt);
-        av_free(cur);
+        ff_slab_free(cur);
     }
 }
 
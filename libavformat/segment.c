@@ -0,0 +1,321 @@
+/*
+ * Generic segmenting muxer
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Segmenting muxer: splits the output into files of roughly equal duration,
+ * cut on keyframes, each written by a chained muxer, and optionally lists
+ * them in an m3u8 playlist or a CSV file.
+ */
+
+#include <float.h>
+#include <math.h>
+#include "libavutil/avstring.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/opt.h"
+#include "avformat.h"
+#include "internal.h"
+
+struct segment_entry {
+    char filename[1024];
+    double duration;
+};
+
+typedef struct {
+    const AVClass *class;
+    AVFormatContext *avf;       ///< chained muxer writing the current segment
+    char *format;               ///< name of the chained muxer
+    char *list;                 ///< name of the index file
+    float time;                 ///< target segment duration in seconds
+    int list_size;              ///< maximum number of playlist entries, 0 for all
+    int wrap;                   ///< number after which the segment number wraps
+    int is_csv;
+    int has_video;
+    int number;                 ///< number of the current segment
+    int sequence;               ///< number of the first segment in the playlist
+    int64_t start_time;         ///< start time of the current segment, AV_TIME_BASE
+    int64_t end_time;           ///< end time of the last packet written, AV_TIME_BASE
+    int64_t first_time;
+    ByteIOContext *list_pb;
+    struct segment_entry **entries;
+    int nb_entries;
+} SegmentContext;
+
+static int segment_start(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    AVFormatContext *oc = seg->avf;
+    int ret;
+
+    if (av_get_frame_filename(oc->filename, sizeof(oc->filename), s->filename,
+                              seg->wrap ? seg->number % seg->wrap : seg->number) < 0) {
+        av_log(s, AV_LOG_ERROR, "Invalid segment filename template '%s'\n",
+               s->filename);
+        return AVERROR(EINVAL);
+    }
+    if ((ret = url_fopen(&oc->pb, oc->filename, URL_WRONLY)) < 0) {
+        av_log(s, AV_LOG_ERROR, "Could not open '%s'\n", oc->filename);
+        return ret;
+    }
+    if ((ret = av_write_header(oc)) < 0) {
+        url_fclose(oc->pb);
+        oc->pb = NULL;
+    }
+    return ret;
+}
+
+static int write_m3u8(AVFormatContext *s, int last)
+{
+    SegmentContext *seg = s->priv_data;
+    ByteIOContext *pb;
+    int i, ret, target = 0;
+
+    for (i = 0; i < seg->nb_entries; i++)
+        target = FFMAX(target, (int)ceil(seg->entries[i]->duration));
+
+    if ((ret = url_fopen(&pb, seg->list, URL_WRONLY)) < 0)
+        return ret;
+    url_fprintf(pb, "#EXTM3U\n");
+    url_fprintf(pb, "#EXT-X-TARGETDURATION:%d\n", target);
+    url_fprintf(pb, "#EXT-X-MEDIA-SEQUENCE:%d\n", seg->sequence);
+    for (i = 0; i < seg->nb_entries; i++) {
+        url_fprintf(pb, "#EXTINF:%d,\n", (int)(seg->entries[i]->duration + 0.5));
+        url_fprintf(pb, "%s\n", seg->entries[i]->filename);
+    }
+    if (last)
+        url_fprintf(pb, "#EXT-X-ENDLIST\n");
+    put_flush_packet(pb);
+    url_fclose(pb);
+    return 0;
+}
+
+/**
+ * Finish the current segment and add it to the index.
+ */
+static int segment_end(AVFormatContext *s, int last)
+{
+    SegmentContext *seg = s->priv_data;
+    AVFormatContext *oc = seg->avf;
+    struct segment_entry *entry;
+    const char *name;
+    int ret;
+
+    ret = av_write_trailer(oc);
+    url_fclose(oc->pb);
+    oc->pb = NULL;
+    if (ret < 0)
+        return ret;
+    if (!seg->list)
+        return 0;
+
+    /* the index refers to the segments relative to its own location */
+    name = strrchr(oc->filename, '/');
+    name = name ? name + 1 : oc->filename;
+    if (seg->is_csv) {
+        url_fprintf(seg->list_pb, "%s,%f,%f\n", name,
+                    (seg->start_time - seg->first_time) / (double)AV_TIME_BASE,
+                    (seg->end_time   - seg->first_time) / (double)AV_TIME_BASE);
+        put_flush_packet(seg->list_pb);
+        return 0;
+    }
+
+    entry = av_mallocz(sizeof(*entry));
+    if (!entry)
+        return AVERROR(ENOMEM);
+    av_strlcpy(entry->filename, name, sizeof(entry->filename));
+    entry->duration   = (seg->end_time - seg->start_time) / (double)AV_TIME_BASE;
+    dynarray_add(&seg->entries, &seg->nb_entries, entry);
+    /* only the entries still listed in the playlist need to be kept */
+    if (seg->list_size && seg->nb_entries > seg->list_size) {
+        av_free(seg->entries[0]);
+        memmove(seg->entries, seg->entries + 1,
+                --seg->nb_entries * sizeof(*seg->entries));
+        seg->sequence++;
+    }
+    return write_m3u8(s, last);
+}
+
+static void free_segment_context(SegmentContext *seg)
+{
+    int i;
+
+    if (seg->avf) {
+        for (i = 0; i < seg->avf->nb_streams; i++) {
+            /* the codec contexts belong to the outer muxer */
+            AVStream *st = seg->avf->streams[i];
+            av_metadata_free(&st->metadata);
+            av_free(st->index_entries);
+            av_free(st->priv_data);
+            av_free(st->info);
+            av_free(st);
+        }
+        av_metadata_free(&seg->avf->metadata);
+        av_freep(&seg->avf);
+    }
+    if (seg->list_pb)
+        url_fclose(seg->list_pb);
+    seg->list_pb = NULL;
+    for (i = 0; i < seg->nb_entries; i++)
+        av_free(seg->entries[i]);
+    av_freep(&seg->entries);
+    seg->nb_entries = 0;
+}
+
+static int seg_write_header(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    AVFormatContext *oc;
+    AVOutputFormat *fmt;
+    int ret, i;
+
+    if (seg->format)
+        fmt = av_guess_format(seg->format, NULL, NULL);
+    else
+        fmt = av_guess_format(NULL, s->filename, NULL);
+    if (!fmt || fmt->flags & AVFMT_NOFILE) {
+        av_log(s, AV_LOG_ERROR, "Unable to find a suitable segment format\n");
+        return AVERROR(EINVAL);
+    }
+
+    oc = seg->avf = avformat_alloc_context();
+    if (!oc)
+        return AVERROR(ENOMEM);
+    oc->oformat = fmt;
+    oc->max_delay = s->max_delay;
+    av_metadata_copy(&oc->metadata, s->metadata, 0);
+
+    /* The chained muxer uses the codec contexts of our own streams, like
+     * the rtp chain muxer does. */
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i], *ost = av_new_stream(oc, 0);
+        if (!ost) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        av_free(ost->codec);
+        ost->codec = st->codec;
+        ost->sample_aspect_ratio = st->sample_aspect_ratio;
+        av_metadata_copy(&ost->metadata, st->metadata, 0);
+        if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+            seg->has_video = 1;
+    }
+
+    if (seg->list) {
+        seg->is_csv = av_match_ext(seg->list, "csv");
+        if (seg->is_csv &&
+            (ret = url_fopen(&seg->list_pb, seg->list, URL_WRONLY)) < 0)
+            goto fail;
+    }
+
+    seg->start_time = AV_NOPTS_VALUE;
+    if ((ret = segment_start(s)) < 0)
+        goto fail;
+
+    /* The packets are passed on unchanged, so use the time bases the chained
+     * muxer has chosen. */
+    for (i = 0; i < s->nb_streams; i++)
+        av_set_pts_info(s->streams[i], 64, oc->streams[i]->time_base.num,
+                        oc->streams[i]->time_base.den);
+    return 0;
+fail:
+    free_segment_context(seg);
+    return ret;
+}
+
+static int seg_write_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    SegmentContext *seg = s->priv_data;
+    AVStream *st = s->streams[pkt->stream_index];
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    int ret;
+
+    if (ts != AV_NOPTS_VALUE)
+        ts = av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q);
+    if (seg->start_time == AV_NOPTS_VALUE && ts != AV_NOPTS_VALUE) {
+        seg->start_time = seg->first_time = ts;
+        seg->end_time   = ts;
+    }
+
+    /* Cut on video keyframes if there is video, on any packet otherwise,
+     * once the time for the next segment boundary has been reached. The
+     * boundaries are multiples of the target duration from the start, so
+     * the cuts don't drift. */
+    if (ts != AV_NOPTS_VALUE &&
+        (!seg->has_video || (st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+                             pkt->flags & AV_PKT_FLAG_KEY)) &&
+        ts - seg->first_time >= (seg->number + 1) * seg->time * AV_TIME_BASE) {
+        if ((ret = segment_end(s, 0)) < 0)
+            return ret;
+        seg->number++;
+        seg->start_time = ts;
+        if ((ret = segment_start(s)) < 0)
+            return ret;
+    }
+
+    if (ts != AV_NOPTS_VALUE)
+        seg->end_time = FFMAX(seg->end_time, ts +
+                              av_rescale_q(pkt->duration, st->time_base,
+                                           AV_TIME_BASE_Q));
+    return av_write_frame(seg->avf, pkt);
+}
+
+static int seg_write_trailer(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret = 0;
+
+    if (seg->avf && seg->avf->pb)
+        ret = segment_end(s, 1);
+    free_segment_context(seg);
+    av_freep(&seg->format);
+    av_freep(&seg->list);
+    return ret;
+}
+
+#define OFFSET(x) offsetof(SegmentContext, x)
+#define E AV_OPT_FLAG_ENCODING_PARAM
+static const AVOption options[] = {
+    { "segment_format",    "format of the segments, guessed from the file name by default", OFFSET(format), FF_OPT_TYPE_STRING, 0, 0, 0, E },
+    { "segment_time",      "target segment duration in seconds", OFFSET(time), FF_OPT_TYPE_FLOAT, 2, 0, FLT_MAX, E },
+    { "segment_list",      "write an index of the segments, a CSV file if the name ends in .csv, an m3u8 playlist otherwise", OFFSET(list), FF_OPT_TYPE_STRING, 0, 0, 0, E },
+    { "segment_list_size", "maximum number of playlist entries, 0 to list all segments", OFFSET(list_size), FF_OPT_TYPE_INT, 0, 0, INT_MAX, E },
+    { "segment_wrap",      "number after which the segment number wraps around, 0 to never wrap", OFFSET(wrap), FF_OPT_TYPE_INT, 0, 0, INT_MAX, E },
+    { NULL },
+};
+
+static const AVClass seg_class = {
+    "segment muxer", av_default_item_name, options, LIBAVUTIL_VERSION_INT
+};
+
+AVOutputFormat segment_muxer = {
+    "segment",
+    NULL_IF_CONFIG_SMALL("segment muxer"),
+    NULL,
+    NULL,
+    sizeof(SegmentContext),
+    CODEC_ID_MP2,
+    CODEC_ID_MPEG2VIDEO,
+    seg_write_header,
+    seg_write_packet,
+    seg_write_trailer,
+    .flags = AVFMT_NOFILE | AVFMT_NEEDNUMBER,
+    .priv_class = &seg_class,
+};
@@ -26,11 +26,17 @@
 
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
 #define _DARWIN_C_SOURCE /* Needed for using IP_MULTICAST_TTL on OS X */
+#define _GNU_SOURCE     /* Needed for recvmmsg(), sendmmsg() and struct mmsghdr */
 #include "avformat.h"
 #include <unistd.h>
+#include "libavutil/fifo.h"
+#include "libavutil/intreadwrite.h"
 #include "internal.h"
 #include "network.h"
 #include "os_support.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 #if HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
@@ -51,10 +57,25 @@ typedef struct {
     struct sockaddr_storage dest_addr;
     int dest_addr_len;
     int is_connected;
+
+    /* receiver thread and datagram ring, used if fifo_size is set */
+    int fifo_size;
+    int overrun_nonfatal;
+    AVFifoSPSC *fifo;
+    int fifo_error;      ///< error reported by the receiver thread, or 0
+    unsigned overruns;   ///< number of datagrams dropped because the ring was full
+    uint8_t fifo_tmp[4];
+#if HAVE_PTHREADS
+    pthread_t receiver;
+    int thread_started;
+    volatile int close_req;
+#endif
 } UDPContext;
 
 #define UDP_TX_BUF_SIZE 32768
 #define UDP_MAX_PKT_SIZE 65536
+#define UDP_RX_BATCH 8  ///< datagrams fetched per recvmmsg() call by the receiver thread
+#define UDP_TX_BATCH 32 ///< datagrams passed per sendmmsg() call
 
 static int udp_set_multicast_ttl(int sockfd, int mcastTTL,
                                  struct sockaddr *addr)
@@ -301,6 +322,145 @@ int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if HAVE_PTHREADS
+/**
+ * Store one received datagram, prefixed by its length, in the ring.
+ * @param buf the datagram, preceded by 4 bytes of room for its length
+ * @return 0 on success, <0 on a fatal overrun
+ */
+static int udp_fifo_put(URLContext *h, uint8_t *buf, int len)
+{
+    UDPContext *s = h->priv_data;
+
+    if (av_fifo_spsc_space(s->fifo) < len + 4) {
+        if (!s->overruns++)
+            av_log(NULL, AV_LOG_WARNING, "UDP fifo overrun, datagrams are being dropped\n");
+        if (!s->overrun_nonfatal) {
+            av_log(NULL, AV_LOG_ERROR,
+                   "UDP fifo overrun, increase fifo_size or set overrun_nonfatal=1\n");
+            return AVERROR(EIO);
+        }
+        return 0;
+    }
+    AV_WL32(buf - 4, len);
+    av_fifo_spsc_write(s->fifo, buf - 4, len + 4, 0);
+    return 0;
+}
+
+/**
+ * Drain the socket into the ring so that stalls in the reading thread
+ * do not overflow the kernel socket buffer.
+ */
+static void *udp_receiver_thread(void *arg)
+{
+    URLContext *h = arg;
+    UDPContext *s = h->priv_data;
+    uint8_t *buf;
+    int i, n, ret = 0;
+#if HAVE_RECVMMSG
+    struct mmsghdr msgs[UDP_RX_BATCH];
+    struct iovec iov[UDP_RX_BATCH];
+#endif
+
+    buf = av_malloc(UDP_RX_BATCH * (UDP_MAX_PKT_SIZE + 4));
+    if (!buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+#if HAVE_RECVMMSG
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < UDP_RX_BATCH; i++) {
+        iov[i].iov_base = buf + i * (UDP_MAX_PKT_SIZE + 4) + 4;
+        iov[i].iov_len  = UDP_MAX_PKT_SIZE;
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+
+    for (;;) {
+        fd_set rfds;
+        struct timeval tv;
+
+        if (s->close_req)
+            break;
+
+        FD_ZERO(&rfds);
+        FD_SET(s->udp_fd, &rfds);
+        tv.tv_sec  = 0;
+        tv.tv_usec = 100 * 1000;
+        n = select(s->udp_fd + 1, &rfds, NULL, NULL, &tv);
+        if (n < 0) {
+            if (ff_neterrno() == FF_NETERROR(EINTR))
+                continue;
+            ret = AVERROR(EIO);
+            break;
+        }
+        if (!(n > 0 && FD_ISSET(s->udp_fd, &rfds)))
+            continue;
+
+#if HAVE_RECVMMSG
+        n = recvmmsg(s->udp_fd, msgs, UDP_RX_BATCH, MSG_DONTWAIT, NULL);
+#else
+        n = recv(s->udp_fd, buf + 4, UDP_MAX_PKT_SIZE, 0);
+#endif
+        if (n < 0) {
+            if (ff_neterrno() != FF_NETERROR(EAGAIN) &&
+                ff_neterrno() != FF_NETERROR(EINTR)) {
+                ret = AVERROR(EIO);
+                break;
+            }
+            continue;
+        }
+
+#if HAVE_RECVMMSG
+        for (i = 0; i < n && !ret; i++)
+            ret = udp_fifo_put(h, iov[i].iov_base, msgs[i].msg_len);
+#else
+        ret = udp_fifo_put(h, buf + 4, n);
+#endif
+        if (ret < 0)
+            break;
+    }
+
+end:
+    av_free(buf);
+    s->fifo_error = ret ? ret : AVERROR_EOF;
+    av_fifo_spsc_abort(s->fifo);
+    return NULL;
+}
+
+/**
+ * Read one datagram from the ring filled by the receiver thread.
+ */
+static int udp_read_fifo(URLContext *h, uint8_t *buf, int size)
+{
+    UDPContext *s = h->priv_data;
+    int len, ret;
+
+    for (;;) {
+        ret = av_fifo_spsc_wait_size(s->fifo, 4, 100 * 1000);
+        if (ret >= 0) {
+            /* the receiver thread adds a datagram with its length at once */
+            av_fifo_spsc_read(s->fifo, s->fifo_tmp, 4, 0);
+            len = AV_RL32(s->fifo_tmp);
+            ret = FFMIN(len, size);
+            av_fifo_spsc_read(s->fifo, buf, ret, 0);
+            av_fifo_spsc_read(s->fifo, NULL, len - ret, 0);
+            break;
+        }
+        if (ret == AVERROR_EOF) {
+            ret = s->fifo_error == AVERROR_EOF ? AVERROR(EIO) : s->fifo_error;
+            break;
+        }
+        if (url_interrupt_cb()) {
+            ret = AVERROR(EINTR);
+            break;
+        }
+    }
+    return ret;
+}
+#endif
+
 /* put it in UDP context */
 /* return non zero if error */
 static int udp_open(URLContext *h, const char *uri, int flags)
@@ -345,6 +505,12 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         if (find_info_tag(buf, sizeof(buf), "connect", p)) {
             s->is_connected = strtol(buf, NULL, 10);
         }
+        if (find_info_tag(buf, sizeof(buf), "fifo_size", p)) {
+            s->fifo_size = strtol(buf, NULL, 10) * 188;
+        }
+        if (find_info_tag(buf, sizeof(buf), "overrun_nonfatal", p)) {
+            s->overrun_nonfatal = strtol(buf, NULL, 10);
+        }
     }
 
     /* fill the dest addr */
@@ -421,10 +587,25 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     }
 
     s->udp_fd = udp_fd;
+
+#if HAVE_PTHREADS
+    if (!is_output && s->fifo_size > 0) {
+        s->fifo = av_fifo_spsc_alloc(s->fifo_size);
+        if (!s->fifo)
+            goto fail;
+        if (pthread_create(&s->receiver, NULL, udp_receiver_thread, h)) {
+            av_log(NULL, AV_LOG_ERROR, "pthread_create failed\n");
+            goto fail;
+        }
+        s->thread_started = 1;
+    }
+#endif
+
     return 0;
  fail:
     if (udp_fd >= 0)
         closesocket(udp_fd);
+    av_fifo_spsc_free(s->fifo);
     av_free(s);
     return AVERROR(EIO);
 }
@@ -437,6 +618,11 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     int ret;
     struct timeval tv;
 
+#if HAVE_PTHREADS
+    if (s->fifo)
+        return udp_read_fifo(h, buf, size);
+#endif
+
     for(;;) {
         if (url_interrupt_cb())
             return AVERROR(EINTR);
@@ -487,13 +673,59 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
     return size;
 }
 
+#if HAVE_SENDMMSG
+static int udp_write_batch(URLContext *h, const uint8_t * const *bufs,
+                           const int *sizes, int nb)
+{
+    UDPContext *s = h->priv_data;
+    struct mmsghdr msgs[UDP_TX_BATCH];
+    struct iovec iov[UDP_TX_BATCH];
+    int i, n, ret, sent = 0;
+
+    while (sent < nb) {
+        n = FFMIN(nb - sent, UDP_TX_BATCH);
+        memset(msgs, 0, n * sizeof(*msgs));
+        for (i = 0; i < n; i++) {
+            /* sendmmsg() does not modify the data, iov_base just isn't const */
+            iov[i].iov_base = (void *)(intptr_t)bufs[sent + i];
+            iov[i].iov_len  = sizes[sent + i];
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (!s->is_connected) {
+                msgs[i].msg_hdr.msg_name    = &s->dest_addr;
+                msgs[i].msg_hdr.msg_namelen = s->dest_addr_len;
+            }
+        }
+        ret = sendmmsg(s->udp_fd, msgs, n, 0);
+        if (ret < 0) {
+            if (ff_neterrno() != FF_NETERROR(EINTR) &&
+                ff_neterrno() != FF_NETERROR(EAGAIN))
+                return sent ? sent : ff_neterrno();
+            continue;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+#endif
+
 static int udp_close(URLContext *h)
 {
     UDPContext *s = h->priv_data;
 
+#if HAVE_PTHREADS
+    if (s->thread_started) {
+        s->close_req = 1;
+        pthread_join(s->receiver, NULL);
+        if (s->overruns)
+            av_log(NULL, AV_LOG_WARNING, "UDP fifo: %u datagrams dropped on overrun\n",
+                   s->overruns);
+    }
+#endif
     if (s->is_multicast && !(h->flags & URL_WRONLY))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr);
     closesocket(s->udp_fd);
+    av_fifo_spsc_free(s->fifo);
     av_free(s);
     return 0;
 }
@@ -506,4 +738,7 @@ URLProtocol udp_protocol = {
     NULL, /* seek */
     udp_close,
     .url_get_file_handle = udp_get_file_handle,
+#if HAVE_SENDMMSG
+    .url_write_batch = udp_write_batch,
+#endif
 };
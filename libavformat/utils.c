@@ -25,6 +25,8 @@
 #include "metadata.h"
 #include "id3v2.h"
 #include "libavutil/avstring.h"
+#include "libavutil/profile.h"
+#include "libavutil/slab.h"
 #include "riff.h"
 #include "audiointerleave.h"
 #include <sys/time.h>
@@ -120,6 +122,21 @@ static
 #endif
 AVOutputFormat *first_oformat = NULL;
 
+#define MAX_PROBE_SIGNATURES 64
+
+/** registered probe signatures, see probe_signature_match() */
+static struct probe_signature_entry {
+    AVInputFormat *fmt;
+    const AVProbeSignature *sig;
+    struct probe_signature_entry *next;
+} probe_signatures[MAX_PROBE_SIGNATURES];
+static int nb_probe_signatures;
+/**
+ * Signatures at offset 0 whose first byte is fully compared are hashed on
+ * that byte, all others are in the last list.
+ */
+static struct probe_signature_entry *probe_signature_lists[257];
+
 AVInputFormat  *av_iformat_next(AVInputFormat  *f)
 {
     if(f) return f->next;
@@ -135,10 +152,29 @@ AVOutputFormat *av_oformat_next(AVOutputFormat *f)
 void av_register_input_format(AVInputFormat *format)
 {
     AVInputFormat **p;
+    const AVProbeSignature *sig;
+
     p = &first_iformat;
     while (*p != NULL) p = &(*p)->next;
     *p = format;
     format->next = NULL;
+
+    /* Signatures which don't fit in the table are just not used, the
+     * format is still found by its read_probe(). */
+    for (sig = format->signatures; sig && sig->size; sig++) {
+        struct probe_signature_entry *entry, **list;
+        if (nb_probe_signatures >= MAX_PROBE_SIGNATURES)
+            break;
+        if (!sig->offset && (!sig->mask || (uint8_t)sig->mask[0] == 0xff))
+            list = &probe_signature_lists[(uint8_t)sig->bytes[0]];
+        else
+            list = &probe_signature_lists[256];
+        entry = &probe_signatures[nb_probe_signatures++];
+        entry->fmt  = format;
+        entry->sig  = sig;
+        entry->next = *list;
+        *list = entry;
+    }
 }
 
 void av_register_output_format(AVOutputFormat *format)
@@ -363,7 +399,45 @@ int av_filename_number_test(const char *filename)
     return filename && (av_get_frame_filename(buf, sizeof(buf), filename, 1)>=0);
 }
 
-AVInputFormat *av_probe_input_format2(AVProbeData *pd, int is_opened, int *score_max)
+static int match_signature(const AVProbeSignature *sig, AVProbeData *pd)
+{
+    const uint8_t *buf = pd->buf + sig->offset;
+    int i;
+
+    if (sig->offset + sig->size > pd->buf_size)
+        return 0;
+    for (i = 0; i < sig->size; i++) {
+        uint8_t mask = sig->mask ? sig->mask[i] : 0xff;
+        if ((buf[i] ^ sig->bytes[i]) & mask)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Find the format whose signature matches the probe data.
+ */
+static AVInputFormat *probe_signature_match(AVProbeData *pd, int is_opened)
+{
+    struct probe_signature_entry *entry;
+    int i;
+
+    if (pd->buf_size <= 0)
+        return NULL;
+    for (i = 0; i < 2; i++) {
+        entry = probe_signature_lists[i ? 256 : pd->buf[0]];
+        for (; entry; entry = entry->next) {
+            if (!is_opened == !(entry->fmt->flags & AVFMT_NOFILE))
+                continue;
+            if (match_signature(entry->sig, pd))
+                return entry->fmt;
+        }
+    }
+    return NULL;
+}
+
+static AVInputFormat *probe_input_format(AVProbeData *pd, int is_opened,
+                                         int *score_max, AVProbeStats *stats)
 {
     AVProbeData lpd = *pd;
     AVInputFormat *fmt1 = NULL, *fmt;
@@ -377,6 +451,14 @@ AVInputFormat *av_probe_input_format2(AVProbeData *pd, int is_opened, int *score
         }
     }
 
+    if (*score_max < AVPROBE_SCORE_MAX &&
+        (fmt = probe_signature_match(&lpd, is_opened))) {
+        *score_max = AVPROBE_SCORE_MAX;
+        if (stats)
+            stats->nb_signature_matches++;
+        return fmt;
+    }
+
     fmt = NULL;
     while ((fmt1 = av_iformat_next(fmt1))) {
         if (!is_opened == !(fmt1->flags & AVFMT_NOFILE))
@@ -384,6 +466,8 @@ AVInputFormat *av_probe_input_format2(AVProbeData *pd, int is_opened, int *score
         score = 0;
         if (fmt1->read_probe) {
             score = fmt1->read_probe(&lpd);
+            if (stats)
+                stats->nb_read_probe++;
         } else if (fmt1->extensions) {
             if (av_match_ext(lpd.filename, fmt1->extensions)) {
                 score = 50;
@@ -398,6 +482,11 @@ AVInputFormat *av_probe_input_format2(AVProbeData *pd, int is_opened, int *score
     return fmt;
 }
 
+AVInputFormat *av_probe_input_format2(AVProbeData *pd, int is_opened, int *score_max)
+{
+    return probe_input_format(pd, is_opened, score_max, NULL);
+}
+
 AVInputFormat *av_probe_input_format(AVProbeData *pd, int is_opened){
     int score=0;
     return av_probe_input_format2(pd, is_opened, &score);
@@ -526,7 +615,8 @@ int av_open_input_stream(AVFormatContext **ic_ptr,
 
 int ff_probe_input_buffer(ByteIOContext **pb, AVInputFormat **fmt,
                           const char *filename, void *logctx,
-                          unsigned int offset, unsigned int max_probe_size)
+                          unsigned int offset, unsigned int max_probe_size,
+                          AVProbeStats *stats)
 {
     AVProbeData pd = { filename ? filename : "", NULL, -offset };
     unsigned char *buf = NULL;
@@ -570,7 +660,11 @@ int ff_probe_input_buffer(ByteIOContext **pb, AVInputFormat **fmt,
         memset(pd.buf + pd.buf_size, 0, AVPROBE_PADDING_SIZE);
 
         /* guess file format */
-        *fmt = av_probe_input_format2(&pd, 1, &score);
+        *fmt = probe_input_format(&pd, 1, &score, stats);
+        if (stats) {
+            stats->nb_rounds++;
+            stats->probe_size = pd.buf_size;
+        }
         if(*fmt){
             if(score <= AVPROBE_SCORE_MAX/4){ //this can only be true in the last iteration
                 av_log(logctx, AV_LOG_WARNING, "Format detected only with low score of %d, misdetection possible!\n", score);
@@ -600,6 +694,7 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
     AVProbeData probe_data, *pd = &probe_data;
     ByteIOContext *pb = NULL;
     void *logctx= ap && ap->prealloced_context ? *ic_ptr : NULL;
+    AVProbeStats stats = { 0 };
 
     pd->filename = "";
     if (filename)
@@ -622,8 +717,14 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
         if (buf_size > 0) {
             url_setbufsize(pb, buf_size);
         }
-        if (!fmt && (err = ff_probe_input_buffer(&pb, &fmt, filename, logctx, 0, logctx ? (*ic_ptr)->probesize : 0)) < 0) {
-            goto fail;
+        if (!fmt) {
+            int64_t probe_start = av_gettime();
+            err = ff_probe_input_buffer(&pb, &fmt, filename, logctx, 0,
+                                        logctx ? (*ic_ptr)->probesize : 0,
+                                        &stats);
+            stats.time = av_gettime() - probe_start;
+            if (err < 0)
+                goto fail;
         }
     }
 
@@ -643,6 +744,7 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
     err = av_open_input_stream(ic_ptr, pb, filename, fmt, ap);
     if (err)
         goto fail;
+    (*ic_ptr)->probe_stats = stats;
     return 0;
  fail:
     av_freep(&pd->buf);
@@ -659,7 +761,7 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
 
 static AVPacket *add_to_pktbuf(AVPacketList **packet_buffer, AVPacket *pkt,
                                AVPacketList **plast_pktl){
-    AVPacketList *pktl = av_mallocz(sizeof(AVPacketList));
+    AVPacketList *pktl = ff_slab_mallocz(sizeof(AVPacketList));
     if (!pktl)
         return NULL;
 
@@ -692,7 +794,7 @@ int av_read_packet(AVFormatContext *s, AVPacket *pkt)
                 pd->buf_size = 0;
                 s->raw_packet_buffer = pktl->next;
                 s->raw_packet_buffer_remaining_size += pkt->size;
-                av_free(pktl);
+                ff_slab_free(pktl);
                 return 0;
             }
         }
@@ -1210,7 +1312,7 @@ static int av_read_frame_internal(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
-int av_read_frame(AVFormatContext *s, AVPacket *pkt)
+static int read_frame_genpts(AVFormatContext *s, AVPacket *pkt)
 {
     AVPacketList *pktl;
     int eof=0;
@@ -1240,7 +1342,7 @@ int av_read_frame(AVFormatContext *s, AVPacket *pkt)
                 /* read packet from packet buffer, if there is data */
                 *pkt = *next_pkt;
                 s->packet_buffer = pktl->next;
-                av_free(pktl);
+                ff_slab_free(pktl);
                 return 0;
             }
         }
@@ -1264,6 +1366,16 @@ int av_read_frame(AVFormatContext *s, AVPacket *pkt)
     }
 }
 
+int av_read_frame(AVFormatContext *s, AVPacket *pkt)
+{
+    uint64_t t = av_profile_start();
+    int ret = read_frame_genpts(s, pkt);
+
+    if (t)
+        av_profile_stop(av_profile_get_probe("read_frame", s->iformat->name), t);
+    return ret;
+}
+
 /* XXX: suppress the packet queue */
 static void flush_packet_queue(AVFormatContext *s)
 {
@@ -1275,13 +1387,13 @@ static void flush_packet_queue(AVFormatContext *s)
             break;
         s->packet_buffer = pktl->next;
         av_free_packet(&pktl->pkt);
-        av_free(pktl);
+        ff_slab_free(pktl);
     }
     while(s->raw_packet_buffer){
         pktl = s->raw_packet_buffer;
         s->raw_packet_buffer = pktl->next;
         av_free_packet(&pktl->pkt);
-        av_free(pktl);
+        ff_slab_free(pktl);
     }
     s->packet_buffer_end=
     s->raw_packet_buffer_end= NULL;
@@ -2192,6 +2304,7 @@ int av_find_stream_info(AVFormatContext *ic)
     AVStream *st;
     AVPacket pkt1, *pkt;
     int64_t old_offset = url_ftell(ic->pb);
+    int64_t start_time = av_gettime();
 
     for(i=0;i<ic->nb_streams;i++) {
         AVCodec *codec;
@@ -2281,6 +2394,13 @@ int av_find_stream_info(AVFormatContext *ic)
             av_log(ic, AV_LOG_DEBUG, "Probe buffer size limit %d reached\n", ic->probesize);
             break;
         }
+        /* or we spent too much time on it */
+        if (ic->max_analyze_time &&
+            av_gettime() - start_time >= ic->max_analyze_time) {
+            ret = count;
+            av_log(ic, AV_LOG_WARNING, "max_analyze_time reached\n");
+            break;
+        }
 
         /* NOTE: a new stream can be added there if no header in file
            (AVFMTCTX_NOHEADER) */
@@ -2969,7 +3089,7 @@ void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
 {
     AVPacketList **next_point, *this_pktl;
 
-    this_pktl = av_mallocz(sizeof(AVPacketList));
+    this_pktl = ff_slab_mallocz(sizeof(AVPacketList));
     this_pktl->pkt= *pkt;
     pkt->destruct= NULL;             // do not free original but only the copy
     av_dup_packet(&this_pktl->pkt);  // duplicate the packet if it uses non-alloced memory
@@ -3031,7 +3151,7 @@ int av_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out, AVPacket *pk
 
         if(s->streams[out->stream_index]->last_in_packet_buffer == pktl)
             s->streams[out->stream_index]->last_in_packet_buffer= NULL;
-        av_freep(&pktl);
+        ff_slab_freep(&pktl);
         return 1;
     }else{
         av_init_packet(out);
@@ -3071,11 +3191,15 @@ int av_interleaved_write_frame(AVFormatContext *s, AVPacket *pkt){
 
     for(;;){
         AVPacket opkt;
+        uint64_t t;
         int ret= av_interleave_packet(s, &opkt, pkt, 0);
         if(ret<=0) //FIXME cleanup needed for ret<0 ?
             return ret;
 
+        t = av_profile_start();
         ret= s->oformat->write_packet(s, &opkt);
+        if (t)
+            av_profile_stop(av_profile_get_probe("write_packet", s->oformat->name), t);
 
         av_free_packet(&opkt);
         pkt= NULL;
@@ -164,6 +164,15 @@ static int64_t find_tag(ByteIOContext *pb, uint32_t tag1)
     return size;
 }
 
+/* There is no ACT demuxer to conflict with in this tree, so a RIFF WAVE
+ * header identifies the file as well as the RF64 one. */
+static const AVProbeSignature wav_signatures[] = {
+    { 0, 12, "RIFF\0\0\0\0WAVE", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff" },
+    { 0, 16, "RF64\0\0\0\0WAVEds64",
+      "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff\xff\xff\xff\xff" },
+    { 0 }
+};
+
 static int wav_probe(AVProbeData *p)
 {
     /* check file header */
@@ -351,6 +360,7 @@ AVInputFormat wav_demuxer = {
     wav_read_seek,
     .flags= AVFMT_GENERIC_INDEX,
     .codec_tag= (const AVCodecTag* const []){ff_codec_wav_tags, 0},
+    .signatures = wav_signatures,
 };
 #endif /* CONFIG_WAV_DEMUXER */
 
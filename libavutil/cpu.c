@@ -21,10 +21,16 @@
 #include "cpu.h"
 #include "config.h"
 
-int av_get_cpu_flags(void)
+static int flags, checked;
+
+void av_force_cpu_flags(int arg)
 {
-    static int flags, checked;
+    flags   = arg;
+    checked = arg != -1;
+}
 
+int av_get_cpu_flags(void)
+{
     if (checked)
         return flags;
 
@@ -44,6 +44,16 @@
  */
 int av_get_cpu_flags(void);
 
+/**
+ * Disable cpu detection and make av_get_cpu_flags() return the given
+ * flags instead, -1 restores the detection.
+ * This is meant for testing and benchmarking the different versions of
+ * the DSP functions, the flags are not checked against the running CPU.
+ * Only call it before the DSP contexts which should use the flags are
+ * initialized.
+ */
+void av_force_cpu_flags(int flags);
+
 /* The following CPU-specific functions shall not be called directly. */
 int ff_get_cpu_flags_arm(void);
 int ff_get_cpu_flags_ppc(void);
@@ -37,12 +37,18 @@ static struct {
     [AV_CRC_32_IEEE]    = { 0, 32, 0x04C11DB7 },
     [AV_CRC_32_IEEE_LE] = { 1, 32, 0xEDB88320 },
 };
+#if CONFIG_SMALL
 static AVCRC av_crc_table[AV_CRC_MAX][257];
+#else
+static AVCRC av_crc_table[AV_CRC_MAX][AV_CRC_SLICE8_SIZE];
+#endif
 #endif
 
 /**
  * Initialize a CRC table.
- * @param ctx must be an array of size sizeof(AVCRC)*257 or sizeof(AVCRC)*1024
+ * @param ctx must be an array of size sizeof(AVCRC)*257, sizeof(AVCRC)*1024
+ *            or sizeof(AVCRC)*AV_CRC_SLICE8_SIZE, larger tables allow
+ *            processing 4 or 8 bytes per step
  * @param le If 1, the lowest bit represents the coefficient for the highest
  *           exponent of the corresponding polynomial (both for poly and
  *           actual CRC).
@@ -62,7 +68,8 @@ int av_crc_init(AVCRC *ctx, int le, int bits, uint32_t poly, int ctx_size){
 
     if (bits < 8 || bits > 32 || poly >= (1LL<<bits))
         return -1;
-    if (ctx_size != sizeof(AVCRC)*257 && ctx_size != sizeof(AVCRC)*1024)
+    if (ctx_size != sizeof(AVCRC)*257 && ctx_size != sizeof(AVCRC)*1024 &&
+        ctx_size != sizeof(AVCRC)*AV_CRC_SLICE8_SIZE)
         return -1;
 
     for (i = 0; i < 256; i++) {
@@ -78,10 +85,22 @@ int av_crc_init(AVCRC *ctx, int le, int bits, uint32_t poly, int ctx_size){
     }
     ctx[256]=1;
 #if !CONFIG_SMALL
-    if(ctx_size >= sizeof(AVCRC)*1024)
+    if(ctx_size == sizeof(AVCRC)*1024)
         for (i = 0; i < 256; i++)
             for(j=0; j<3; j++)
                 ctx[256*(j+1) + i]= (ctx[256*j + i]>>8) ^ ctx[ ctx[256*j + i]&0xFF ];
+    if (ctx_size == sizeof(AVCRC)*AV_CRC_SLICE8_SIZE) {
+        /* table j gives the CRC of a byte followed by j zero bytes; the
+           tables after the first one start at 257, ctx[256] marks the layout */
+        const AVCRC *prev = ctx;
+        for (j = 1; j < 8; j++) {
+            AVCRC *t = ctx + 1 + 256*j;
+            for (i = 0; i < 256; i++)
+                t[i] = (prev[i]>>8) ^ ctx[prev[i]&0xFF];
+            prev = t;
+        }
+        ctx[256] = 8;
+    }
 #endif
 
     return 0;
@@ -116,7 +135,25 @@ uint32_t av_crc(const AVCRC *ctx, uint32_t crc, const uint8_t *buffer, size_t le
     const uint8_t *end= buffer+length;
 
 #if !CONFIG_SMALL
-    if(!ctx[256]) {
+    if (ctx[256] == 8) {
+        const AVCRC *t = ctx + 1;
+        while(((intptr_t) buffer & 3) && buffer < end)
+            crc = ctx[((uint8_t)crc) ^ *buffer++] ^ (crc >> 8);
+
+        while(buffer<end-7){
+            uint32_t a = av_le2ne32(((const uint32_t*)buffer)[0]) ^ crc;
+            uint32_t b = av_le2ne32(((const uint32_t*)buffer)[1]);
+            buffer += 8;
+            crc =  t[7*256 + ( a     &0xFF)]
+                  ^t[6*256 + ((a>>8 )&0xFF)]
+                  ^t[5*256 + ((a>>16)&0xFF)]
+                  ^t[4*256 + ((a>>24)     )]
+                  ^t[3*256 + ( b     &0xFF)]
+                  ^t[2*256 + ((b>>8 )&0xFF)]
+                  ^t[1*256 + ((b>>16)&0xFF)]
+                  ^ctx[        ((b>>24)     )];
+        }
+    } else if(!ctx[256]) {
         while(((intptr_t) buffer & 3) && buffer < end)
             crc = ctx[((uint8_t)crc) ^ *buffer++] ^ (crc >> 8);
 
@@ -139,12 +176,14 @@ uint32_t av_crc(const AVCRC *ctx, uint32_t crc, const uint8_t *buffer, size_t le
 #undef printf
 int main(void){
     uint8_t buf[1999];
-    int i;
+    int i, j, len;
+    unsigned sum = 0;
     int p[4][3]={{AV_CRC_32_IEEE_LE, 0xEDB88320, 0x3D5CDD04},
                  {AV_CRC_32_IEEE   , 0x04C11DB7, 0xC0F5BAE0},
                  {AV_CRC_16_ANSI   , 0x8005,     0x1FBB    },
                  {AV_CRC_8_ATM     , 0x07,       0xE3      },};
     const AVCRC *ctx;
+    static AVCRC ctx1[257], ctx4[1024], ctx8[AV_CRC_SLICE8_SIZE];
 
     for(i=0; i<sizeof(buf); i++)
         buf[i]= i+i*i;
@@ -153,6 +192,36 @@ int main(void){
         ctx = av_crc_get_table(p[i][0]);
         printf("crc %08X =%X\n", p[i][1], av_crc(ctx, 0, buf, sizeof(buf)));
     }
+
+    /* all table sizes must give the same results, whatever the alignment */
+    for (i = 0; i < 2; i++) {
+        av_crc_init(ctx1, !i, 32, p[i][1], sizeof(ctx1));
+        av_crc_init(ctx4, !i, 32, p[i][1], sizeof(ctx4));
+        av_crc_init(ctx8, !i, 32, p[i][1], sizeof(ctx8));
+        for (j = 0; j < 8; j++)
+            for (len = 0; len < 40; len++)
+                if (av_crc(ctx1, 0, buf + j, len) != av_crc(ctx4, 0, buf + j, len) ||
+                    av_crc(ctx1, 0, buf + j, len) != av_crc(ctx8, 0, buf + j, len))
+                    printf("mismatch for %08X, offset %d, length %d\n", p[i][1], j, len);
+    }
+
+    for (i = 0; i < 1000; i++) {
+        START_TIMER
+        sum += av_crc(ctx1, 0, buf, sizeof(buf));
+        STOP_TIMER("av_crc 257")
+    }
+    for (i = 0; i < 1000; i++) {
+        START_TIMER
+        sum += av_crc(ctx4, 0, buf, sizeof(buf));
+        STOP_TIMER("av_crc 1024")
+    }
+    for (i = 0; i < 1000; i++) {
+        START_TIMER
+        sum += av_crc(ctx8, 0, buf, sizeof(buf));
+        STOP_TIMER("av_crc slice8")
+    }
+    /* use the results, av_crc() is pure and the calls could be dropped */
+    printf("sum %08X\n", sum);
     return 0;
 }
 #endif
@@ -27,6 +27,12 @@
 
 typedef uint32_t AVCRC;
 
+/**
+ * Size in entries of a CRC table which allows av_crc() to process 8 bytes
+ * per step.
+ */
+#define AV_CRC_SLICE8_SIZE (257 + 7*256)
+
 typedef enum {
     AV_CRC_8_ATM,
     AV_CRC_16_ANSI,
@@ -122,6 +122,7 @@ struct AVExpr {
         e_mod, e_max, e_min, e_eq, e_gt, e_gte,
         e_pow, e_mul, e_div, e_add,
         e_last, e_st, e_while,
+        e_mov, e_jz, e_jmp,     ///< only used in compiled programs
     } type;
     double value; // is sign in other types
     union {
@@ -131,8 +132,40 @@ struct AVExpr {
         double (*func2)(void *, double, double);
     } a;
     struct AVExpr *param[2];
+    struct ExprProgram *prog;   ///< compiled form of the whole expression, set in the root
 };
 
+/**
+ * One instruction of a compiled expression. The operands and the result
+ * are registers; the operation is one of the AVExpr types.
+ */
+typedef struct ExprInsn {
+    int type;
+    int dst, src[2];
+    double value;
+    union {
+        int const_index;
+        int jump;               ///< index of the target instruction
+        double (*func0)(double);
+        double (*func1)(void *, double);
+        double (*func2)(void *, double, double);
+    } a;
+} ExprInsn;
+
+#define MAX_REGS 256
+
+typedef struct ExprProgram {
+    ExprInsn *insns;
+    int nb_insns;
+    int *const_regs;            ///< registers holding constant values
+    double *const_vals;
+    int nb_consts;
+    int nb_regs;
+    int result;                 ///< register holding the result
+    int nb_vars;                ///< number of const_values used
+    int straight;               ///< no jumps and no variables
+} ExprProgram;
+
 static double eval_expr(Parser *p, AVExpr *e)
 {
     switch (e->type) {
@@ -175,11 +208,22 @@ static double eval_expr(Parser *p, AVExpr *e)
 
 static int parse_expr(AVExpr **e, Parser *p);
 
+static void free_program(ExprProgram *prog)
+{
+    if (!prog)
+        return;
+    av_free(prog->insns);
+    av_free(prog->const_regs);
+    av_free(prog->const_vals);
+    av_free(prog);
+}
+
 void av_expr_free(AVExpr *e)
 {
     if (!e) return;
     av_expr_free(e->param[0]);
     av_expr_free(e->param[1]);
+    free_program(e->prog);
     av_freep(&e);
 }
 
@@ -444,6 +488,278 @@ static int verify_expr(AVExpr *e)
     }
 }
 
+/**
+ * Compilation of the parse tree into a flat program: each node becomes
+ * one instruction writing a new register, operations on constants are
+ * folded, and identical pure subexpressions are computed only once.
+ */
+typedef struct Compiler {
+    ExprInsn *insns;
+    int nb_insns, insns_size;
+    double reg_val[MAX_REGS];
+    uint8_t reg_flags[MAX_REGS];
+    int nb_regs;
+    int cse_start;              ///< first instruction usable for CSE
+    int nb_vars;
+    int straight;
+} Compiler;
+
+#define REG_CONST   1           ///< the register holds reg_val
+#define REG_USED    2           ///< the constant is used by the program
+#define REG_PURE    4           ///< the value only depends on const_values
+
+static av_always_inline double apply_op(const ExprInsn *in, double d, double d2)
+{
+    switch (in->type) {
+    case e_func0:  return in->value * in->a.func0(d);
+    case e_squish: return 1/(1+exp(4*d));
+    case e_gauss:  return exp(-d*d/2)/sqrt(2*M_PI);
+    case e_isnan:  return in->value * !!isnan(d);
+    case e_mod:    return in->value * (d - floor(d/d2)*d2);
+    case e_max:    return in->value * (d >  d2 ?   d : d2);
+    case e_min:    return in->value * (d <  d2 ?   d : d2);
+    case e_eq:     return in->value * (d == d2 ? 1.0 : 0.0);
+    case e_gt:     return in->value * (d >  d2 ? 1.0 : 0.0);
+    case e_gte:    return in->value * (d >= d2 ? 1.0 : 0.0);
+    case e_pow:    return in->value * pow(d, d2);
+    case e_mul:    return in->value * (d * d2);
+    case e_div:    return in->value * (d / d2);
+    case e_add:    return in->value * (d + d2);
+    case e_last:   return in->value * d2;
+    }
+    return NAN;
+}
+
+static int new_reg(Compiler *c, int flags)
+{
+    if (c->nb_regs == MAX_REGS)
+        return AVERROR(ENOSPC);
+    c->reg_flags[c->nb_regs] = flags;
+    return c->nb_regs++;
+}
+
+static int const_reg(Compiler *c, double value)
+{
+    int i;
+
+    for (i = 0; i < c->nb_regs; i++)
+        if (c->reg_flags[i] & REG_CONST && !memcmp(&c->reg_val[i], &value, sizeof(value)))
+            return i;
+    if ((i = new_reg(c, REG_CONST | REG_PURE)) < 0)
+        return i;
+    c->reg_val[i] = value;
+    return i;
+}
+
+static void use_reg(Compiler *c, int reg)
+{
+    if (reg >= 0)
+        c->reg_flags[reg] |= REG_USED;
+}
+
+/**
+ * Append in to the program, or reuse the register of an identical pure
+ * instruction.
+ * @return the register holding the result, or a negative error code
+ */
+static int emit(Compiler *c, ExprInsn *in, int pure)
+{
+    int i;
+
+    if (pure) {
+        for (i = c->cse_start; i < c->nb_insns; i++) {
+            ExprInsn *o = &c->insns[i];
+            if (c->reg_flags[o->dst] & REG_PURE &&
+                o->type == in->type && o->value == in->value &&
+                o->src[0] == in->src[0] && o->src[1] == in->src[1] &&
+                !memcmp(&o->a, &in->a, sizeof(in->a)))
+                return o->dst;
+        }
+    }
+    if (in->dst < 0 && (in->dst = new_reg(c, pure ? REG_PURE : 0)) < 0)
+        return in->dst;
+    if (c->nb_insns == c->insns_size) {
+        int size = 2 * c->insns_size + 16;
+        ExprInsn *insns = av_realloc(c->insns, size * sizeof(*insns));
+        if (!insns)
+            return AVERROR(ENOMEM);
+        c->insns      = insns;
+        c->insns_size = size;
+    }
+    use_reg(c, in->src[0]);
+    use_reg(c, in->src[1]);
+    c->insns[c->nb_insns++] = *in;
+    return in->dst;
+}
+
+static int compile_expr(Compiler *c, AVExpr *e)
+{
+    ExprInsn in = { e->type, -1, { -1, -1 }, e->value };
+    int i, pure, cond, jz, loop;
+
+    switch (e->type) {
+    case e_value:
+        return const_reg(c, e->value);
+    case e_const:
+        in.a.const_index = e->a.const_index;
+        c->nb_vars = FFMAX(c->nb_vars, e->a.const_index + 1);
+        return emit(c, &in, 1);
+    case e_while:
+        /* d = NAN; while (cond) d = body; */
+        c->straight = 0;
+        if ((in.dst = new_reg(c, 0)) < 0 || (i = const_reg(c, NAN)) < 0)
+            return AVERROR(ENOSPC);
+        in.type   = e_mov;
+        in.src[0] = i;
+        if ((i = emit(c, &in, 0)) < 0)
+            return i;
+        loop = c->nb_insns;
+        if ((cond = compile_expr(c, e->param[0])) < 0)
+            return cond;
+        if (c->reg_flags[cond] & REG_CONST && !c->reg_val[cond])
+            return in.dst;
+        jz = c->nb_insns;
+        in.type   = e_jz;
+        in.src[0] = cond;
+        if ((i = emit(c, &in, 0)) < 0)
+            return i;
+        c->cse_start = c->nb_insns;
+        if ((i = compile_expr(c, e->param[1])) < 0)
+            return i;
+        in.type   = e_mov;
+        in.src[0] = i;
+        if ((i = emit(c, &in, 0)) < 0)
+            return i;
+        in.type   = e_jmp;
+        in.src[0] = -1;
+        in.a.jump = loop;
+        if ((i = emit(c, &in, 0)) < 0)
+            return i;
+        c->insns[jz].a.jump = c->nb_insns;
+        /* the body may not be executed, so its values cannot be reused
+           after the loop */
+        c->cse_start = c->nb_insns;
+        return in.dst;
+    }
+
+    if ((in.src[0] = compile_expr(c, e->param[0])) < 0)
+        return in.src[0];
+    if (e->param[1] && (in.src[1] = compile_expr(c, e->param[1])) < 0)
+        return in.src[1];
+    pure = c->reg_flags[in.src[0]] & REG_PURE &&
+           (in.src[1] < 0 || c->reg_flags[in.src[1]] & REG_PURE);
+
+    switch (e->type) {
+    case e_func1:
+        in.a.func1 = e->a.func1;
+        pure = 0;
+        break;
+    case e_func2:
+        in.a.func2 = e->a.func2;
+        pure = 0;
+        break;
+    case e_ld:
+    case e_st:
+        /* these depend on more than their operands */
+        c->straight = 0;
+        pure = 0;
+        break;
+    case e_func0:
+        in.a.func0 = e->a.func0;
+    default:
+        if (c->reg_flags[in.src[0]] & REG_CONST &&
+            (in.src[1] < 0 || c->reg_flags[in.src[1]] & REG_CONST))
+            return const_reg(c, apply_op(&in, c->reg_val[in.src[0]],
+                                         in.src[1] < 0 ? 0 : c->reg_val[in.src[1]]));
+    }
+    return emit(c, &in, pure);
+}
+
+static int compile_program(AVExpr *e)
+{
+    Compiler *c = av_mallocz(sizeof(Compiler));
+    ExprProgram *prog = av_mallocz(sizeof(ExprProgram));
+    int i, ret;
+
+    if (!c || !prog) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    c->straight = 1;
+    if ((ret = compile_expr(c, e)) < 0)
+        goto fail;
+    prog->result = ret;
+    use_reg(c, ret);
+
+    for (i = 0; i < c->nb_regs; i++)
+        if ((c->reg_flags[i] & (REG_CONST|REG_USED)) == (REG_CONST|REG_USED))
+            prog->nb_consts++;
+    prog->const_regs = av_malloc(prog->nb_consts * sizeof(*prog->const_regs));
+    prog->const_vals = av_malloc(prog->nb_consts * sizeof(*prog->const_vals));
+    if (prog->nb_consts && (!prog->const_regs || !prog->const_vals)) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    prog->nb_consts = 0;
+    for (i = 0; i < c->nb_regs; i++) {
+        if ((c->reg_flags[i] & (REG_CONST|REG_USED)) == (REG_CONST|REG_USED)) {
+            prog->const_regs[prog->nb_consts  ] = i;
+            prog->const_vals[prog->nb_consts++] = c->reg_val[i];
+        }
+    }
+    prog->insns    = c->insns;
+    prog->nb_insns = c->nb_insns;
+    prog->nb_regs  = c->nb_regs;
+    prog->nb_vars  = c->nb_vars;
+    prog->straight = c->straight;
+    e->prog = prog;
+    av_free(c);
+    return 0;
+fail:
+    if (c)
+        av_free(c->insns);
+    av_free(c);
+    free_program(prog);
+    /* too many registers: keep evaluating the tree */
+    return ret == AVERROR(ENOSPC) ? 0 : ret;
+}
+
+static double run_program(const ExprProgram *prog, double *regs,
+                          const double *const_values, void *opaque)
+{
+    const ExprInsn *in = prog->insns, *end = prog->insns + prog->nb_insns;
+    double var[VARS] = { 0 };
+    int i;
+
+    for (i = 0; i < prog->nb_consts; i++)
+        regs[prog->const_regs[i]] = prog->const_vals[i];
+
+    while (in < end) {
+        double d = in->src[0] >= 0 ? regs[in->src[0]] : 0;
+        switch (in->type) {
+        case e_const: regs[in->dst] = in->value * const_values[in->a.const_index]; break;
+        case e_func1: regs[in->dst] = in->value * in->a.func1(opaque, d); break;
+        case e_func2: regs[in->dst] = in->value * in->a.func2(opaque, d, regs[in->src[1]]); break;
+        case e_ld:    regs[in->dst] = in->value * var[av_clip(d, 0, VARS-1)]; break;
+        case e_st:    regs[in->dst] = in->value * (var[av_clip(d, 0, VARS-1)] = regs[in->src[1]]); break;
+        case e_mov:   regs[in->dst] = d; break;
+        case e_jz:
+            if (!d) {
+                in = prog->insns + in->a.jump;
+                continue;
+            }
+            break;
+        case e_jmp:
+            in = prog->insns + in->a.jump;
+            continue;
+        default:
+            regs[in->dst] = apply_op(in, d, in->src[1] >= 0 ? regs[in->src[1]] : 0);
+        }
+        in++;
+    }
+    return regs[prog->result];
+}
+
 int av_expr_parse(AVExpr **expr, const char *s,
                   const char * const *const_names,
                   const char * const *func1_names, double (* const *funcs1)(void *, double),
@@ -487,6 +803,10 @@ int av_expr_parse(AVExpr **expr, const char *s,
         ret = AVERROR(EINVAL);
         goto end;
     }
+    if ((ret = compile_program(e)) < 0) {
+        av_expr_free(e);
+        goto end;
+    }
     *expr = e;
 end:
     av_free(w);
@@ -497,11 +817,120 @@ double av_expr_eval(AVExpr *e, const double *const_values, void *opaque)
 {
     Parser p;
 
+    if (e->prog) {
+        double regs[MAX_REGS];
+        return run_program(e->prog, regs, const_values, opaque);
+    }
     p.const_values = const_values;
     p.opaque     = opaque;
     return eval_expr(&p, e);
 }
 
+/* return the number of const_values used by e */
+static int count_vars(AVExpr *e)
+{
+    if (!e)
+        return 0;
+    return FFMAX3(e->type == e_const ? e->a.const_index + 1 : 0,
+                  count_vars(e->param[0]), count_vars(e->param[1]));
+}
+
+#define BATCH_BLOCK 32
+#define BATCH_REGS  64
+
+/* evaluate a straight program one instruction at a time over blocks of
+   values; the registers which are the same for all values are computed once */
+static void run_program_batch(const ExprProgram *prog, double *res, int count,
+                              const double *const_values,
+                              const double * const *const_arrays, void *opaque)
+{
+    double regs[BATCH_REGS][BATCH_BLOCK];
+    uint8_t uniform[BATCH_REGS];
+    const ExprInsn *in, *end = prog->insns + prog->nb_insns;
+    int i, j, n;
+
+    memset(uniform, 0, sizeof(uniform));
+    for (i = 0; i < prog->nb_consts; i++) {
+        for (j = 0; j < BATCH_BLOCK; j++)
+            regs[prog->const_regs[i]][j] = prog->const_vals[i];
+        uniform[prog->const_regs[i]] = 1;
+    }
+    for (in = prog->insns; in < end; in++) {
+        double d;
+        if (in->type == e_const) {
+            if (const_arrays[in->a.const_index])
+                continue;
+            d = in->value * const_values[in->a.const_index];
+        } else if (in->type == e_func1 || in->type == e_func2 ||
+                   !uniform[in->src[0]] || (in->src[1] >= 0 && !uniform[in->src[1]])) {
+            continue;
+        } else
+            d = apply_op(in, regs[in->src[0]][0], in->src[1] >= 0 ? regs[in->src[1]][0] : 0);
+        for (j = 0; j < BATCH_BLOCK; j++)
+            regs[in->dst][j] = d;
+        uniform[in->dst] = 1;
+    }
+
+    for (i = 0; i < count; i += n) {
+        n = FFMIN(count - i, BATCH_BLOCK);
+        for (in = prog->insns; in < end; in++) {
+            double *dst = regs[in->dst];
+            const double *s0 = in->src[0] >= 0 ? regs[in->src[0]] : NULL;
+            const double *s1 = in->src[1] >= 0 ? regs[in->src[1]] : NULL;
+            const double v = in->value;
+
+            if (uniform[in->dst])
+                continue;
+            switch (in->type) {
+            case e_const: {
+                const double *src = const_arrays[in->a.const_index] + i;
+                for (j = 0; j < n; j++) dst[j] = v * src[j];
+                break;
+            }
+            case e_func1: for (j = 0; j < n; j++) dst[j] = v * in->a.func1(opaque, s0[j]);        break;
+            case e_func2: for (j = 0; j < n; j++) dst[j] = v * in->a.func2(opaque, s0[j], s1[j]); break;
+            case e_add:   for (j = 0; j < n; j++) dst[j] = v * (s0[j] + s1[j]);                   break;
+            case e_mul:   for (j = 0; j < n; j++) dst[j] = v * (s0[j] * s1[j]);                   break;
+            case e_div:   for (j = 0; j < n; j++) dst[j] = v * (s0[j] / s1[j]);                   break;
+            case e_max:   for (j = 0; j < n; j++) dst[j] = v * (s0[j] > s1[j] ? s0[j] : s1[j]);   break;
+            case e_min:   for (j = 0; j < n; j++) dst[j] = v * (s0[j] < s1[j] ? s0[j] : s1[j]);   break;
+            default:
+                for (j = 0; j < n; j++)
+                    dst[j] = apply_op(in, s0[j], s1 ? s1[j] : 0);
+            }
+        }
+        memcpy(res + i, regs[prog->result], n * sizeof(*res));
+    }
+}
+
+int av_expr_eval_batch(AVExpr *e, double *res, int count,
+                       const double *const_values,
+                       const double * const *const_arrays, void *opaque)
+{
+    double values_buf[64], *values = values_buf;
+    int i, j, nb_vars = e->prog ? e->prog->nb_vars : count_vars(e);
+
+    if (e->prog && e->prog->straight && e->prog->nb_regs <= BATCH_REGS) {
+        run_program_batch(e->prog, res, count, const_values, const_arrays, opaque);
+        return 0;
+    }
+
+    /* evaluate each set of values on its own */
+    if (nb_vars > FF_ARRAY_ELEMS(values_buf) &&
+        !(values = av_malloc(nb_vars * sizeof(*values))))
+        return AVERROR(ENOMEM);
+    memcpy(values, const_values, nb_vars * sizeof(*values));
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < nb_vars; j++)
+            if (const_arrays[j])
+                values[j] = const_arrays[j][i];
+        res[i] = av_expr_eval(e, values, opaque);
+    }
+    if (values != values_buf)
+        av_free(values);
+    return 0;
+}
+
 int av_expr_parse_and_eval(double *d, const char *s,
                            const char * const *const_names, const double *const_values,
                            const char * const *func1_names, double (* const *funcs1)(void *, double),
@@ -631,6 +1060,34 @@ int main(void)
                            NULL, NULL, NULL, NULL, NULL, 0, NULL);
     printf("%f == 0.931322575\n", d);
 
+    {
+        static const char *xy_names[] = { "X", "Y", NULL };
+        double xs[100], res[100], xy[2] = { 0, 3 };
+        const double *arrays[2] = { xs, NULL };
+        AVExpr *e;
+
+        for (i = 0; i < 100; i++)
+            xs[i] = i;
+        if (av_expr_parse(&e, "X*X/(Y+1)+max(X,50)*sin(Y)", xy_names,
+                          NULL, NULL, NULL, NULL, 0, NULL) >= 0) {
+            av_expr_eval_batch(e, res, 100, xy, arrays, NULL);
+            for (i = 0; i < 100; i++) {
+                xy[0] = i;
+                if (res[i] != av_expr_eval(e, xy, NULL))
+                    break;
+            }
+            printf("av_expr_eval_batch() %s av_expr_eval()\n", i == 100 ? "==" : "!=");
+            av_expr_free(e);
+        }
+        /* X*2 of the loop body is never evaluated */
+        if (av_expr_parse(&e, "while(ld(0), X*2); X*2", xy_names,
+                          NULL, NULL, NULL, NULL, 0, NULL) >= 0) {
+            xy[0] = 5;
+            printf("%f == 10\n", av_expr_eval(e, xy, NULL));
+            av_expr_free(e);
+        }
+    }
+
     for (i=0; i<1050; i++) {
         START_TIMER
             av_expr_parse_and_eval(&d, "1+(5-2)^(3-1)+1/2+sin(PI)-max(-2.2,-3.1)",
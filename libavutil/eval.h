@@ -86,6 +86,24 @@ int av_expr_parse(AVExpr **expr, const char *s,
  */
 double av_expr_eval(AVExpr *e, const double *const_values, void *opaque);
 
+/**
+ * Evaluate a previously parsed expression for count sets of values of
+ * the constants. This is much faster than calling av_expr_eval() for
+ * each set, for example to evaluate an expression for each pixel.
+ *
+ * @param res array where the count results are put
+ * @param const_values values of the identifiers from av_expr_parse()
+ * const_names which are the same for all the evaluations
+ * @param const_arrays array with one entry per identifier from
+ * av_expr_parse() const_names: an array of count values for the
+ * identifier, or NULL to use the value from const_values
+ * @param opaque a pointer which will be passed to all functions from funcs1 and funcs2
+ * @return 0 in case of success, a negative AVERROR code otherwise
+ */
+int av_expr_eval_batch(AVExpr *e, double *res, int count,
+                       const double *const_values,
+                       const double * const *const_arrays, void *opaque);
+
 /**
  * Free a parsed expression previously created with av_expr_parse().
  */
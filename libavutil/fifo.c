@@ -19,7 +19,16 @@
  * License along with FFmpeg; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+#if HAVE_MEMORYBARRIER
+#include <windows.h>
+#endif
 #include "common.h"
+#include "error.h"
 #include "fifo.h"
 
 AVFifoBuffer *av_fifo_alloc(unsigned int size)
@@ -127,3 +136,216 @@ void av_fifo_drain(AVFifoBuffer *f, int size)
         f->rptr -= f->end - f->buffer;
     f->rndx += size;
 }
+
+struct AVFifoSPSC {
+    uint8_t *buffer;
+    unsigned int mask;
+    /* the indices run freely and are each written by a single thread,
+     * keep them in separate cache lines */
+    volatile unsigned int rndx;
+    uint8_t pad[60];
+    volatile unsigned int wndx;
+    volatile int read_waiting, write_waiting, abort;
+#if HAVE_PTHREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+};
+
+#if HAVE_SYNC_SYNCHRONIZE
+#define memory_barrier() __sync_synchronize()
+#elif HAVE_MEMORYBARRIER
+#define memory_barrier() MemoryBarrier()
+#elif HAVE_PTHREADS
+static pthread_mutex_t barrier_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define memory_barrier() do {                   \
+        pthread_mutex_lock(&barrier_mutex);     \
+        pthread_mutex_unlock(&barrier_mutex);   \
+    } while (0)
+#else
+#define memory_barrier() do { } while (0)
+#endif
+
+AVFifoSPSC *av_fifo_spsc_alloc(unsigned int size)
+{
+    AVFifoSPSC *f;
+    unsigned int alloc_size = 1;
+
+    if (size > INT_MAX / 2 + 1)
+        return NULL;
+    while (alloc_size < size)
+        alloc_size <<= 1;
+    if (!(f = av_mallocz(sizeof(*f))))
+        return NULL;
+    if (!(f->buffer = av_malloc(alloc_size))) {
+        av_free(f);
+        return NULL;
+    }
+    f->mask = alloc_size - 1;
+#if HAVE_PTHREADS
+    pthread_mutex_init(&f->mutex, NULL);
+    pthread_cond_init(&f->cond, NULL);
+#endif
+    return f;
+}
+
+void av_fifo_spsc_free(AVFifoSPSC *f)
+{
+    if (f) {
+#if HAVE_PTHREADS
+        pthread_mutex_destroy(&f->mutex);
+        pthread_cond_destroy(&f->cond);
+#endif
+        av_free(f->buffer);
+        av_free(f);
+    }
+}
+
+int av_fifo_spsc_size(AVFifoSPSC *f)
+{
+    return f->wndx - f->rndx;
+}
+
+int av_fifo_spsc_space(AVFifoSPSC *f)
+{
+    return f->mask + 1 - (f->wndx - f->rndx);
+}
+
+/**
+ * Wait until avail() returns at least size. The waiting thread sets its
+ * flag before checking again, the other thread updates its index before
+ * checking the flag, so at least one of them sees the other's write.
+ */
+static int spsc_wait(AVFifoSPSC *f, int size, int64_t timeout,
+                     int (*avail)(AVFifoSPSC *f), volatile int *waiting)
+{
+    int ret = avail(f);
+
+    if (ret < size && timeout) {
+#if HAVE_PTHREADS
+        struct timespec deadline;
+
+        if (timeout > 0) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            timeout += now.tv_usec;
+            deadline.tv_sec  = now.tv_sec + timeout / 1000000;
+            deadline.tv_nsec = timeout % 1000000 * 1000;
+        }
+        pthread_mutex_lock(&f->mutex);
+        *waiting = 1;
+        memory_barrier();
+        while ((ret = avail(f)) < size && !f->abort) {
+            if (timeout < 0)
+                pthread_cond_wait(&f->cond, &f->mutex);
+            else if (pthread_cond_timedwait(&f->cond, &f->mutex, &deadline))
+                break;
+        }
+        *waiting = 0;
+        pthread_mutex_unlock(&f->mutex);
+#endif
+    }
+    memory_barrier();
+    if (ret >= size)
+        return ret;
+    return f->abort ? AVERROR_EOF : AVERROR(EAGAIN);
+}
+
+static void spsc_wake(AVFifoSPSC *f, volatile int *waiting)
+{
+    memory_barrier();
+#if HAVE_PTHREADS
+    if (*waiting) {
+        pthread_mutex_lock(&f->mutex);
+        pthread_cond_broadcast(&f->cond);
+        pthread_mutex_unlock(&f->mutex);
+    }
+#endif
+}
+
+int av_fifo_spsc_wait_size(AVFifoSPSC *f, int size, int64_t timeout)
+{
+    return spsc_wait(f, size, timeout, av_fifo_spsc_size, &f->read_waiting);
+}
+
+int av_fifo_spsc_wait_space(AVFifoSPSC *f, int size, int64_t timeout)
+{
+    return spsc_wait(f, size, timeout, av_fifo_spsc_space, &f->write_waiting);
+}
+
+int av_fifo_spsc_read(AVFifoSPSC *f, void *dest, int size, int64_t timeout)
+{
+    int ret = av_fifo_spsc_wait_size(f, size, timeout);
+    uint8_t *ptr;
+    int len;
+
+    if (ret < 0)
+        return ret;
+    if (dest) {
+        len = FFMIN(av_fifo_spsc_peek_read(f, &ptr), size);
+        memcpy(dest, ptr, len);
+        memcpy((uint8_t *)dest + len, f->buffer, size - len);
+    }
+    av_fifo_spsc_commit_read(f, size);
+    return size;
+}
+
+int av_fifo_spsc_write(AVFifoSPSC *f, const void *src, int size, int64_t timeout)
+{
+    int ret = av_fifo_spsc_wait_space(f, size, timeout);
+    uint8_t *ptr;
+    int len;
+
+    if (ret < 0)
+        return ret;
+    len = FFMIN(av_fifo_spsc_peek_write(f, &ptr), size);
+    memcpy(ptr, src, len);
+    memcpy(f->buffer, (const uint8_t *)src + len, size - len);
+    av_fifo_spsc_commit_write(f, size);
+    return size;
+}
+
+int av_fifo_spsc_peek_read(AVFifoSPSC *f, uint8_t **ptr)
+{
+    unsigned int offset = f->rndx & f->mask;
+    int size = av_fifo_spsc_size(f);
+
+    memory_barrier();
+    *ptr = f->buffer + offset;
+    return FFMIN(size, f->mask + 1 - offset);
+}
+
+void av_fifo_spsc_commit_read(AVFifoSPSC *f, int size)
+{
+    memory_barrier();
+    f->rndx += size;
+    spsc_wake(f, &f->write_waiting);
+}
+
+int av_fifo_spsc_peek_write(AVFifoSPSC *f, uint8_t **ptr)
+{
+    unsigned int offset = f->wndx & f->mask;
+    int space = av_fifo_spsc_space(f);
+
+    memory_barrier();
+    *ptr = f->buffer + offset;
+    return FFMIN(space, f->mask + 1 - offset);
+}
+
+void av_fifo_spsc_commit_write(AVFifoSPSC *f, int size)
+{
+    memory_barrier();
+    f->wndx += size;
+    spsc_wake(f, &f->read_waiting);
+}
+
+void av_fifo_spsc_abort(AVFifoSPSC *f)
+{
+    f->abort = 1;
+    memory_barrier();
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&f->mutex);
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->mutex);
+#endif
+}
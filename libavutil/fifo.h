@@ -113,4 +113,102 @@ static inline uint8_t av_fifo_peek(AVFifoBuffer *f, int offs)
         ptr -= f->end - f->buffer;
     return *ptr;
 }
+
+/**
+ * A FIFO shared by one producer and one consumer thread, which need no
+ * lock to use it. Only the producer may call the write functions and only
+ * the consumer the read functions, av_fifo_spsc_size(),
+ * av_fifo_spsc_space() and av_fifo_spsc_abort() may be called by both.
+ *
+ * The functions taking a timeout wait for data or space for at most
+ * timeout microseconds, forever if it is negative and not at all if it is
+ * 0. Waiting requires pthreads, without them these functions do not wait.
+ */
+typedef struct AVFifoSPSC AVFifoSPSC;
+
+/**
+ * Allocate an AVFifoSPSC.
+ * @param size size of the FIFO, rounded up to a power of 2
+ * @return the FIFO or NULL in case of memory allocation failure
+ */
+AVFifoSPSC *av_fifo_spsc_alloc(unsigned int size);
+
+/**
+ * Free an AVFifoSPSC, which must not be used by the other thread anymore.
+ */
+void av_fifo_spsc_free(AVFifoSPSC *f);
+
+/**
+ * Return the amount of data in bytes in the FIFO.
+ */
+int av_fifo_spsc_size(AVFifoSPSC *f);
+
+/**
+ * Return the amount of space in bytes in the FIFO.
+ */
+int av_fifo_spsc_space(AVFifoSPSC *f);
+
+/**
+ * Wait until the FIFO holds at least size bytes, called by the consumer.
+ * @return the amount of data in the FIFO, AVERROR(EAGAIN) on timeout,
+ *         AVERROR_EOF if there is not enough data and the FIFO was aborted
+ */
+int av_fifo_spsc_wait_size(AVFifoSPSC *f, int size, int64_t timeout);
+
+/**
+ * Wait until the FIFO has space for at least size bytes, called by the
+ * producer.
+ * @return the amount of space in the FIFO, AVERROR(EAGAIN) on timeout,
+ *         AVERROR_EOF if there is not enough space and the FIFO was aborted
+ */
+int av_fifo_spsc_wait_space(AVFifoSPSC *f, int size, int64_t timeout);
+
+/**
+ * Read size bytes from the FIFO, once that many are available.
+ * @param dest data destination, if NULL the data is discarded
+ * @return size or an error code of av_fifo_spsc_wait_size(), in which case
+ *         nothing is read
+ */
+int av_fifo_spsc_read(AVFifoSPSC *f, void *dest, int size, int64_t timeout);
+
+/**
+ * Write size bytes to the FIFO, once there is space for them.
+ * @return size or an error code of av_fifo_spsc_wait_space(), in which
+ *         case nothing is written
+ */
+int av_fifo_spsc_write(AVFifoSPSC *f, const void *src, int size, int64_t timeout);
+
+/**
+ * Get the data at the start of the FIFO which is contiguous in memory,
+ * to read it in place. It stays in the FIFO until av_fifo_spsc_commit_read().
+ * @param ptr set to the start of the data
+ * @return the size of the contiguous data
+ */
+int av_fifo_spsc_peek_read(AVFifoSPSC *f, uint8_t **ptr);
+
+/**
+ * Remove size bytes read in place from the FIFO.
+ */
+void av_fifo_spsc_commit_read(AVFifoSPSC *f, int size);
+
+/**
+ * Get the space at the end of the FIFO which is contiguous in memory, to
+ * write to it in place. The data written is only added to the FIFO by
+ * av_fifo_spsc_commit_write().
+ * @param ptr set to the start of the space
+ * @return the size of the contiguous space
+ */
+int av_fifo_spsc_peek_write(AVFifoSPSC *f, uint8_t **ptr);
+
+/**
+ * Add size bytes written in place to the FIFO.
+ */
+void av_fifo_spsc_commit_write(AVFifoSPSC *f, int size);
+
+/**
+ * Wake up the threads waiting on the FIFO and make all further waits
+ * fail with AVERROR_EOF once the data or space is exhausted.
+ */
+void av_fifo_spsc_abort(AVFifoSPSC *f);
+
 #endif /* AVUTIL_FIFO_H */
@@ -32,6 +32,8 @@
 
 #include <string.h>
 #include "bswap.h"
+#include "common.h"
+#include "intreadwrite.h"
 #include "md5.h"
 
 typedef struct AVMD5{
@@ -71,49 +73,89 @@ static const uint32_t T[64] = { // T[i]= fabs(sin(i+1)<<32)
     0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
 };
 
-#define CORE(i, a, b, c, d) \
+#define CORE(i, a, b, c, d, src) \
         t = S[i>>4][i&3];\
         a += T[i];\
 \
         if(i<32){\
-            if(i<16) a += (d ^ (b&(c^d))) + X[      i &15 ];\
-            else     a += (c ^ (d&(c^b))) + X[ (1+5*i)&15 ];\
+            if(i<16) a += (d ^ (b&(c^d))) + AV_RL32(src + 4*(      i &15));\
+            else     a += (c ^ (d&(c^b))) + AV_RL32(src + 4*((1+5*i)&15));\
         }else{\
-            if(i<48) a += (b^c^d)         + X[ (5+3*i)&15 ];\
-            else     a += (c^(b|~d))      + X[ (  7*i)&15 ];\
+            if(i<48) a += (b^c^d)         + AV_RL32(src + 4*((5+3*i)&15));\
+            else     a += (c^(b|~d))      + AV_RL32(src + 4*((  7*i)&15));\
         }\
         a = b + (( a << t ) | ( a >> (32 - t) ));
 
-static void body(uint32_t ABCD[4], uint32_t X[16]){
+static void body(uint32_t ABCD[4], const uint8_t *src, int nblocks){
 
     int t;
     int i av_unused;
-    unsigned int a= ABCD[3];
-    unsigned int b= ABCD[2];
-    unsigned int c= ABCD[1];
-    unsigned int d= ABCD[0];
-
-#if HAVE_BIGENDIAN
-    for(i=0; i<16; i++)
-        X[i]= av_bswap32(X[i]);
-#endif
+    unsigned int a, b, c, d;
+
+    for (; nblocks > 0; nblocks--, src += 64) {
+        a= ABCD[3];
+        b= ABCD[2];
+        c= ABCD[1];
+        d= ABCD[0];
 
 #if CONFIG_SMALL
-    for( i = 0; i < 64; i++ ){
-        CORE(i,a,b,c,d)
-        t=d; d=c; c=b; b=a; a=t;
-    }
+        for( i = 0; i < 64; i++ ){
+            CORE(i,a,b,c,d,src)
+            t=d; d=c; c=b; b=a; a=t;
+        }
 #else
-#define CORE2(i) CORE(i,a,b,c,d) CORE((i+1),d,a,b,c) CORE((i+2),c,d,a,b) CORE((i+3),b,c,d,a)
+#define CORE2(i) CORE(i,a,b,c,d,src) CORE((i+1),d,a,b,c,src) CORE((i+2),c,d,a,b,src) CORE((i+3),b,c,d,a,src)
 #define CORE4(i) CORE2(i) CORE2((i+4)) CORE2((i+8)) CORE2((i+12))
 CORE4(0) CORE4(16) CORE4(32) CORE4(48)
 #endif
 
-    ABCD[0] += d;
-    ABCD[1] += c;
-    ABCD[2] += b;
-    ABCD[3] += a;
+        ABCD[0] += d;
+        ABCD[1] += c;
+        ABCD[2] += b;
+        ABCD[3] += a;
+    }
+}
+
+#if !CONFIG_SMALL
+/* Independent buffers hashed together, their rounds are interleaved to
+ * keep more execution units busy than a single dependency chain can.
+ * More than 2 lanes run out of registers on x86-64. */
+#define LANES 2
+
+#define CORE_LANES(i, a, b, c, d) \
+        for (l = 0; l < LANES; l++) { CORE(i, a[l], b[l], c[l], d[l], src[l]) }
+
+static void body_lanes(uint32_t *ABCD[LANES], const uint8_t *src_lanes[LANES], int nblocks){
+
+    int t, l;
+    unsigned int a[LANES], b[LANES], c[LANES], d[LANES];
+    const uint8_t *src[LANES];
+
+    for (l = 0; l < LANES; l++)
+        src[l] = src_lanes[l];
+
+    for (; nblocks > 0; nblocks--) {
+        for (l = 0; l < LANES; l++) {
+            a[l] = ABCD[l][3];
+            b[l] = ABCD[l][2];
+            c[l] = ABCD[l][1];
+            d[l] = ABCD[l][0];
+        }
+
+#define CORE2_LANES(i) CORE_LANES(i,a,b,c,d) CORE_LANES((i+1),d,a,b,c) CORE_LANES((i+2),c,d,a,b) CORE_LANES((i+3),b,c,d,a)
+#define CORE4_LANES(i) CORE2_LANES(i) CORE2_LANES((i+4)) CORE2_LANES((i+8)) CORE2_LANES((i+12))
+CORE4_LANES(0) CORE4_LANES(16) CORE4_LANES(32) CORE4_LANES(48)
+
+        for (l = 0; l < LANES; l++) {
+            ABCD[l][0] += d[l];
+            ABCD[l][1] += c[l];
+            ABCD[l][2] += b[l];
+            ABCD[l][3] += a[l];
+            src[l] += 64;
+        }
+    }
 }
+#endif
 
 void av_md5_init(AVMD5 *ctx){
     ctx->len    = 0;
@@ -124,33 +166,35 @@ void av_md5_init(AVMD5 *ctx){
     ctx->ABCD[3] = 0x67452301;
 }
 
-void av_md5_update(AVMD5 *ctx, const uint8_t *src, const int len){
-    int i, j;
+void av_md5_update(AVMD5 *ctx, const uint8_t *src, int len){
+    int j;
 
     j= ctx->len & 63;
     ctx->len += len;
 
-    for( i = 0; i < len; i++ ){
-        ctx->block[j++] = src[i];
-        if( 64 == j ){
-            body(ctx->ABCD, (uint32_t*) ctx->block);
-            j = 0;
-        }
+    if (j) {
+        int cnt = FFMIN(len, 64 - j);
+        memcpy(ctx->block + j, src, cnt);
+        if (j + cnt < 64)
+            return;
+        src += cnt;
+        len -= cnt;
+        body(ctx->ABCD, ctx->block, 1);
     }
+    body(ctx->ABCD, src, len >> 6);
+    memcpy(ctx->block, src + (len & ~63), len & 63);
 }
 
 void av_md5_final(AVMD5 *ctx, uint8_t *dst){
+    static const uint8_t pad[64] = { 0x80 };
     int i;
     uint64_t finalcount= av_le2ne64(ctx->len<<3);
 
-    av_md5_update(ctx, "\200", 1);
-    while((ctx->len & 63)!=56)
-        av_md5_update(ctx, "", 1);
-
+    av_md5_update(ctx, pad, 1 + ((55 - ctx->len) & 63));
     av_md5_update(ctx, (uint8_t*)&finalcount, 8);
 
     for(i=0; i<4; i++)
-        ((uint32_t*)dst)[i]= av_le2ne32(ctx->ABCD[3-i]);
+        AV_WL32(dst + 4*i, ctx->ABCD[3-i]);
 }
 
 void av_md5_sum(uint8_t *dst, const uint8_t *src, const int len){
@@ -161,22 +205,63 @@ void av_md5_sum(uint8_t *dst, const uint8_t *src, const int len){
     av_md5_final(ctx, dst);
 }
 
+void av_md5_sum_multi(uint8_t **dst, const uint8_t **src, const int *len, int nb){
+    int i = 0;
+#if !CONFIG_SMALL
+    AVMD5 ctx[LANES];
+    uint32_t *ABCD[LANES];
+    int l, nblocks;
+
+    for (; i + LANES <= nb; i += LANES) {
+        nblocks = INT_MAX;
+        for (l = 0; l < LANES; l++) {
+            av_md5_init(&ctx[l]);
+            ABCD[l]  = ctx[l].ABCD;
+            nblocks  = FFMIN(nblocks, len[i + l] >> 6);
+        }
+        body_lanes(ABCD, src + i, nblocks);
+        for (l = 0; l < LANES; l++) {
+            ctx[l].len = nblocks * 64;
+            av_md5_update(&ctx[l], src[i + l] + nblocks * 64, len[i + l] - nblocks * 64);
+            av_md5_final(&ctx[l], dst[i + l]);
+        }
+    }
+#endif
+    for (; i < nb; i++)
+        av_md5_sum(dst[i], src[i], len[i]);
+}
+
 #ifdef TEST
 #include <stdio.h>
 #include <inttypes.h>
 #undef printf
 int main(void){
-    uint64_t md5val;
+    uint64_t md5val[2];
     int i;
-    uint8_t in[1000];
+    uint8_t in[1000], out[7][16], ref[16];
+    uint8_t *dst[7];
+    const uint8_t *src[7];
+    int len[7];
 
     for(i=0; i<1000; i++) in[i]= i*i;
-    av_md5_sum( (uint8_t*)&md5val, in,  1000); printf("%"PRId64"\n", md5val);
-    av_md5_sum( (uint8_t*)&md5val, in,  63); printf("%"PRId64"\n", md5val);
-    av_md5_sum( (uint8_t*)&md5val, in,  64); printf("%"PRId64"\n", md5val);
-    av_md5_sum( (uint8_t*)&md5val, in,  65); printf("%"PRId64"\n", md5val);
+    av_md5_sum( (uint8_t*)md5val, in,  1000); printf("%"PRId64"\n", md5val[0]);
+    av_md5_sum( (uint8_t*)md5val, in,  63); printf("%"PRId64"\n", md5val[0]);
+    av_md5_sum( (uint8_t*)md5val, in,  64); printf("%"PRId64"\n", md5val[0]);
+    av_md5_sum( (uint8_t*)md5val, in,  65); printf("%"PRId64"\n", md5val[0]);
     for(i=0; i<1000; i++) in[i]= i % 127;
-    av_md5_sum( (uint8_t*)&md5val, in,  999); printf("%"PRId64"\n", md5val);
+    av_md5_sum( (uint8_t*)md5val, in,  999); printf("%"PRId64"\n", md5val[0]);
+
+    for(i=0; i<7; i++){
+        dst[i]= out[i];
+        src[i]= in + 37*i;
+        len[i]= 64*i + 3*i;
+    }
+    av_md5_sum_multi(dst, src, len, 7);
+    for(i=0; i<7; i++){
+        av_md5_sum(ref, src[i], len[i]);
+        if(memcmp(ref, out[i], 16))
+            printf("av_md5_sum_multi() mismatch on buffer %d\n", i);
+    }
 
     return 0;
 }
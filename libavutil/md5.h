@@ -32,5 +32,15 @@ void av_md5_update(struct AVMD5 *ctx, const uint8_t *src, const int len);
 void av_md5_final(struct AVMD5 *ctx, uint8_t *dst);
 void av_md5_sum(uint8_t *dst, const uint8_t *src, const int len);
 
+/**
+ * Hash several independent buffers, which is faster than hashing them one
+ * by one, the more so the closer their lengths are.
+ *
+ * @param dst array of nb pointers to the 16 byte digests
+ * @param src array of nb pointers to the buffers
+ * @param len array of the nb buffer lengths
+ */
+void av_md5_sum_multi(uint8_t **dst, const uint8_t **src, const int *len, int nb);
+
 #endif /* AVUTIL_MD5_H */
 
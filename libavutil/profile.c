@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#include "timer.h"
+#ifndef AV_READ_TIME
+#include <sys/time.h>
+#endif
+#include "avutil.h"
+#include "log.h"
+#include "mem.h"
+#include "profile.h"
+
+#define MAX_PROBES 256
+
+typedef struct Counter {
+    uint64_t count;
+    uint64_t time;
+} Counter;
+
+/* the counters of one thread */
+typedef struct ThreadCounters {
+    Counter counters[MAX_PROBES];
+    struct ThreadCounters *next;
+} ThreadCounters;
+
+static int enabled;
+
+static struct {
+    const char *category, *name;
+} probes[MAX_PROBES];
+static int nb_probes;
+
+/* counters of the threads which have exited */
+static ThreadCounters retired;
+
+#if HAVE_PTHREADS
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static ThreadCounters *threads;
+
+static void thread_exit(void *opaque)
+{
+    ThreadCounters *t = opaque, **p;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < MAX_PROBES; i++) {
+        retired.counters[i].count += t->counters[i].count;
+        retired.counters[i].time  += t->counters[i].time;
+    }
+    for (p = &threads; *p != t; p = &(*p)->next);
+    *p = t->next;
+    pthread_mutex_unlock(&lock);
+    av_free(t);
+}
+
+static void make_key(void)
+{
+    pthread_key_create(&key, thread_exit);
+}
+
+static ThreadCounters *get_thread_counters(void)
+{
+    ThreadCounters *t;
+
+    pthread_once(&key_once, make_key);
+    if (!(t = pthread_getspecific(key))) {
+        if (!(t = av_mallocz(sizeof(*t))))
+            return NULL;
+        pthread_mutex_lock(&lock);
+        t->next = threads;
+        threads = t;
+        pthread_mutex_unlock(&lock);
+        pthread_setspecific(key, t);
+    }
+    return t;
+}
+#else
+#define pthread_mutex_lock(lock)
+#define pthread_mutex_unlock(lock)
+static ThreadCounters *threads;
+
+static ThreadCounters *get_thread_counters(void)
+{
+    return &retired;
+}
+#endif
+
+static uint64_t get_time(void)
+{
+#ifdef AV_READ_TIME
+    return AV_READ_TIME();
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+const char *av_profile_time_unit(void)
+{
+#ifdef AV_READ_TIME
+    return "cycles";
+#else
+    return "us";
+#endif
+}
+
+void av_profile_enable(int enable)
+{
+    enabled = enable;
+}
+
+uint64_t av_profile_start(void)
+{
+    return enabled ? get_time() : 0;
+}
+
+void av_profile_stop(int probe, uint64_t start)
+{
+    ThreadCounters *t;
+
+    if (probe < 0 || !start || !(t = get_thread_counters()))
+        return;
+    t->counters[probe].count++;
+    t->counters[probe].time += get_time() - start;
+}
+
+static int str_equal(const char *a, const char *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+int av_profile_get_probe(const char *category, const char *name)
+{
+    int i, n = nb_probes;
+
+    /* the strings of a probe are usually the same pointers on each call */
+    for (i = 0; i < n; i++)
+        if (probes[i].category == category && probes[i].name == name)
+            return i;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < nb_probes; i++)
+        if (str_equal(probes[i].category, category) && str_equal(probes[i].name, name))
+            break;
+    if (i == nb_probes) {
+        if (nb_probes == MAX_PROBES) {
+            i = AVERROR(ENOSPC);
+        } else {
+            probes[i].category = category;
+            probes[i].name     = name;
+            nb_probes++;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return i;
+}
+
+int av_profile_get_stats(AVProfileStats *stats, int nb_stats)
+{
+    ThreadCounters *t;
+    int i, n;
+
+    pthread_mutex_lock(&lock);
+    n = FFMIN(nb_stats, nb_probes);
+    for (i = 0; i < n; i++) {
+        stats[i].category = probes[i].category;
+        stats[i].name     = probes[i].name;
+        stats[i].count    = retired.counters[i].count;
+        stats[i].time     = retired.counters[i].time;
+        for (t = threads; t; t = t->next) {
+            stats[i].count += t->counters[i].count;
+            stats[i].time  += t->counters[i].time;
+        }
+    }
+    n = nb_probes;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+void av_profile_dump(void *log_ctx, int level)
+{
+    AVProfileStats stats[MAX_PROBES];
+    int i, n = av_profile_get_stats(stats, MAX_PROBES);
+
+    for (i = 0; i < n; i++) {
+        if (!stats[i].count)
+            continue;
+        av_log(log_ctx, level, "%-12s %-16s %10"PRIu64" calls %16"PRIu64" %s, %10"PRIu64" per call\n",
+               stats[i].category, stats[i].name ? stats[i].name : "",
+               stats[i].count, stats[i].time, av_profile_time_unit(),
+               stats[i].time / stats[i].count);
+    }
+}
+
+void av_profile_reset(void)
+{
+    ThreadCounters *t;
+
+    pthread_mutex_lock(&lock);
+    memset(retired.counters, 0, sizeof(retired.counters));
+    for (t = threads; t; t = t->next)
+        memset(t->counters, 0, sizeof(t->counters));
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Profiling probes, to measure the time spent in each processing stage.
+ *
+ * A probe is identified by a category, for example "decode", and a name,
+ * for example the name of a codec. The libraries have probes around the
+ * decoders, sws_scale(), the filters, av_read_frame() and
+ * av_interleaved_write_frame(); they cost a function call when profiling
+ * is disabled, which is the default.
+ *
+ * @code
+ * uint64_t t = av_profile_start();
+ * process();
+ * if (t)
+ *     av_profile_stop(av_profile_get_probe("process", NULL), t);
+ * @endcode
+ *
+ * The time is accumulated separately by each thread, and summed when the
+ * statistics are read.
+ */
+
+#ifndef AVUTIL_PROFILE_H
+#define AVUTIL_PROFILE_H
+
+#include <stdint.h>
+
+typedef struct AVProfileStats {
+    const char *category;
+    const char *name;           ///< may be NULL
+    uint64_t count;             ///< number of measurements
+    uint64_t time;              ///< total time, in av_profile_time_unit() units
+} AVProfileStats;
+
+/**
+ * Enable or disable profiling.
+ */
+void av_profile_enable(int enable);
+
+/**
+ * Start a measurement.
+ * @return the current time if profiling is enabled, 0 otherwise
+ */
+uint64_t av_profile_start(void);
+
+/**
+ * End a measurement started with av_profile_start() and add it to probe.
+ * Does nothing if start is 0, i.e. profiling was disabled when the
+ * measurement was started, or if probe is negative.
+ */
+void av_profile_stop(int probe, uint64_t start);
+
+/**
+ * Get the probe with the given category and name, registering it if
+ * needed. The strings are not copied, they must stay valid as long as
+ * the library is used, string literals or codec names for example.
+ *
+ * @param name may be NULL
+ * @return the probe, or a negative AVERROR code if too many probes are
+ * registered
+ */
+int av_profile_get_probe(const char *category, const char *name);
+
+/**
+ * Get the statistics of the registered probes.
+ *
+ * @param stats array where the statistics of at most nb_stats probes are
+ * put
+ * @return the number of registered probes
+ */
+int av_profile_get_stats(AVProfileStats *stats, int nb_stats);
+
+/**
+ * Print the statistics of the probes which have been hit with av_log().
+ */
+void av_profile_dump(void *log_ctx, int level);
+
+/**
+ * Reset the statistics of all the probes.
+ */
+void av_profile_reset(void);
+
+/**
+ * @return the name of the unit of the times: "cycles" or "us"
+ */
+const char *av_profile_time_unit(void);
+
+#endif /* AVUTIL_PROFILE_H */
@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * slab allocator for small objects
+ */
+
+/* needed for posix_memalign() */
+#define _XOPEN_SOURCE 600
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "config.h"
+#if HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+#if CONFIG_SLAB
+#include <pthread.h>
+#endif
+#include "avutil.h"
+#include "log.h"
+#include "mem.h"
+#include "slab.h"
+
+#if CONFIG_SLAB
+
+/* here we want to use the system allocator for the slabs */
+#undef free
+
+#ifdef MALLOC_PREFIX
+#define memalign       AV_JOIN(MALLOC_PREFIX, memalign)
+#define posix_memalign AV_JOIN(MALLOC_PREFIX, posix_memalign)
+#define free           AV_JOIN(MALLOC_PREFIX, free)
+void *memalign(size_t align, size_t size);
+int   posix_memalign(void **ptr, size_t align, size_t size);
+void  free(void *ptr);
+#endif
+
+/* The slabs are aligned to their size, so the slab of an object is found
+ * by masking its address. */
+#define SLAB_SIZE   (16 * 1024)
+#define SLAB_HEADER 64
+#define SLAB_OF(ptr) ((Slab *)((uintptr_t)(ptr) & ~(uintptr_t)(SLAB_SIZE - 1)))
+
+/* number of objects moved between a thread cache and the slabs at once,
+ * a cache holds at most twice as many */
+#define BATCH 32
+
+#define NB_CLASSES 8
+
+/* size_class of the blocks larger than FF_SLAB_MAX_SIZE, each of which is
+ * allocated with a slab header of its own */
+#define LARGE_CLASS NB_CLASSES
+
+static const uint16_t class_size[NB_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256
+};
+
+/* size class of each size in units of 16 bytes, rounded up */
+static const uint8_t size_to_class[FF_SLAB_MAX_SIZE / 16 + 1] = {
+    0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7
+};
+
+typedef struct FreeObject {
+    struct FreeObject *next;
+} FreeObject;
+
+typedef struct Slab {
+    struct Slab *prev, *next;   ///< in the list of slabs with free objects
+    FreeObject *free;           ///< free objects of this slab
+    int nb_free;
+    int nb_objects;
+    int size_class;
+} Slab;
+
+typedef struct SizeClass {
+    Slab *partial;              ///< slabs with free objects
+    int nb_slabs;
+    int nb_empty;               ///< slabs all objects of which are free
+    int objects_free;
+    uint64_t refills, flushes;
+} SizeClass;
+
+/* the cache of one thread */
+typedef struct ThreadCache {
+    FreeObject *free[NB_CLASSES];
+    int nb_free[NB_CLASSES];
+    uint64_t allocs[NB_CLASSES];
+    uint64_t frees[NB_CLASSES];
+    struct ThreadCache *next;
+} ThreadCache;
+
+static SizeClass classes[NB_CLASSES];
+
+/* counters of the threads which have exited */
+static ThreadCache retired;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static ThreadCache *threads;
+
+/* allocate size bytes aligned to SLAB_SIZE */
+static Slab *alloc_slab(size_t size)
+{
+#if HAVE_POSIX_MEMALIGN
+    void *ptr;
+    if (posix_memalign(&ptr, SLAB_SIZE, size))
+        return NULL;
+    return ptr;
+#else
+    return memalign(SLAB_SIZE, size);
+#endif
+}
+
+static Slab *new_slab(int c)
+{
+    Slab *slab;
+    uint8_t *obj;
+    int i;
+
+    if (!(slab = alloc_slab(SLAB_SIZE)))
+        return NULL;
+    slab->nb_objects = (SLAB_SIZE - SLAB_HEADER) / class_size[c];
+    slab->nb_free    = slab->nb_objects;
+    slab->size_class = c;
+    slab->free       = NULL;
+    obj = (uint8_t *)slab + SLAB_HEADER + (slab->nb_objects - 1) * class_size[c];
+    for (i = 0; i < slab->nb_objects; i++, obj -= class_size[c]) {
+        ((FreeObject *)obj)->next = slab->free;
+        slab->free = (FreeObject *)obj;
+    }
+    classes[c].nb_slabs++;
+    classes[c].nb_empty++;
+    classes[c].objects_free += slab->nb_objects;
+    return slab;
+}
+
+static void unlink_slab(SizeClass *sc, Slab *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        sc->partial = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+}
+
+static void link_slab(SizeClass *sc, Slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = sc->partial;
+    if (sc->partial)
+        sc->partial->prev = slab;
+    sc->partial = slab;
+}
+
+/**
+ * Move up to BATCH objects from the slabs into the cache.
+ * Must be called with the lock held.
+ */
+static void refill(ThreadCache *tc, int c)
+{
+    SizeClass *sc = &classes[c];
+    int n;
+
+    for (n = 0; n < BATCH; n++) {
+        Slab *slab = sc->partial;
+        FreeObject *obj;
+
+        if (!slab) {
+            if (!(slab = new_slab(c)))
+                break;
+            link_slab(sc, slab);
+        }
+        if (slab->nb_free == slab->nb_objects)
+            sc->nb_empty--;
+        obj = slab->free;
+        slab->free = obj->next;
+        if (!--slab->nb_free)
+            unlink_slab(sc, slab);
+        obj->next = tc->free[c];
+        tc->free[c] = obj;
+    }
+    tc->nb_free[c]  += n;
+    sc->objects_free -= n;
+    sc->refills++;
+}
+
+/**
+ * Move up to n objects from the cache back into their slabs. Slabs which
+ * become free are released, except for one per class which is kept to
+ * avoid allocating and freeing a slab over and over.
+ * Must be called with the lock held.
+ */
+static void flush(ThreadCache *tc, int c, int n)
+{
+    SizeClass *sc = &classes[c];
+
+    for (; n > 0 && tc->free[c]; n--) {
+        FreeObject *obj = tc->free[c];
+        Slab *slab = SLAB_OF(obj);
+
+        tc->free[c] = obj->next;
+        tc->nb_free[c]--;
+        sc->objects_free++;
+        obj->next = slab->free;
+        slab->free = obj;
+        if (!slab->nb_free++)
+            link_slab(sc, slab);
+        if (slab->nb_free == slab->nb_objects) {
+            if (sc->nb_empty) {
+                unlink_slab(sc, slab);
+                sc->nb_slabs--;
+                sc->objects_free -= slab->nb_objects;
+                free(slab);
+            } else
+                sc->nb_empty++;
+        }
+    }
+    sc->flushes++;
+}
+
+static void thread_exit(void *opaque)
+{
+    ThreadCache *tc = opaque, **p;
+    int c;
+
+    pthread_mutex_lock(&lock);
+    for (c = 0; c < NB_CLASSES; c++) {
+        flush(tc, c, tc->nb_free[c]);
+        retired.allocs[c] += tc->allocs[c];
+        retired.frees[c]  += tc->frees[c];
+    }
+    for (p = &threads; *p != tc; p = &(*p)->next);
+    *p = tc->next;
+    pthread_mutex_unlock(&lock);
+    av_free(tc);
+}
+
+static void make_key(void)
+{
+    pthread_key_create(&key, thread_exit);
+}
+
+static ThreadCache *get_thread_cache(void)
+{
+    ThreadCache *tc;
+
+    pthread_once(&key_once, make_key);
+    tc = pthread_getspecific(key);
+    if (!tc) {
+        if (!(tc = av_mallocz(sizeof(*tc))))
+            return NULL;
+        pthread_mutex_lock(&lock);
+        tc->next = threads;
+        threads  = tc;
+        pthread_mutex_unlock(&lock);
+        pthread_setspecific(key, tc);
+    }
+    return tc;
+}
+
+void *ff_slab_alloc(size_t size)
+{
+    ThreadCache *tc;
+    FreeObject *obj;
+    int c;
+
+    if (size > FF_SLAB_MAX_SIZE) {
+        Slab *slab;
+        if (size > INT_MAX - SLAB_HEADER ||
+            !(slab = alloc_slab(SLAB_HEADER + size)))
+            return NULL;
+        slab->size_class = LARGE_CLASS;
+        return (uint8_t *)slab + SLAB_HEADER;
+    }
+    if (!(tc = get_thread_cache()))
+        return NULL;
+    c = size_to_class[(size + 15) >> 4];
+    if (!tc->free[c]) {
+        pthread_mutex_lock(&lock);
+        refill(tc, c);
+        pthread_mutex_unlock(&lock);
+        if (!tc->free[c])
+            return NULL;
+    }
+    obj = tc->free[c];
+    tc->free[c] = obj->next;
+    tc->nb_free[c]--;
+    tc->allocs[c]++;
+    return obj;
+}
+
+void ff_slab_free(void *ptr)
+{
+    ThreadCache *tc;
+    FreeObject *obj = ptr;
+    int c;
+
+    if (!ptr)
+        return;
+    c = SLAB_OF(ptr)->size_class;
+    if (c == LARGE_CLASS) {
+        free(SLAB_OF(ptr));
+        return;
+    }
+    if (!(tc = get_thread_cache())) {
+        /* no cache for this thread, return the object directly */
+        ThreadCache tmp = { { 0 } };
+        tmp.free[c]    = obj;
+        tmp.nb_free[c] = 1;
+        pthread_mutex_lock(&lock);
+        flush(&tmp, c, 1);
+        retired.frees[c]++;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    obj->next = tc->free[c];
+    tc->free[c] = obj;
+    tc->frees[c]++;
+    if (++tc->nb_free[c] > 2 * BATCH) {
+        pthread_mutex_lock(&lock);
+        flush(tc, c, BATCH);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+int ff_slab_get_stats(FFSlabStats *stats, int nb_stats)
+{
+    ThreadCache *tc;
+    int c;
+
+    pthread_mutex_lock(&lock);
+    for (c = 0; c < FFMIN(nb_stats, NB_CLASSES); c++) {
+        FFSlabStats *s = &stats[c];
+        s->size         = class_size[c];
+        s->allocs       = retired.allocs[c];
+        s->frees        = retired.frees[c];
+        for (tc = threads; tc; tc = tc->next) {
+            s->allocs  += tc->allocs[c];
+            s->frees   += tc->frees[c];
+        }
+        s->refills      = classes[c].refills;
+        s->flushes      = classes[c].flushes;
+        s->slabs        = classes[c].nb_slabs;
+        s->objects      = classes[c].nb_slabs ? classes[c].nb_slabs *
+                          ((SLAB_SIZE - SLAB_HEADER) / class_size[c]) : 0;
+        s->objects_free = classes[c].objects_free;
+    }
+    pthread_mutex_unlock(&lock);
+    return NB_CLASSES;
+}
+
+#else /* CONFIG_SLAB */
+
+void *ff_slab_alloc(size_t size)
+{
+    return av_malloc(size);
+}
+
+void ff_slab_free(void *ptr)
+{
+    av_free(ptr);
+}
+
+int ff_slab_get_stats(FFSlabStats *stats, int nb_stats)
+{
+    return 0;
+}
+
+#endif /* CONFIG_SLAB */
+
+void *ff_slab_mallocz(size_t size)
+{
+    void *ptr = ff_slab_alloc(size);
+    if (ptr)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
+void ff_slab_freep(void *arg)
+{
+    void **ptr = (void **)arg;
+    ff_slab_free(*ptr);
+    *ptr = NULL;
+}
+
+void ff_slab_dump_stats(void *log_ctx, int level)
+{
+    FFSlabStats stats[16];
+    int i, nb = ff_slab_get_stats(stats, FF_ARRAY_ELEMS(stats));
+
+    for (i = 0; i < nb; i++) {
+        FFSlabStats *s = &stats[i];
+        if (!s->allocs && !s->slabs)
+            continue;
+        av_log(log_ctx, level, "slab %3d bytes: %10"PRIu64" allocs %10"PRIu64" frees "
+               "%8"PRIu64" refills %8"PRIu64" flushes %4d slabs %6d/%6d objects in use\n",
+               s->size, s->allocs, s->frees, s->refills, s->flushes, s->slabs,
+               s->objects - s->objects_free, s->objects);
+    }
+}
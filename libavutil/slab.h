@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2011 the FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Internal slab allocator for small objects which are allocated and freed
+ * at a high rate, like packet list nodes and buffer references.
+ *
+ * The objects are grouped in size classes, each served from slabs of
+ * memory shared by all threads. Every thread keeps a cache of free
+ * objects per size class, the shared slabs are only locked to move a
+ * batch of objects into or out of a cache.
+ *
+ * If the slab allocator is disabled at configure time, these functions
+ * fall back to av_malloc() and av_free().
+ */
+
+#ifndef AVUTIL_SLAB_H
+#define AVUTIL_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Largest size ff_slab_alloc() serves from the size classes, larger blocks
+ * are allocated from the system one by one.
+ */
+#define FF_SLAB_MAX_SIZE 256
+
+/**
+ * Allocate a memory block from the slab allocator, aligned like
+ * av_malloc() does.
+ * @param size size of the block
+ * @return the block, or NULL if it cannot be allocated
+ */
+void *ff_slab_alloc(size_t size);
+
+/**
+ * Allocate a memory block from the slab allocator and zero it.
+ * @see ff_slab_alloc()
+ */
+void *ff_slab_mallocz(size_t size);
+
+/**
+ * Free a memory block allocated with ff_slab_alloc() or ff_slab_mallocz(),
+ * which may be done by any thread.
+ * @param ptr the block, may be NULL
+ */
+void ff_slab_free(void *ptr);
+
+/**
+ * Free a memory block allocated with ff_slab_alloc() or ff_slab_mallocz()
+ * and set the pointer pointing to it to NULL.
+ * @param ptr pointer to the pointer to the block
+ */
+void ff_slab_freep(void *ptr);
+
+typedef struct FFSlabStats {
+    int size;                   ///< size of the objects of the class
+    uint64_t allocs;            ///< number of allocations
+    uint64_t frees;             ///< number of frees
+    uint64_t refills;           ///< batches of objects moved into a thread cache
+    uint64_t flushes;           ///< batches of objects moved out of a thread cache
+    int slabs;                  ///< number of slabs currently allocated
+    int objects;                ///< number of objects the slabs hold
+    int objects_free;           ///< objects neither allocated nor in a thread cache
+} FFSlabStats;
+
+/**
+ * Get the statistics of the size classes.
+ * @param stats array filled with the statistics of up to nb_stats classes,
+ *              in increasing order of size
+ * @return the number of size classes, 0 if the slab allocator is disabled
+ */
+int ff_slab_get_stats(FFSlabStats *stats, int nb_stats);
+
+/**
+ * Print the statistics of all size classes with av_log().
+ */
+void ff_slab_dump_stats(void *log_ctx, int level);
+
+#endif /* AVUTIL_SLAB_H */
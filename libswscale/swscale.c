@@ -66,6 +66,7 @@ untested special converters
 #include "libavutil/mathematics.h"
 #include "libavutil/bswap.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/profile.h"
 
 #undef MOVNTQ
 #undef PAVGB
@@ -1889,6 +1890,18 @@ static int check_image_pointers(uint8_t *data[4], enum PixelFormat pix_fmt,
     return 1;
 }
 
+/* run the conversion function, timed in the "sws_scale" profiling probe */
+static int call_swscale(SwsContext *c, const uint8_t* src[], int srcStride[], int srcSliceY,
+                        int srcSliceH, uint8_t* dst[], int dstStride[])
+{
+    uint64_t t = av_profile_start();
+    int ret = c->swScale(c, src, srcStride, srcSliceY, srcSliceH, dst, dstStride);
+
+    if (t)
+        av_profile_stop(av_profile_get_probe("sws_scale", NULL), t);
+    return ret;
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
@@ -1996,7 +2009,7 @@ int sws_scale(SwsContext *c, const uint8_t* const src[], const int srcStride[],
         if (srcSliceY + srcSliceH == c->srcH)
             c->sliceDir = 0;
 
-        return c->swScale(c, src2, srcStride2, srcSliceY, srcSliceH, dst2, dstStride2);
+        return call_swscale(c, src2, srcStride2, srcSliceY, srcSliceH, dst2, dstStride2);
     } else {
         // slices go from bottom to top => we flip the image internally
         int srcStride2[4]= {-srcStride[0], -srcStride[1], -srcStride[2], -srcStride[3]};
@@ -2019,7 +2032,7 @@ int sws_scale(SwsContext *c, const uint8_t* const src[], const int srcStride[],
         if (!srcSliceY)
             c->sliceDir = 0;
 
-        return c->swScale(c, src2, srcStride2, c->srcH-srcSliceY-srcSliceH, srcSliceH, dst2, dstStride2);
+        return call_swscale(c, src2, srcStride2, c->srcH-srcSliceY-srcSliceH, srcSliceH, dst2, dstStride2);
     }
 }
 
@@ -217,6 +217,10 @@ FATE_TESTS += fate-sha
 fate-sha: libavutil/sha-test$(EXESUF)
 fate-sha: CMD = run libavutil/sha-test
 
+FATE_TESTS += fate-bsf
+fate-bsf: libavcodec/bitstream_filter-test$(EXESUF)
+fate-bsf: CMD = run libavcodec/bitstream_filter-test
+
 FATE_TESTS += fate-musepack7
 fate-musepack7: CMD = pcm -i $(SAMPLES)/musepack/inside-mp7.mpc
 fate-musepack7: CMP = oneoff